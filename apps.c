@@ -11,6 +11,7 @@
 #include "wifi.h"
 #include "io.h"
 #include "terminal.h"
+#include "trace.h"
 
 /* String comparison */
 static int str_equals(const char* a, const char* b) {
@@ -74,7 +75,7 @@ static int num_apps = 7;
 
 /* Settings state */
 static int settings_win = -1;
-static int settings_resolution = 0;  /* 0=640x480, 1=320x200, 2=1280x720 */
+static int settings_resolution = 0;  /* 0=640x480, 1=320x200, 2=1024x768 */
 static int settings_mouse_speed = 1; /* 0=slow, 1=normal, 2=fast */
 static int settings_theme = 0;       /* 0=cyan, 1=gray, 2=blue */
 
@@ -243,6 +244,7 @@ app_t* apps_get(int index) {
 int app_run(const char* name) {
     for (int i = 0; i < num_apps; i++) {
         if (str_equals(apps[i].name, name)) {
+            trace("app", i);
             apps[i].run();
             return 1;
         }
@@ -250,16 +252,15 @@ int app_run(const char* name) {
     return 0;
 }
 
+/* App window closed - its ID is no longer ours */
+void app_window_closed(gui_window_t* win) {
+    *(int*)win->user_data = -1;
+}
+
 /* ==================== BROWSER APP (Potato) ==================== */
 
 static int browser_win = -1;
 
-void app_browser(void) {
-    browser_page = 0;
-    browser_win = gui_create_window(120, 50, 400, 300, "Potato Browser");
-    gui_set_active_window(browser_win);
-}
-
 void browser_draw_content(gui_window_t* win) {
     if (!win || !win->visible) return;
     
@@ -324,23 +325,32 @@ void browser_draw_content(gui_window_t* win) {
     vga_putstring(win->x + 8, status_y + 2, "Ready", COLOR_BLACK, COLOR_LIGHT_GRAY);
 }
 
-void browser_handle_key(char key) {
+void browser_handle_key(gui_window_t* win, char key) {
     if (key >= '0' && key <= '3') {
         browser_page = key - '0';
+        gui_invalidate_window(win->id);
     }
 }
 
+static const gui_window_ops_t browser_ops = {
+    .draw = browser_draw_content,
+    .key = browser_handle_key,
+    .close = app_window_closed,
+};
+
+void app_browser(void) {
+    if (gui_focus_window(browser_win)) return;  /* already open */
+    browser_page = 0;
+    browser_win = gui_create_window(120, 50, 400, 300, "Potato Browser");
+    gui_set_window_ops(browser_win, &browser_ops, &browser_win);
+    gui_set_active_window(browser_win);
+}
+
 /* ==================== FILES APP ==================== */
 
 static int files_win = -1;
 static int files_selected = -1;
 
-void app_files(void) {
-    files_win = gui_create_window(140, 70, 360, 280, "Files");
-    files_selected = -1;
-    gui_set_active_window(files_win);
-}
-
 void files_draw_content(gui_window_t* win) {
     if (!win || !win->visible) return;
     
@@ -387,12 +397,13 @@ void files_handle_click(gui_window_t* win, int mx, int my) {
         if (mx >= x && mx < x + win->width - 12 &&
             my >= y + i * 12 && my < y + i * 12 + 11) {
             files_selected = i;
+            gui_invalidate_window(win->id);
             return;
         }
     }
 }
 
-void files_handle_key(char key) {
+void files_handle_key(gui_window_t* win, char key) {
     unsigned char ukey = (unsigned char)key;
     if (key == '\n' && files_selected >= 0 && virtual_files[files_selected].name) {
         file_execute(virtual_files[files_selected].name);
@@ -403,107 +414,94 @@ void files_handle_key(char key) {
     if (ukey == KEY_DOWN && virtual_files[files_selected + 1].name) {
         files_selected++;
     }
+    gui_invalidate_window(win->id);
+}
+
+static const gui_window_ops_t files_ops = {
+    .draw = files_draw_content,
+    .key = files_handle_key,
+    .click = files_handle_click,
+    .close = app_window_closed,
+};
+
+void app_files(void) {
+    if (gui_focus_window(files_win)) return;  /* already open */
+    files_win = gui_create_window(140, 70, 360, 280, "Files");
+    gui_set_window_ops(files_win, &files_ops, &files_win);
+    files_selected = -1;
+    gui_set_active_window(files_win);
 }
 
 /* ==================== NOTEPAD APP ==================== */
 
 static int notepad_win = -1;
-static int last_notepad_cursor = -1;
 
-void app_notepad(void) {
-    notepad_win = gui_create_window(160, 60, 380, 300, "Notepad");
-    gui_set_active_window(notepad_win);
+/* Text origin inside the notepad window */
+#define NOTEPAD_TEXT_X 9
+#define NOTEPAD_TEXT_Y 28
+
+/* Window-relative position of the character cell at buffer offset pos */
+static void notepad_cell(int pos, int* cx, int* cy) {
+    int x = NOTEPAD_TEXT_X;
+    int y = NOTEPAD_TEXT_Y;
+    for (int i = 0; i < pos && notepad_buffer[i]; i++) {
+        if (notepad_buffer[i] == '\n') {
+            x = NOTEPAD_TEXT_X;
+            y += 10;
+        } else {
+            x += 8;
+        }
+    }
+    *cx = x;
+    *cy = y;
 }
 
 void notepad_draw_content(gui_window_t* win) {
     if (!win || !win->visible) return;
     
-    /* Full redraw only if cursor moved backwards or content cleared */
-    if (last_notepad_cursor > notepad_cursor || last_notepad_cursor == -1) {
-        /* Gray frame */
-        vga_fillrect(win->x + 3, win->y + 22, win->width - 6, win->height - 25, COLOR_LIGHT_GRAY);
-        
-        /* White text area (sunken) */
-        int text_x = win->x + 6;
-        int text_y = win->y + 25;
-        int text_w = win->width - 12;
-        int text_h = win->height - 31;
+    /* Gray frame */
+    vga_fillrect(win->x + 3, win->y + 22, win->width - 6, win->height - 25, COLOR_LIGHT_GRAY);
         
-        vga_fillrect(text_x, text_y, text_w, text_h, COLOR_WHITE);
-        /* Sunken border */
-        vga_hline(text_x, text_y, text_w, COLOR_DARK_GRAY);
-        vga_vline(text_x, text_y, text_h, COLOR_DARK_GRAY);
-        vga_hline(text_x, text_y + text_h - 1, text_w, COLOR_WHITE);
-        vga_vline(text_x + text_w - 1, text_y, text_h, COLOR_WHITE);
+    /* White text area (sunken) */
+    int text_x = win->x + 6;
+    int text_y = win->y + 25;
+    int text_w = win->width - 12;
+    int text_h = win->height - 31;
         
-        int x = text_x + 3;
-        int y = text_y + 3;
-        int start_x = x;
-        
-        for (int i = 0; i < notepad_cursor && notepad_buffer[i]; i++) {
-            if (notepad_buffer[i] == '\n') {
-                x = start_x;
-                y += 10;
-                if (y > win->y + win->height - 20) break;
-            } else {
-                if (x < win->x + win->width - 10) {
-                    vga_putchar(x, y, notepad_buffer[i], COLOR_BLACK, COLOR_WHITE);
-                    x += 8;
-                }
-            }
-        }
-        last_notepad_cursor = notepad_cursor;
-    } else if (last_notepad_cursor < notepad_cursor) {
-        /* Only draw new character */
-        int x = win->x + 5;
-        int y = win->y + 20;
-        int start_x = x;
+    vga_fillrect(text_x, text_y, text_w, text_h, COLOR_WHITE);
+    /* Sunken border */
+    vga_hline(text_x, text_y, text_w, COLOR_DARK_GRAY);
+    vga_vline(text_x, text_y, text_h, COLOR_DARK_GRAY);
+    vga_hline(text_x, text_y + text_h - 1, text_w, COLOR_WHITE);
+    vga_vline(text_x + text_w - 1, text_y, text_h, COLOR_WHITE);
         
-        /* Calculate cursor position */
-        for (int i = 0; i < last_notepad_cursor && notepad_buffer[i]; i++) {
-            if (notepad_buffer[i] == '\n') {
-                x = start_x;
-                y += 10;
-            } else {
-                x += 8;
-            }
-        }
+    /* Text - lines outside the clip are skipped without drawing */
+    int x = win->x + NOTEPAD_TEXT_X;
+    int y = win->y + NOTEPAD_TEXT_Y;
         
-        /* Draw only the new character */
-        if (last_notepad_cursor < notepad_cursor && x < win->x + win->width - 10 && y < win->y + win->height - 20) {
-            char new_char = notepad_buffer[last_notepad_cursor];
-            if (new_char == '\n') {
-                /* Just update position tracking */
-            } else {
-                /* Clear old cursor */
-                vga_fillrect(x, y, 10, 8, COLOR_WHITE);
-                vga_putchar(x, y, new_char, COLOR_BLACK, COLOR_WHITE);
-                x += 8;
-            }
-        }
-        last_notepad_cursor = notepad_cursor;
-    }
-    
-    /* Draw cursor at current position */
-    int x = win->x + 5;
-    int y = win->y + 20;
-    int start_x = x;
-    
     for (int i = 0; i < notepad_cursor && notepad_buffer[i]; i++) {
         if (notepad_buffer[i] == '\n') {
-            x = start_x;
+            x = win->x + NOTEPAD_TEXT_X;
             y += 10;
+            if (y > win->y + win->height - 20) break;
         } else {
+            if (x < win->x + win->width - 10) {
+                vga_putchar(x, y, notepad_buffer[i], COLOR_BLACK, COLOR_WHITE);
+            }
             x += 8;
         }
     }
-    
-    if (x < win->x + win->width - 10 && y < win->y + win->height - 10) {
+        
+    /* Cursor */
+    if (x < win->x + win->width - 10 && y < win->y + win->height - 20) {
         vga_fillrect(x, y, 2, 8, COLOR_BLACK);
     }
 }
 
-void notepad_handle_key(char key) {
+void notepad_handle_key(gui_window_t* win, char key) {
+    int old_x, old_y;
+    notepad_cell(notepad_cursor, &old_x, &old_y);
+    
     if (key == '\b') {
         if (notepad_cursor > 0) {
             notepad_cursor--;
@@ -520,6 +518,25 @@ void notepad_handle_key(char key) {
             notepad_buffer[notepad_cursor] = 0;
         }
     }
+    
+    /* Only the cells under the old and new cursor change */
+    int new_x, new_y;
+    notepad_cell(notepad_cursor, &new_x, &new_y);
+    gui_invalidate_window_rect(win->id, old_x, old_y, 10, 8);
+    gui_invalidate_window_rect(win->id, new_x, new_y, 10, 8);
+}
+
+static const gui_window_ops_t notepad_ops = {
+    .draw = notepad_draw_content,
+    .key = notepad_handle_key,
+    .close = app_window_closed,
+};
+
+void app_notepad(void) {
+    if (gui_focus_window(notepad_win)) return;  /* already open */
+    notepad_win = gui_create_window(160, 60, 380, 300, "Notepad");
+    gui_set_window_ops(notepad_win, &notepad_ops, &notepad_win);
+    gui_set_active_window(notepad_win);
 }
 
 /* ==================== TERMINAL APP ==================== */
@@ -527,8 +544,33 @@ void notepad_handle_key(char key) {
 static int terminal_win = -1;
 static int terminal_initialized = 0;
 
+void terminal_draw_content(gui_window_t* win) {
+    if (!win || !win->visible) return;
+    terminal_draw(win->x, win->y + 15, win->width, win->height - 15);
+}
+
+void terminal_key_handler(gui_window_t* win, char key) {
+    terminal_handle_key(key);
+    
+    /* Typing only changes the prompt line; Enter can change every line */
+    int prompt_y = (key == '\n') ? -1 : terminal_prompt_y(win->height - 15);
+    if (prompt_y < 0) {
+        gui_invalidate_window(win->id);
+    } else {
+        gui_invalidate_window_rect(win->id, 3, 15 + prompt_y, win->width - 6, 12);
+    }
+}
+
+static const gui_window_ops_t terminal_ops = {
+    .draw = terminal_draw_content,
+    .key = terminal_key_handler,
+    .close = app_window_closed,
+};
+
 void app_terminal(void) {
+    if (gui_focus_window(terminal_win)) return;  /* already open */
     terminal_win = gui_create_window(50, 50, 500, 350, "Terminal - bash");
+    gui_set_window_ops(terminal_win, &terminal_ops, &terminal_win);
     if (!terminal_initialized) {
         terminal_init();
         terminal_initialized = 1;
@@ -536,29 +578,9 @@ void app_terminal(void) {
     gui_set_active_window(terminal_win);
 }
 
-void terminal_draw_content(gui_window_t* win) {
-    if (!win || !win->visible) return;
-    terminal_draw(win->x, win->y + 15, win->width, win->height - 15);
-}
-
-void terminal_key_handler(char key) {
-    terminal_handle_key(key);
-}
-
 /* ==================== CALCULATOR APP ==================== */
 
 static int calc_win = -1;
-static char last_calc_display[16] = "";
-
-void app_calculator(void) {
-    calc_win = gui_create_window(200, 100, 160, 200, "Calc");
-    calc_value = 0;
-    calc_operand = 0;
-    calc_op = 0;
-    calc_display[0] = '0';
-    calc_display[1] = 0;
-    gui_set_active_window(calc_win);
-}
 
 void calc_draw_content(gui_window_t* win) {
     if (!win || !win->visible) return;
@@ -566,58 +588,32 @@ void calc_draw_content(gui_window_t* win) {
     int x = win->x + 5;
     int y = win->y + 20;
     
-    /* Only redraw display if it changed */
-    int display_changed = 0;
-    for (int i = 0; i < 16; i++) {
-        if (last_calc_display[i] != calc_display[i]) {
-            display_changed = 1;
-            break;
-        }
-    }
-    
-    if (display_changed || last_calc_display[0] == 0) {
-        /* Clear and redraw only display area */
-        vga_fillrect(x, y, win->width - 12, 16, COLOR_WHITE);
-        vga_rect(x, y, win->width - 12, 16, COLOR_BLACK);
-        vga_putstring(x + 4, y + 4, calc_display, COLOR_BLACK, COLOR_WHITE);
-        
-        /* Save current display */
-        for (int i = 0; i < 16; i++) {
-            last_calc_display[i] = calc_display[i];
-        }
-    }
-    
-    /* Draw buttons only on first draw */
-    static int buttons_drawn = 0;
-    if (!buttons_drawn || win->dirty_region.dirty) {
-        /* Clear content area */
-        vga_fillrect(win->x + 3, win->y + 16, win->width - 6, win->height - 19, COLOR_LIGHT_GRAY);
+    /* Clear content area */
+    vga_fillrect(win->x + 3, win->y + 16, win->width - 6, win->height - 19, COLOR_LIGHT_GRAY);
         
-        /* Redraw display */
-        vga_fillrect(x, y, win->width - 12, 16, COLOR_WHITE);
-        vga_rect(x, y, win->width - 12, 16, COLOR_BLACK);
-        vga_putstring(x + 4, y + 4, calc_display, COLOR_BLACK, COLOR_WHITE);
+    /* Display */
+    vga_fillrect(x, y, win->width - 12, 16, COLOR_WHITE);
+    vga_rect(x, y, win->width - 12, 16, COLOR_BLACK);
+    vga_putstring(x + 4, y + 4, calc_display, COLOR_BLACK, COLOR_WHITE);
         
-        /* Buttons */
-        const char* btns[] = {"7", "8", "9", "+", "4", "5", "6", "-", "1", "2", "3", "*", "C", "0", "=", "/"};
-        int bx = x, by = y + 20;
+    /* Buttons */
+    const char* btns[] = {"7", "8", "9", "+", "4", "5", "6", "-", "1", "2", "3", "*", "C", "0", "=", "/"};
+    int bx = x, by = y + 20;
         
-        for (int i = 0; i < 16; i++) {
-            vga_fillrect(bx, by, 18, 16, COLOR_WHITE);
-            vga_rect(bx, by, 18, 16, COLOR_BLACK);
-            vga_putchar(bx + 5, by + 4, btns[i][0], COLOR_BLACK, COLOR_WHITE);
+    for (int i = 0; i < 16; i++) {
+        vga_fillrect(bx, by, 18, 16, COLOR_WHITE);
+        vga_rect(bx, by, 18, 16, COLOR_BLACK);
+        vga_putchar(bx + 5, by + 4, btns[i][0], COLOR_BLACK, COLOR_WHITE);
             
-            bx += 22;
-            if ((i + 1) % 4 == 0) {
-                bx = x;
-                by += 18;
-            }
+        bx += 22;
+        if ((i + 1) % 4 == 0) {
+            bx = x;
+            by += 18;
         }
-        buttons_drawn = 1;
     }
 }
 
-static void calc_update_display(void) {
+static void calc_update_display(gui_window_t* win) {
     int v = calc_value;
     int neg = 0;
     if (v < 0) { neg = 1; v = -v; }
@@ -640,6 +636,9 @@ static void calc_update_display(void) {
     for (int j = 0; j <= 15 - start; j++) {
         calc_display[j] = calc_display[start + j];
     }
+    
+    /* Only the display area changes */
+    gui_invalidate_window_rect(win->id, 5, 20, win->width - 12, 16);
 }
 
 void calc_handle_click(gui_window_t* win, int mx, int my) {
@@ -660,12 +659,12 @@ void calc_handle_click(gui_window_t* win, int mx, int my) {
                 
                 if (c >= '0' && c <= '9') {
                     calc_value = calc_value * 10 + (c - '0');
-                    calc_update_display();
+                    calc_update_display(win);
                 } else if (c == 'C') {
                     calc_value = 0;
                     calc_operand = 0;
                     calc_op = 0;
-                    calc_update_display();
+                    calc_update_display(win);
                 } else if (c == '=') {
                     switch (calc_op) {
                         case '+': calc_value = calc_operand + calc_value; break;
@@ -674,7 +673,7 @@ void calc_handle_click(gui_window_t* win, int mx, int my) {
                         case '/': if (calc_value != 0) calc_value = calc_operand / calc_value; break;
                     }
                     calc_op = 0;
-                    calc_update_display();
+                    calc_update_display(win);
                 } else {
                     calc_operand = calc_value;
                     calc_value = 0;
@@ -686,15 +685,15 @@ void calc_handle_click(gui_window_t* win, int mx, int my) {
     }
 }
 
-void calc_handle_key(char key) {
+void calc_handle_key(gui_window_t* win, char key) {
     if (key >= '0' && key <= '9') {
         calc_value = calc_value * 10 + (key - '0');
-        calc_update_display();
+        calc_update_display(win);
     } else if (key == 'c' || key == 'C') {
         calc_value = 0;
         calc_operand = 0;
         calc_op = 0;
-        calc_update_display();
+        calc_update_display(win);
     } else if (key == '\n' || key == '=') {
         switch (calc_op) {
             case '+': calc_value = calc_operand + calc_value; break;
@@ -703,7 +702,7 @@ void calc_handle_key(char key) {
             case '/': if (calc_value != 0) calc_value = calc_operand / calc_value; break;
         }
         calc_op = 0;
-        calc_update_display();
+        calc_update_display(win);
     } else if (key == '+' || key == '-' || key == '*' || key == '/') {
         calc_operand = calc_value;
         calc_value = 0;
@@ -711,15 +710,29 @@ void calc_handle_key(char key) {
     }
 }
 
+static const gui_window_ops_t calc_ops = {
+    .draw = calc_draw_content,
+    .key = calc_handle_key,
+    .click = calc_handle_click,
+    .close = app_window_closed,
+};
+
+void app_calculator(void) {
+    if (gui_focus_window(calc_win)) return;  /* already open */
+    calc_win = gui_create_window(200, 100, 160, 200, "Calc");
+    gui_set_window_ops(calc_win, &calc_ops, &calc_win);
+    calc_value = 0;
+    calc_operand = 0;
+    calc_op = 0;
+    calc_display[0] = '0';
+    calc_display[1] = 0;
+    gui_set_active_window(calc_win);
+}
+
 /* ==================== ABOUT APP ==================== */
 
 static int about_win = -1;
 
-void app_about(void) {
-    about_win = gui_create_window(180, 120, 280, 180, "About GegOS");
-    gui_set_active_window(about_win);
-}
-
 void about_draw_content(gui_window_t* win) {
     if (!win || !win->visible) return;
     
@@ -743,13 +756,20 @@ void about_draw_content(gui_window_t* win) {
     vga_putstring(x, y + 55, "mouse & keyboard", COLOR_BLACK, COLOR_WHITE);
 }
 
-/* ==================== SETTINGS APP ==================== */
+static const gui_window_ops_t about_ops = {
+    .draw = about_draw_content,
+    .close = app_window_closed,
+};
 
-void app_settings(void) {
-    settings_win = gui_create_window(150, 80, 320, 280, "Settings");
-    gui_set_active_window(settings_win);
+void app_about(void) {
+    if (gui_focus_window(about_win)) return;  /* already open */
+    about_win = gui_create_window(180, 120, 280, 180, "About GegOS");
+    gui_set_window_ops(about_win, &about_ops, &about_win);
+    gui_set_active_window(about_win);
 }
 
+/* ==================== SETTINGS APP ==================== */
+
 void settings_draw_content(gui_window_t* win) {
     if (!win || !win->visible) return;
     
@@ -763,7 +783,7 @@ void settings_draw_content(gui_window_t* win) {
     vga_putstring(x, y, "Resolution:", COLOR_BLACK, COLOR_WHITE);
     
     /* Resolution options */
-    const char* res_opts[] = {"640x480", "320x200", "1280x720"};
+    const char* res_opts[] = {"640x480", "320x200", "1024x768"};
     for (int i = 0; i < 3; i++) {
         int bx = x + 75 + i * 50;
         uint8_t bg = (settings_resolution == i) ? COLOR_BLUE : COLOR_LIGHT_GRAY;
@@ -819,8 +839,9 @@ void settings_handle_click(gui_window_t* win, int mx, int my) {
     for (int i = 0; i < 3; i++) {
         int bx = x + 75 + i * 50;
         if (mx >= bx && mx < bx + 48 && my >= y - 2 && my < y + 10) {
-            settings_resolution = i;
             vga_set_mode(i);  /* Actually apply the resolution change */
+            settings_resolution = vga_get_mode();  /* unchanged if unavailable */
+            gui_invalidate_window(settings_win);
             return;
         }
     }
@@ -832,6 +853,7 @@ void settings_handle_click(gui_window_t* win, int mx, int my) {
         int bx = x + 75 + i * 36;
         if (mx >= bx && mx < bx + 34 && my >= y - 2 && my < y + 10) {
             settings_mouse_speed = i;
+            gui_invalidate_window(settings_win);
             return;
         }
     }
@@ -843,11 +865,28 @@ void settings_handle_click(gui_window_t* win, int mx, int my) {
         int bx = x + 75 + i * 36;
         if (mx >= bx && mx < bx + 34 && my >= y - 2 && my < y + 10) {
             settings_theme = i;
+            /* New desktop colour - everything behind the windows changes */
+            gui_invalidate_window(settings_win);
+            gui_add_dirty_rect(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT);
             return;
         }
     }
 }
 
+static const gui_window_ops_t settings_ops = {
+    .draw = settings_draw_content,
+    .click = settings_handle_click,
+    .close = app_window_closed,
+};
+
+void app_settings(void) {
+    if (gui_focus_window(settings_win)) return;  /* already open */
+    settings_win = gui_create_window(150, 80, 320, 280, "Settings");
+    gui_set_window_ops(settings_win, &settings_ops, &settings_win);
+    gui_set_active_window(settings_win);
+    settings_resolution = vga_get_mode();
+}
+
 int get_settings_theme(void) { return settings_theme; }
 int get_settings_mouse_speed(void) { return settings_mouse_speed; }
 
@@ -7,6 +7,7 @@
 #define APPS_H
 
 #include <stdint.h>
+#include "gui.h"
 
 /* File types */
 typedef enum {
@@ -55,6 +56,10 @@ void app_about(void);
 void app_calculator(void);
 void app_settings(void);
 
+/* Close callback for app windows whose user_data points at the
+ * app's window ID variable - resets it so the app opens a new one */
+void app_window_closed(gui_window_t* win);
+
 /* Get app count */
 int apps_get_count(void);
 
@@ -0,0 +1,24 @@
+/*
+ * arena.c - Bump allocators for GegOS
+ */
+
+#include "arena.h"
+#include "pmm.h"
+
+/* Enough for the compositor's clip regions on a busy frame */
+#define FRAME_ARENA_PAGES 16
+
+arena_t frame_arena;
+
+void arena_init(arena_t* a, void* mem, uint32_t size) {
+    a->base = mem;
+    a->size = mem ? size : 0;
+    a->used = 0;
+    a->peak = 0;
+    a->failed = 0;
+}
+
+void frame_arena_init(void) {
+    uintptr_t mem = pmm_alloc_pages(FRAME_ARENA_PAGES);
+    arena_init(&frame_arena, (void*)mem, FRAME_ARENA_PAGES * PAGE_SIZE);
+}
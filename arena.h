@@ -0,0 +1,62 @@
+/*
+ * arena.h - Bump allocators for GegOS
+ * Allocation moves a pointer; everything goes at once on reset, or back
+ * to a mark. Nothing is freed on its own, so there is nothing to
+ * fragment.
+ */
+
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stdint.h>
+
+typedef struct {
+    uint8_t* base;
+    uint32_t size;
+    uint32_t used;
+    uint32_t peak;              /* most ever used */
+    uint32_t failed;            /* allocations that did not fit */
+} arena_t;
+
+/* Scratch memory for one frame of the main loop, reset after each present */
+extern arena_t frame_arena;
+
+/* Give frame_arena its memory (after pmm_init) */
+void frame_arena_init(void);
+
+void arena_init(arena_t* a, void* mem, uint32_t size);
+
+/* 16-byte aligned, 0 if it does not fit */
+static inline void* arena_alloc(arena_t* a, uint32_t size) {
+    uint32_t start = (a->used + 15) & ~15u;
+    if (start > a->size || size > a->size - start) {
+        a->failed++;
+        return 0;
+    }
+    a->used = start + size;
+    if (a->used > a->peak) a->peak = a->used;
+    return a->base + start;
+}
+
+static inline void arena_reset(arena_t* a) {
+    a->used = 0;
+}
+
+/* Marks for temporary use: what was allocated after the mark goes on
+ * release. Release in the reverse order of marking. */
+static inline uint32_t arena_mark(const arena_t* a) {
+    return a->used;
+}
+
+static inline void arena_release(arena_t* a, uint32_t mark) {
+    a->used = mark;
+}
+
+/* Scratch for the statement or block that follows, released after it:
+ *     ARENA_SCOPE(&frame_arena) { ... }
+ * Leaving it with break, return or goto skips the release. */
+#define ARENA_SCOPE(a) \
+    for (uint32_t arena_mark_ = arena_mark(a), arena_once_ = 1; arena_once_; \
+         arena_once_ = 0, arena_release((a), arena_mark_))
+
+#endif /* ARENA_H */
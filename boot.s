@@ -16,9 +16,12 @@ align 4
     dd FLAGS
     dd CHECKSUM
 
-; Stack section - 16KB stack
+; Stack section - 16KB stack over a guard page (unmapped by paging.c)
 section .bss
-align 16
+alignb 4096
+global stack_guard
+stack_guard:
+    resb 4096
 stack_bottom:
     resb 16384                          ; 16 KB stack
 stack_top:
@@ -41,7 +44,8 @@ _start:
     push ebx                            ; Multiboot info structure pointer
     push eax                            ; Multiboot magic number
 
-    ; Call the C kernel entry point
+    ; Call the C kernel entry point (EBP 0 ends crash backtraces)
+    xor ebp, ebp
     call kernel_main
 
     ; If kernel_main returns, hang the CPU
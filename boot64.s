@@ -33,9 +33,12 @@ header_start:
     dd 8                    ; Size
 header_end:
 
-; Stack section - 16KB stack
+; Stack section - 16KB stack over a guard page (unmapped by paging.c)
 section .bss
-align 16
+alignb 4096
+global stack_guard
+stack_guard:
+    resb 4096
 stack_bottom:
     resb 16384
 stack_top:
@@ -55,7 +58,8 @@ gdtr:
     dw gdt64_end - gdt64 - 1
     dq gdt64
 
-; Page tables for 1GB identity mapping
+; Page tables for 4GB identity mapping with 2MB pages
+; (covers the linear framebuffer, usually just below 4GB)
 align 4096
 pml4_table:
     dq pdp_table + 3
@@ -63,8 +67,19 @@ pml4_table:
 
 align 4096
 pdp_table:
-    dq 0x00000083               ; 1GB page
-    times 511 dq 0
+    dq pd_tables + 0x0000 + 3
+    dq pd_tables + 0x1000 + 3
+    dq pd_tables + 0x2000 + 3
+    dq pd_tables + 0x3000 + 3
+    times 508 dq 0
+
+align 4096
+pd_tables:
+%assign i 0
+%rep 2048
+    dq (i << 21) | 0x83         ; 2MB page, present + writable
+%assign i i + 1
+%endrep
 
 ; Text section - kernel entry
 section .text
@@ -75,6 +90,10 @@ extern kernel64_main
 start64:
     cli
     
+    ; cpuid below overwrites the Multiboot magic (EAX) and info (EBX)
+    mov esi, eax
+    mov edi, ebx
+    
     ; Check 64-bit CPU support
     mov eax, 0x80000001
     cpuid
@@ -89,11 +108,17 @@ start64:
     ; Load GDT
     lgdt [rel gdtr]
     
-    ; Enable PAE (CR4.PAE = 1)
+    ; Enable PAE (CR4.PAE = 1) and SSE (CR4.OSFXSR | CR4.OSXMMEXCPT)
     mov eax, cr4
-    or eax, 0x20
+    or eax, 0x620
     mov cr4, eax
     
+    ; SSE needs CR0.EM = 0 and CR0.MP = 1
+    mov eax, cr0
+    and eax, ~0x04
+    or eax, 0x02
+    mov cr0, eax
+    
     ; Load page tables
     mov eax, pml4_table
     mov cr3, eax
@@ -123,10 +148,11 @@ start64_long:
     
     mov rsp, stack_top
     
-    mov rdi, rbx                ; Multiboot info in RDI (first arg)
-    mov rsi, rdx                ; Magic number in RSI (second arg)
+    mov edi, edi                ; Multiboot info in RDI (first arg), zero-extended
+    mov esi, esi                ; Magic number in RSI (second arg)
     
-    ; Call kernel64_main(multiboot_info, magic)
+    ; Call kernel64_main(multiboot_info, magic) (RBP 0 ends crash backtraces)
+    xor ebp, ebp
     call kernel64_main
     
     cli
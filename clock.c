@@ -0,0 +1,139 @@
+/*
+ * clock.c - High resolution clock for GegOS
+ * PIT channel 2 counts down a fixed interval while we watch the TSC, the
+ * same way Linux calibrates it. Cycles become nanoseconds by a multiply
+ * and a shift, so now_ns() costs an rdtsc and two multiplies.
+ */
+
+#include "clock.h"
+#include "io.h"
+#include "timer.h"
+
+/* PIT channel 2, gated through the speaker port */
+#define PIT_FREQUENCY    1193182
+#define PIT_CHANNEL2     0x42
+#define PIT_COMMAND      0x43
+#define PIT_CH2_ONESHOT  0xB0     /* channel 2, lobyte/hibyte, mode 0 */
+#define SPEAKER_PORT     0x61
+#define SPEAKER_GATE     0x01
+#define SPEAKER_DATA     0x02
+#define SPEAKER_OUT2     0x20
+
+#define CAL_MS           10
+#define CAL_COUNT        (PIT_FREQUENCY / (1000 / CAL_MS))
+#define CAL_TRIES        3
+#define CAL_TIMEOUT      1000000  /* port reads before giving up on the PIT */
+
+/* ns = cycles * mult >> NS_SHIFT */
+#define NS_SHIFT         24
+
+static uint32_t tsc_khz = 0;
+static uint32_t ns_mult = 0;
+static uint64_t tsc_base = 0;
+
+static clock_stat_t* stat_list = 0;
+
+/* 64-by-32 bit division without libgcc on the 32-bit kernel */
+static uint64_t div64(uint64_t n, uint32_t d) {
+#ifdef __x86_64__
+    return n / d;
+#else
+    uint32_t hi = (uint32_t)(n >> 32);
+    uint32_t lo = (uint32_t)n;
+    uint32_t q_hi = hi / d;
+    uint32_t rem = hi % d;
+    __asm__ ("divl %4" : "=a"(lo), "=d"(rem) : "a"(lo), "d"(rem), "rm"(d));
+    return ((uint64_t)q_hi << 32) | lo;
+#endif
+}
+
+/* TSC cycles over one CAL_COUNT run of channel 2, 0 if it never ended */
+static uint64_t calibrate_once(void) {
+    /* Gate on, speaker off; loading the count starts the run */
+    outb(SPEAKER_PORT, (inb(SPEAKER_PORT) & ~SPEAKER_DATA) | SPEAKER_GATE);
+    outb(PIT_COMMAND, PIT_CH2_ONESHOT);
+    outb(PIT_CHANNEL2, CAL_COUNT & 0xFF);
+    outb(PIT_CHANNEL2, (CAL_COUNT >> 8) & 0xFF);
+    
+    uint64_t start = now_cycles();
+    for (uint32_t i = 0; i < CAL_TIMEOUT; i++) {
+        if (inb(SPEAKER_PORT) & SPEAKER_OUT2) {
+            return now_cycles() - start;
+        }
+    }
+    return 0;
+}
+
+void clock_init(void) {
+    int irqs = interrupts_enabled();
+    cli();
+    
+    /* An interrupt during a run only makes it longer: keep the shortest */
+    uint64_t best = 0;
+    for (int i = 0; i < CAL_TRIES; i++) {
+        uint64_t cycles = calibrate_once();
+        if (cycles && (!best || cycles < best)) best = cycles;
+    }
+    
+    if (irqs) sti();
+    
+    /* cycles per CAL_COUNT PIT clocks -> kHz */
+    tsc_khz = best ? (uint32_t)div64(best * PIT_FREQUENCY, CAL_COUNT * 1000) : 0;
+    ns_mult = tsc_khz ? (uint32_t)div64(1000000ULL << NS_SHIFT, tsc_khz) : 0;
+    tsc_base = now_cycles();
+}
+
+uint32_t clock_tsc_khz(void) {
+    return tsc_khz;
+}
+
+/* Split in halves so the product cannot overflow */
+uint64_t cycles_to_ns(uint64_t cycles) {
+    uint64_t hi = (cycles >> 32) * ns_mult;
+    uint64_t lo = (cycles & 0xFFFFFFFF) * ns_mult;
+    return (hi << (32 - NS_SHIFT)) + (lo >> NS_SHIFT);
+}
+
+uint32_t cycles_to_us(uint64_t cycles) {
+    uint64_t us = div64(cycles_to_ns(cycles), 1000);
+    return us > 0xFFFFFFFF ? 0xFFFFFFFF : (uint32_t)us;
+}
+
+uint64_t now_ns(void) {
+    if (!tsc_khz) return timer_ms() * 1000000;
+    return cycles_to_ns(now_cycles() - tsc_base);
+}
+
+/* ==== Timing statistics ==== */
+
+void clock_stat_add(clock_stat_t* stat, uint64_t cycles) {
+    if (!stat->linked) {
+        stat->next = stat_list;
+        stat_list = stat;
+        stat->linked = 1;
+    }
+    stat->count++;
+    stat->total += cycles;
+    if (cycles < stat->min) stat->min = cycles;
+    if (cycles > stat->max) stat->max = cycles;
+}
+
+void clock_stat_reset(clock_stat_t* stat) {
+    stat->count = 0;
+    stat->total = 0;
+    stat->min = ~0ULL;
+    stat->max = 0;
+}
+
+clock_stat_t* clock_stats(void) {
+    return stat_list;
+}
+
+uint32_t clock_stat_avg_us(const clock_stat_t* stat) {
+    if (!stat->count) return 0;
+    return cycles_to_us(div64(stat->total, stat->count));
+}
+
+uint32_t clock_stat_max_us(const clock_stat_t* stat) {
+    return cycles_to_us(stat->max);
+}
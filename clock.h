@@ -0,0 +1,60 @@
+/*
+ * clock.h - High resolution clock for GegOS
+ * The TSC, calibrated against the PIT at boot. Every CPU the kernel runs
+ * on (i686 and up) has one; if calibration fails the clock falls back to
+ * timer ticks.
+ */
+
+#ifndef CLOCK_H
+#define CLOCK_H
+
+#include <stdint.h>
+
+/* Raw TSC - cheap, monotonic on one CPU, not serialising */
+static inline uint64_t now_cycles(void) {
+    uint32_t lo, hi;
+    __asm__ volatile ("rdtsc" : "=a"(lo), "=d"(hi));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+/* Calibrate the TSC (interrupts may be on or off) */
+void clock_init(void);
+
+/* Nanoseconds since clock_init */
+uint64_t now_ns(void);
+uint64_t cycles_to_ns(uint64_t cycles);
+uint32_t cycles_to_us(uint64_t cycles);     /* saturates at ~71 minutes */
+
+/* TSC rate, 0 if it could not be calibrated */
+uint32_t clock_tsc_khz(void);
+
+/* Running timing statistics, in cycles. Declare with CLOCK_STAT("name");
+ * a stat links itself into the list clock_stats() returns on first use. */
+typedef struct clock_stat {
+    const char* name;
+    uint32_t count;
+    uint64_t total;
+    uint64_t min;
+    uint64_t max;
+    struct clock_stat* next;
+    int linked;
+} clock_stat_t;
+
+#define CLOCK_STAT(name) { (name), 0, 0, ~0ULL, 0, 0, 0 }
+
+void clock_stat_add(clock_stat_t* stat, uint64_t cycles);
+void clock_stat_reset(clock_stat_t* stat);
+clock_stat_t* clock_stats(void);
+
+/* Averages and extremes for display */
+uint32_t clock_stat_avg_us(const clock_stat_t* stat);
+uint32_t clock_stat_max_us(const clock_stat_t* stat);
+
+/* Time the statement or block that follows into a stat:
+ *     CLOCK_TIME(render_stat) { ... }
+ * Leaving it with break, return or goto skips the sample. */
+#define CLOCK_TIME(stat) \
+    for (uint64_t clock_t0_ = now_cycles(), clock_once_ = 1; clock_once_; \
+         clock_once_ = 0, clock_stat_add(&(stat), now_cycles() - clock_t0_))
+
+#endif /* CLOCK_H */
@@ -0,0 +1,264 @@
+/*
+ * crash.c - Crash dumps for GegOS
+ * The dump is written out as text first and sent to COM1 before anything
+ * touches the display, so a fault in the display code still leaves the
+ * serial copy. A fault while dumping only adds a line on COM1.
+ */
+
+#include "crash.h"
+#include "serial.h"
+#include "symbols.h"
+#include "trace.h"
+#include "clock.h"
+#include "vga.h"
+#include "io.h"
+
+/* From boot.s / boot64.s: the guard page, with the boot stack above it */
+extern char stack_guard[];
+#define GUARD_SIZE       4096
+#define BOOT_STACK_SIZE  16384
+
+#define VECTOR_DF        8
+#define VECTOR_PF        14
+#define PF_PRESENT       0x01
+#define PF_WRITE         0x02
+#define PF_FETCH         0x10
+
+#define MAX_FRAMES       16
+#define TRACE_SHOWN      16
+#define LINE_HEIGHT      10
+#define HEX_DIGITS       (int)(sizeof(uintptr_t) * 2)
+
+static const char* const exception_names[32] = {
+    "Divide error", "Debug", "NMI", "Breakpoint",
+    "Overflow", "Bound range exceeded", "Invalid opcode", "Device not available",
+    "Double fault", "Coprocessor segment overrun", "Invalid TSS", "Segment not present",
+    "Stack-segment fault", "General protection fault", "Page fault", "Reserved",
+    "x87 floating point error", "Alignment check", "Machine check", "SIMD floating point error",
+    "Virtualization exception", "Control protection exception", "Reserved", "Reserved",
+    "Reserved", "Reserved", "Reserved", "Reserved",
+    "Hypervisor injection", "VMM communication", "Security exception", "Reserved"
+};
+
+static char dump[4096];
+static uint32_t dump_len = 0;
+static volatile int crashing = 0;
+
+/* ==== Formatting ==== */
+
+static void put_char(char c) {
+    if (dump_len < sizeof(dump) - 1) dump[dump_len++] = c;
+}
+
+static void put_str(const char* s) {
+    while (*s) put_char(*s++);
+}
+
+static void put_dec(uint32_t v) {
+    char buf[10];
+    int n = 0;
+    do {
+        buf[n++] = '0' + v % 10;
+        v /= 10;
+    } while (v);
+    while (n) put_char(buf[--n]);
+}
+
+/* digits = 0 for as many as needed */
+static void put_hex(uintptr_t v, int digits) {
+    if (!digits) {
+        digits = 1;
+        while (digits < HEX_DIGITS && (v >> (digits * 4))) digits++;
+    }
+    put_str("0x");
+    while (digits--) put_char("0123456789abcdef"[(v >> (digits * 4)) & 0xF]);
+}
+
+/* " name+0x12" if addr is in a known function. A return address is
+ * looked up by the call before it, which may end the caller. */
+static void put_symbol(uintptr_t addr, int is_return) {
+    uintptr_t offset;
+    const char* name = ksym_lookup(addr - is_return, &offset);
+    if (!name) return;
+    put_char(' ');
+    put_str(name);
+    put_char('+');
+    put_hex(offset + is_return, 0);
+}
+
+/* ==== Dump sections ==== */
+
+static uintptr_t read_cr2(void) {
+    uintptr_t v;
+    __asm__ volatile ("mov %%cr2, %0" : "=r"(v));
+    return v;
+}
+
+static uintptr_t read_cr3(void) {
+    uintptr_t v;
+    __asm__ volatile ("mov %%cr3, %0" : "=r"(v));
+    return v;
+}
+
+/* Stack pointer when the exception hit */
+static uintptr_t frame_sp(const interrupt_frame_t* f) {
+#ifdef __x86_64__
+    return f->rsp;
+#else
+    /* pusha saved ESP pointing at the vector; the CPU pushed error code,
+     * EIP, CS and EFLAGS above that (no stack switch in ring 0) */
+    return f->esp + 5 * sizeof(uint32_t);
+#endif
+}
+
+static void dump_registers(const interrupt_frame_t* f, uintptr_t cr2) {
+    struct { const char* name; uintptr_t value; } regs[] = {
+#ifdef __x86_64__
+        { "RAX", f->rax }, { "RBX", f->rbx }, { "RCX", f->rcx },
+        { "RDX", f->rdx }, { "RSI", f->rsi }, { "RDI", f->rdi },
+        { "RBP", f->rbp }, { "RSP", f->rsp }, { " R8", f->r8 },
+        { " R9", f->r9 }, { "R10", f->r10 }, { "R11", f->r11 },
+        { "R12", f->r12 }, { "R13", f->r13 }, { "R14", f->r14 },
+        { "R15", f->r15 }, { "RIP", f->rip }, { "RFL", f->rflags },
+        { " CS", f->cs }, { "CR2", cr2 }, { "CR3", read_cr3() },
+#else
+        { "EAX", f->eax }, { "EBX", f->ebx }, { "ECX", f->ecx }, { "EDX", f->edx },
+        { "ESI", f->esi }, { "EDI", f->edi }, { "EBP", f->ebp }, { "ESP", frame_sp(f) },
+        { "EIP", f->eip }, { "EFL", f->eflags }, { " CS", f->cs }, { "CR2", cr2 },
+        { "CR3", read_cr3() },
+#endif
+    };
+    /* As many per row as fit in 80 columns */
+    const int per_row = 80 / (HEX_DIGITS + 8);
+    int count = (int)(sizeof(regs) / sizeof(regs[0]));
+    
+    for (int i = 0; i < count; i++) {
+        put_str(i % per_row ? "  " : "\n");
+        put_str(regs[i].name);
+        put_char('=');
+        put_hex(regs[i].value, HEX_DIGITS);
+    }
+    put_char('\n');
+}
+
+static int in_guard_page(uintptr_t addr) {
+    return addr >= (uintptr_t)stack_guard && addr <= (uintptr_t)stack_guard + GUARD_SIZE;
+}
+
+/* What a page fault was doing */
+static void dump_page_fault(uintptr_t error, uintptr_t cr2) {
+    put_str(error & PF_FETCH ? "Executing " : error & PF_WRITE ? "Writing " : "Reading ");
+    put_hex(cr2, 0);
+    put_str(error & PF_PRESENT ? ": protection violation\n" : ": page not present\n");
+}
+
+/* Follow the saved frame pointers: [fp] is the caller's frame pointer,
+ * [fp + 1] the return address. Frames have to be on the boot stack and
+ * move up it, so a corrupt chain ends the walk instead of faulting. */
+static void dump_backtrace(uintptr_t fp) {
+    uintptr_t lo = (uintptr_t)stack_guard + GUARD_SIZE;
+    uintptr_t hi = lo + BOOT_STACK_SIZE;
+    
+    put_str("\nBacktrace:\n");
+    for (int i = 0; i < MAX_FRAMES; i++) {
+        if (fp < lo || fp > hi - 2 * sizeof(uintptr_t) || (fp & (sizeof(uintptr_t) - 1))) break;
+        const uintptr_t* frame = (const uintptr_t*)fp;
+        uintptr_t ret = frame[1];
+        if (!ret) break;
+        
+        put_str("  ");
+        put_hex(ret, HEX_DIGITS);
+        put_symbol(ret, 1);
+        put_char('\n');
+        
+        if (frame[0] <= fp) break;
+        fp = frame[0];
+    }
+}
+
+static void dump_trace(void) {
+    uint64_t now = now_cycles();
+    
+    put_str("\nRecent events (of ");
+    put_dec(trace_count());
+    put_str("):\n");
+    for (uint32_t n = 0; n < TRACE_SHOWN; n++) {
+        const trace_entry_t* e = trace_get(n);
+        if (!e) break;
+        put_str("  -");
+        put_dec(cycles_to_us(now - e->cycles));
+        put_str(" us  ");
+        put_str(e->what);
+        put_char(' ');
+        put_hex(e->arg, 0);
+        put_char('\n');
+    }
+}
+
+/* ==== Output ==== */
+
+static void show_on_screen(void) {
+    if (!vga_started()) return;
+    
+    /* 320x200 is too small for the dump */
+    if (vga_get_mode() == VGA_MODE_320x200) vga_set_mode(VGA_MODE_640x480);
+    vga_set_target(0, 0, 0, 0, 0);
+    vga_reset_clip();
+    vga_cursor_set(-1);
+    vga_fillrect(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT, COLOR_BLUE);
+    
+    int y = 8;
+    char* line = dump;
+    for (char* p = dump; *p && y + LINE_HEIGHT <= SCREEN_HEIGHT; p++) {
+        if (*p != '\n') continue;
+        *p = 0;
+        vga_putstring(8, y, line, COLOR_WHITE, COLOR_BLUE);
+        y += LINE_HEIGHT;
+        line = p + 1;
+    }
+    vga_swap();
+}
+
+void crash_exception(const interrupt_frame_t* frame) {
+    cli();
+    if (crashing++) {
+        serial_write("\nException ");
+        serial_write(frame->vector < 32 ? exception_names[frame->vector] : "?");
+        serial_write(" while writing the crash dump\n");
+        for (;;) hlt();
+    }
+    
+    uintptr_t cr2 = read_cr2();
+#ifdef __x86_64__
+    uintptr_t ip = frame->rip, fp = frame->rbp;
+#else
+    uintptr_t ip = frame->eip, fp = frame->ebp;
+#endif
+
+    put_str("\n*** GegOS crashed: ");
+    put_str(frame->vector < 32 ? exception_names[frame->vector] : "Unknown exception");
+    put_str(" (vector ");
+    put_dec((uint32_t)frame->vector);
+    put_str(", error ");
+    put_hex(frame->error, 0);
+    put_str(")\nAt ");
+    put_hex(ip, HEX_DIGITS);
+    put_symbol(ip, 0);
+    put_char('\n');
+    if (frame->vector == VECTOR_PF) dump_page_fault(frame->error, cr2);
+    
+    /* A fault pushing onto the guard page turns into a double fault */
+    if (in_guard_page(frame_sp(frame)) || (frame->vector == VECTOR_PF && in_guard_page(cr2))) {
+        put_str("The boot stack overflowed into its guard page\n");
+    }
+    
+    dump_registers(frame, cr2);
+    dump_backtrace(fp);
+    dump_trace();
+    put_str("\nSystem halted.\n");
+    dump[dump_len] = 0;
+    
+    serial_write(dump);
+    show_on_screen();
+    for (;;) hlt();
+}
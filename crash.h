@@ -0,0 +1,15 @@
+/*
+ * crash.h - Crash dumps for GegOS
+ */
+
+#ifndef CRASH_H
+#define CRASH_H
+
+#include "interrupt.h"
+
+/* Dump a CPU exception to COM1 and the screen, then halt: the exception
+ * name, registers and CR2, a frame pointer backtrace with symbol names,
+ * and the newest trace entries. */
+void crash_exception(const interrupt_frame_t* frame) __attribute__((noreturn));
+
+#endif /* CRASH_H */
@@ -0,0 +1,97 @@
+/*
+ * display.h - Display driver interface for GegOS
+ * vga.c is the front end (clipping, shadow framebuffer, mode switching);
+ * each driver implements the hardware access for one kind of mode.
+ */
+
+#ifndef DISPLAY_H
+#define DISPLAY_H
+
+#include <stdint.h>
+
+/* VGA registers */
+#define VGA_MISC_WRITE      0x3C2
+#define VGA_SEQ_INDEX       0x3C4
+#define VGA_SEQ_DATA        0x3C5
+#define VGA_CRTC_INDEX      0x3D4
+#define VGA_CRTC_DATA       0x3D5
+#define VGA_GC_INDEX        0x3CE
+#define VGA_GC_DATA         0x3CF
+#define VGA_AC_INDEX        0x3C0
+#define VGA_AC_WRITE        0x3C0
+#define VGA_DAC_WRITE_INDEX 0x3C8
+#define VGA_DAC_DATA        0x3C9
+#define VGA_INSTAT_READ     0x3DA
+
+/* Sprite as registered through vga_sprite_create() */
+typedef struct {
+    const uint8_t* pixels;  /* system RAM copy, one byte per pixel */
+    int width, height;
+    int opaque;             /* no VGA_TRANSPARENT pixels */
+    int cache;              /* driver cache handle, 0 if not cached */
+} display_sprite_t;
+
+/*
+ * Driver operations. Rectangles passed to fill/blit/copy are already
+ * clipped to the front end's clip rect; glyphs get raw coordinates and
+ * clip with display_clip_rect(), sprite is only called fully inside it.
+ */
+typedef struct {
+    const char* name;
+    int width, height;
+
+    /* Program the mode, returns 0 if the hardware is not there */
+    int (*init)(void);
+    /* Called before another driver takes over (optional) */
+    void (*leave)(void);
+
+    void (*fill)(int x, int y, int w, int h, uint8_t color);
+    uint8_t (*getpixel)(int x, int y);
+    /* Bitmap rows of 'pitch' bytes, VGA_TRANSPARENT pixels skipped */
+    void (*blit)(int x, int y, int w, int h, const uint8_t* src, int pitch);
+    /* Overlap safe screen-to-screen copy */
+    void (*copy)(int sx, int sy, int dx, int dy, int w, int h);
+    /* One line of n characters, clipped by the driver */
+    void (*glyphs)(int x, int y, const char* str, int n, uint8_t fg, uint8_t bg);
+    /* Accelerated sprite draw (optional), returns 0 to fall back to blit */
+    int (*sprite)(display_sprite_t* spr, int x, int y);
+
+    /* Copy a rect of the 8bpp shadow framebuffer to the screen (x0/x1 8-aligned).
+     * With flip this targets the hidden page. */
+    void (*present)(const uint8_t* src, int pitch, int x0, int y0, int x1, int y1);
+    /* Show the hidden page at the next vsync (optional page flipping) */
+    void (*flip)(void);
+    /* Read the whole screen back as 8bpp */
+    void (*readback)(uint8_t* dst, int pitch);
+    void (*vsync)(void);
+} display_driver_t;
+
+/* Drivers */
+extern display_driver_t planar_driver;     /* Mode 12h, 640x480x16 (vga_planar.c) */
+extern display_driver_t mode13_driver;     /* Mode 13h, 320x200 (vga_mode13.c) */
+extern display_driver_t bga_driver;        /* Bochs/QEMU BGA, 1024x768x32 (vga_lfb.c) */
+extern display_driver_t bga640_driver;     /* Bochs/QEMU BGA, 640x480x8 (vga_lfb.c) */
+extern display_driver_t multiboot_driver;  /* Bootloader framebuffer, 32bpp (vga_lfb.c) */
+
+/* 16-colour palette as 0x00RRGGBB */
+extern const uint32_t display_palette[16];
+
+/* Bootloader framebuffer description for multiboot_driver (vga_lfb.c) */
+int multiboot_fb_setup(uint64_t addr, uint32_t pitch, uint32_t width, uint32_t height, uint8_t bpp);
+
+/* Helpers shared by the drivers (vga.c) */
+int display_clip_rect(int* x, int* y, int* w, int* h);
+void display_program_vga(uint8_t misc, const uint8_t* seq, const uint8_t* crtc,
+                         const uint8_t* gc, const uint8_t* ac);
+void display_load_dac(void);
+void display_vga_vsync(void);
+/* Map a linear framebuffer write-combining, or as vga_set_framebuffer_cache() chose */
+void display_map_framebuffer(uint64_t base, uint64_t length);
+
+/* 8bpp chunky rendering (vga.c) - used for the shadow framebuffer and Mode 13h */
+void chunky_fill(uint8_t* base, int pitch, int x, int y, int w, int h, uint8_t color);
+void chunky_copy(uint8_t* base, int pitch, int sx, int sy, int dx, int dy, int w, int h);
+void chunky_blit(uint8_t* base, int pitch, int x, int y, int w, int h, const uint8_t* src, int src_pitch);
+void chunky_text(uint8_t* base, int pitch, int x, int y, const char* str, int n, uint8_t fg, uint8_t bg);
+
+#endif /* DISPLAY_H */
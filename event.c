@@ -0,0 +1,59 @@
+/*
+ * event.c - Main loop events for GegOS
+ * The main loop blocks in event_wait(). With interrupts on, the CPU halts
+ * until an IRQ handler posts something; before that the PS/2 controller is
+ * polled here instead, so input still wakes the loop.
+ */
+
+#include "event.h"
+#include "io.h"
+#include "keyboard.h"
+#include "mouse.h"
+#include "clock.h"
+
+static volatile uint32_t pending_events = 0;
+static volatile uint64_t input_posted = 0;   /* input went pending */
+static uint64_t input_taken = 0;
+
+void event_post(uint32_t events) {
+    if ((events & EVENT_INPUT) && !(pending_events & EVENT_INPUT)) {
+        input_posted = now_cycles();
+    }
+    __asm__ volatile ("lock orl %1, %0" : "+m"(pending_events) : "r"(events));
+}
+
+/* Input still waiting: in the controller before IRQs are on, or left in
+ * the drivers' rings by a consumer that stopped early */
+static void poll_input(void) {
+    if (keyboard_haskey()) event_post(EVENT_KEY);
+    if (mouse_has_data()) event_post(EVENT_MOUSE);
+}
+
+uint32_t event_wait(void) {
+    for (;;) {
+        int irqs = interrupts_enabled();
+        poll_input();
+        
+        /* Take the events with interrupts off, so a post cannot land
+         * between the check and the halt */
+        cli();
+        uint32_t events = pending_events;
+        pending_events = 0;
+        if (events) {
+            input_taken = (events & EVENT_INPUT) ? input_posted : 0;
+            if (irqs) sti();
+            return events;
+        }
+        
+        if (irqs) {
+            /* sti takes effect after the next instruction: no lost wakeup */
+            __asm__ volatile ("sti; hlt" : : : "memory");
+        } else {
+            __asm__ volatile ("pause");
+        }
+    }
+}
+
+uint64_t event_input_cycles(void) {
+    return input_taken;
+}
@@ -0,0 +1,29 @@
+/*
+ * event.h - Main loop events for GegOS
+ * Producers post event flags; the main loop sleeps until one is pending.
+ */
+
+#ifndef EVENT_H
+#define EVENT_H
+
+#include <stdint.h>
+
+/* Event flags - each says "go look", the data stays with its driver */
+#define EVENT_KEY     (1 << 0)  /* keyboard input waiting */
+#define EVENT_MOUSE   (1 << 1)  /* mouse packets waiting */
+#define EVENT_TIMER   (1 << 2)  /* timer tick */
+#define EVENT_REDRAW  (1 << 3)  /* something to repaint */
+
+#define EVENT_INPUT   (EVENT_KEY | EVENT_MOUSE)
+
+/* Post events (safe from interrupt handlers) */
+void event_post(uint32_t events);
+
+/* Sleep until at least one event is pending, returns and clears them all */
+uint32_t event_wait(void);
+
+/* TSC stamp of when the input in the last event_wait() result was first
+ * posted, 0 if it held none - for measuring input latency */
+uint64_t event_input_cycles(void);
+
+#endif /* EVENT_H */
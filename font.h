@@ -0,0 +1,13 @@
+/*
+ * font.h - 8x8 bitmap font for GegOS
+ */
+
+#ifndef FONT_H
+#define FONT_H
+
+#include <stdint.h>
+
+/* ASCII 0-127, one byte per row, MSB is the leftmost pixel */
+extern const uint8_t font8x8[128][8];
+
+#endif /* FONT_H */
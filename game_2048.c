@@ -6,9 +6,11 @@
 #include "vga.h"
 #include "keyboard.h"
 #include "io.h"
+#include "timer.h"
 
 #define GRID_SIZE 4
 #define TILE_SIZE 30
+#define FRAME_MS 20
 
 typedef struct {
     int tiles[GRID_SIZE][GRID_SIZE];
@@ -252,6 +254,7 @@ void game_2048_run(void) {
     
     while (!game_2048_is_game_over()) {
         game_2048_draw();
+        vga_swap();  /* Present the frame at vsync */
         
         if (keyboard_haskey()) {
             char key = keyboard_getchar();
@@ -270,13 +273,14 @@ void game_2048_run(void) {
         }
         
         /* Frame delay */
-        for (volatile int i = 0; i < 150000; i++);
+        sleep_ms(FRAME_MS);
     }
     
     game_2048_draw();
+    vga_swap();
     
     /* Wait for keypress */
     while (!keyboard_haskey()) {
-        for (volatile int i = 0; i < 150000; i++);
+        hlt();  /* until the next IRQ */
     }
 }
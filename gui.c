@@ -3,8 +3,7 @@
  * Complete rewrite with proper cursor handling
  * 
  * Key changes in 2.0:
- * - Cursor drawn LAST after all rendering
- * - No save/restore needed - full screen redraws each frame
+ * - Cursor is a vga overlay with its own save-under
  * - Simpler, more reliable rendering pipeline
  */
 
@@ -13,9 +12,9 @@
 #include "mouse.h"
 #include "keyboard.h"
 #include "io.h"
-
-/* External declarations */
-extern void redraw_cursor_area_kernel(int x, int y);
+#include "heap.h"
+#include "arena.h"
+#include "trace.h"
 
 /* GUI Colors (Windows 95/XP classic theme) */
 #define GUI_COLOR_DESKTOP     COLOR_CYAN          /* Teal desktop */
@@ -30,29 +29,90 @@ extern void redraw_cursor_area_kernel(int x, int y);
 #define GUI_COLOR_BUTTON_PRESS COLOR_DARK_GRAY
 #define GUI_COLOR_TASKBAR     COLOR_LIGHT_GRAY    /* Gray taskbar */
 
-/* Window storage */
-static gui_window_t windows[MAX_WINDOWS];
-static int num_windows = 0;
+/* Window table, indexed by window ID. It grows from the heap as windows
+ * open; a closed window frees its slot for the next one. A slot keeps
+ * its backing store after its window is closed. */
+typedef struct {
+    gui_window_t* win;          /* 0 while the slot is free */
+    uint8_t* surface;
+    uint32_t surface_size;
+} window_slot_t;
+
+#define MIN_WINDOW_SLOTS 8
+
+static window_slot_t* slots = 0;
+static int num_slots = 0;
+static kmem_cache_t window_cache;   /* gui_window_t objects for the slots */
+static int window_cache_ready = 0;
+static int num_windows = 0;     /* open windows, also the length of z_order */
 static int active_window = -1;
+static int drag_window = -1;
+
+/* Stacking order, bottom first (window IDs), num_slots long */
+static int* z_order = 0;
 
-/* Button storage */
+/* Button storage - slots of destroyed buttons are reused */
 static gui_button_t buttons[MAX_BUTTONS];
-static int num_buttons = 0;
+static int num_buttons = 0;     /* slots in use or freed, not past the last used one */
+static int pressed_button = -1;
+static int hovered_button = -1;
+
+/* Desktop icons (hit testing only, the desktop painter draws them) */
+static const desktop_icon_t* desktop_icons = 0;
+
+/* The hit index is rebuilt on the next lookup after anything moves */
+static int hit_stale = 1;
+
+/* Backing store for the window in a slot, 0 when memory is short.
+ * Reopening a window of the same size or smaller allocates nothing. */
+static uint8_t* surface_alloc(int id, int width, int height) {
+    window_slot_t* slot = &slots[id];
+    uint32_t size = (uint32_t)(width * height);
+    if (size <= slot->surface_size) return slot->surface;
+    kfree(slot->surface);
+    slot->surface = kmalloc(size);
+    slot->surface_size = slot->surface ? size : 0;
+    return slot->surface;
+}
+
+/* Double the window table (and z_order with it), 0 when memory is short */
+static int grow_slots(void) {
+    int n = num_slots ? num_slots * 2 : MIN_WINDOW_SLOTS;
+    window_slot_t* new_slots = kzalloc(n * sizeof(window_slot_t));
+    int* new_order = kmalloc(n * sizeof(int));
+    if (!new_slots || !new_order) {
+        kfree(new_slots);
+        kfree(new_order);
+        return 0;
+    }
+    
+    for (int i = 0; i < num_slots; i++) new_slots[i] = slots[i];
+    for (int z = 0; z < num_windows; z++) new_order[z] = z_order[z];
+    kfree(slots);
+    kfree(z_order);
+    slots = new_slots;
+    z_order = new_order;
+    num_slots = n;
+    return 1;
+}
+
+/* Window in a slot, 0 if the slot is free */
+static gui_window_t* live_window(int id) {
+    if (id < 0 || id >= num_slots) return 0;
+    return slots[id].win;
+}
+
+/* Damage a whole window where it is on screen now */
+static void damage_window(gui_window_t* win) {
+    gui_add_dirty_rect(win->x, win->y, win->width, win->height);
+}
 
 /* ============================================================================
- * CURSOR SYSTEM 2.0 - Optimized rectangle redraws
+ * CURSOR SYSTEM 2.0 - Overlay with save-under
  * ============================================================================ */
 
 /* Cursor state */
 static int cursor_visible = 0;
-static int cursor_x = 0;
-static int cursor_y = 0;
-static int cursor_last_x = -1;
-static int cursor_last_y = -1;
-
-/* Cursor dimensions */
-#define CURSOR_WIDTH 12
-#define CURSOR_BUFFER 32  /* Extra pixels to redraw around cursor */
 
 /* Arrow cursor shape - 1=black border, 2=white fill, 0=transparent */
 static const uint8_t cursor_shape[16][12] = {
@@ -74,22 +134,49 @@ static const uint8_t cursor_shape[16][12] = {
     {0,0,0,0,0,1,1,1,1,0,0,0}
 };
 
-/* Draw cursor at position - called AFTER all other rendering */
-static void draw_cursor_at(int x, int y) {
+/* Pre-rendered sprites (cached off-screen by the VGA driver).
+ * Only the cursor and the close button are sprites. The desktop icons
+ * and the title bar gradient are painted into the shadow framebuffer or
+ * a window's backing store, and vga_sprite_draw() only copies from VRAM
+ * when it draws straight to the screen, so a cached copy of them would
+ * never be used. */
+#define CLOSE_BTN_WIDTH  16
+#define CLOSE_BTN_HEIGHT 14
+
+static uint8_t cursor_pixels[16][12];
+static uint8_t close_btn_pixels[CLOSE_BTN_HEIGHT][CLOSE_BTN_WIDTH];
+static int cursor_sprite = -1;
+static int close_btn_sprite = -1;
+
+/* Build sprite bitmaps from the shapes above */
+static void build_sprites(void) {
     for (int j = 0; j < 16; j++) {
         for (int i = 0; i < 12; i++) {
-            int px = x + i;
-            int py = y + j;
-            if (px >= 0 && px < SCREEN_WIDTH && py >= 0 && py < SCREEN_HEIGHT) {
-                uint8_t val = cursor_shape[j][i];
-                if (val == 1) {
-                    vga_putpixel(px, py, COLOR_BLACK);
-                } else if (val == 2) {
-                    vga_putpixel(px, py, COLOR_WHITE);
-                }
-            }
+            uint8_t val = cursor_shape[j][i];
+            cursor_pixels[j][i] = (val == 1) ? COLOR_BLACK :
+                                  (val == 2) ? COLOR_WHITE : VGA_TRANSPARENT;
+        }
+    }
+    cursor_sprite = vga_sprite_create(12, 16, &cursor_pixels[0][0]);
+    
+    /* Close button: red face, light top-left edge, brown bottom-right, white X */
+    for (int j = 0; j < CLOSE_BTN_HEIGHT; j++) {
+        for (int i = 0; i < CLOSE_BTN_WIDTH; i++) {
+            uint8_t c = COLOR_RED;
+            if (j == 0 || i == 0) c = COLOR_LIGHT_RED;
+            if (j == CLOSE_BTN_HEIGHT - 1 || i == CLOSE_BTN_WIDTH - 1) c = COLOR_BROWN;
+            close_btn_pixels[j][i] = c;
         }
     }
+    int cx = CLOSE_BTN_WIDTH / 2;
+    int cy = CLOSE_BTN_HEIGHT / 2;
+    for (int d = -3; d <= 3; d++) {
+        close_btn_pixels[cy + d][cx + d] = COLOR_WHITE;
+        close_btn_pixels[cy - d][cx + d] = COLOR_WHITE;
+        close_btn_pixels[cy + d][cx + d + 1] = COLOR_WHITE;
+        close_btn_pixels[cy - d][cx + d + 1] = COLOR_WHITE;
+    }
+    close_btn_sprite = vga_sprite_create(CLOSE_BTN_WIDTH, CLOSE_BTN_HEIGHT, &close_btn_pixels[0][0]);
 }
 
 /* Point in rect check */
@@ -99,21 +186,41 @@ int point_in_rect(int px, int py, int rx, int ry, int rw, int rh) {
 
 /* Initialize GUI */
 void gui_init(void) {
+    if (!window_cache_ready) {
+        kmem_cache_init(&window_cache, "gui-window", sizeof(gui_window_t));
+        window_cache_ready = 1;
+    }
+    
+    for (int i = 0; i < num_slots; i++) {
+        kmem_cache_free(&window_cache, slots[i].win);
+        kfree(slots[i].surface);
+        slots[i].win = 0;
+        slots[i].surface = 0;
+        slots[i].surface_size = 0;
+    }
     num_windows = 0;
     num_buttons = 0;
     active_window = -1;
+    drag_window = -1;
+    pressed_button = -1;
+    hovered_button = -1;
+    hit_stale = 1;
     cursor_visible = 0;
-    cursor_x = SCREEN_WIDTH / 2;
-    cursor_y = SCREEN_HEIGHT / 2;
+    if (cursor_sprite < 0) build_sprites();
 }
 
 /* Create window */
 int gui_create_window(int x, int y, int width, int height, const char* title) {
-    if (num_windows >= MAX_WINDOWS) return -1;
+    int id = 0;
+    while (id < num_slots && slots[id].win) id++;
+    if (id == num_slots && !grow_slots()) return -1;
     
-    int id = num_windows++;
-    gui_window_t* win = &windows[id];
+    gui_window_t* win = kmem_cache_alloc(&window_cache);
+    if (!win) return -1;
+    slots[id].win = win;
+    z_order[num_windows++] = id;  /* new windows open on top */
     
+    win->id = id;
     win->x = x;
     win->y = y;
     win->width = width;
@@ -123,17 +230,28 @@ int gui_create_window(int x, int y, int width, int height, const char* title) {
     win->dragging = 0;
     win->visible = 1;
     win->dirty_region.dirty = 0;
+    win->surface = surface_alloc(id, width, height);
+    win->ops = 0;
+    win->user_data = 0;
+    gui_invalidate_window(id);
+    hit_stale = 1;
+    trace("window open", id);
+    
+    /* The first window adds a task button */
+    if (num_windows == 1) gui_add_dirty_rect(0, SCREEN_HEIGHT - 32, SCREEN_WIDTH, 32);
     
     return id;
 }
 
 /* Create button */
 int gui_create_button(int x, int y, int width, int height, const char* label, void (*callback)(void)) {
-    if (num_buttons >= MAX_BUTTONS) return -1;
+    int id = 0;
+    while (id < num_buttons && buttons[id].used) id++;
+    if (id == MAX_BUTTONS) return -1;
+    if (id == num_buttons) num_buttons++;
     
-    int id = num_buttons++;
     gui_button_t* btn = &buttons[id];
-    
+    btn->used = 1;
     btn->x = x;
     btn->y = y;
     btn->width = width;
@@ -144,6 +262,7 @@ int gui_create_button(int x, int y, int width, int height, const char* label, vo
     btn->hovered = 0;
     btn->visible = 1;
     btn->window_id = -1;
+    hit_stale = 1;
     
     return id;
 }
@@ -160,25 +279,72 @@ int gui_create_window_button(int window_id, int x, int y, int width, int height,
 
 /* Get window */
 gui_window_t* gui_get_window(int id) {
-    if (id >= 0 && id < num_windows) {
-        return &windows[id];
-    }
-    return 0;
+    return live_window(id);
+}
+
+int gui_window_slots(void) {
+    return num_slots;
 }
 
 /* Show/hide window */
 void gui_show_window(int window_id, int visible) {
-    if (window_id >= 0 && window_id < num_windows) {
-        windows[window_id].visible = visible;
+    gui_window_t* win = live_window(window_id);
+    if (win && win->visible != visible) {
+        damage_window(win);
+        win->visible = visible;
+        hit_stale = 1;
+    }
+}
+
+/* Bring back an open window, returns 0 if there is none with that ID */
+int gui_focus_window(int window_id) {
+    if (!live_window(window_id)) return 0;
+    gui_show_window(window_id, 1);
+    gui_set_active_window(window_id);
+    return 1;
+}
+
+/* Position of a window in the stack */
+static int z_index(int window_id) {
+    for (int z = 0; z < num_windows; z++) {
+        if (z_order[z] == window_id) return z;
     }
+    return -1;
 }
 
-/* Set active window */
+/* Bring a window to the top of the stack */
+void gui_raise_window(int window_id) {
+    int z = z_index(window_id);
+    if (z < 0 || z == num_windows - 1) return;
+    for (; z < num_windows - 1; z++) z_order[z] = z_order[z + 1];
+    z_order[z] = window_id;
+    if (slots[window_id].win->visible) damage_window(slots[window_id].win);
+    hit_stale = 1;
+}
+
+/* Send a window to the bottom of the stack */
+void gui_lower_window(int window_id) {
+    int z = z_index(window_id);
+    if (z <= 0) return;
+    for (; z > 0; z--) z_order[z] = z_order[z - 1];
+    z_order[0] = window_id;
+    if (slots[window_id].win->visible) damage_window(slots[window_id].win);
+    hit_stale = 1;
+}
+
+/* Set active window (and raise it) */
 void gui_set_active_window(int window_id) {
-    for (int i = 0; i < num_windows; i++) {
-        windows[i].active = (i == window_id);
+    if (!live_window(window_id)) window_id = -1;
+    
+    /* Title bars change colour; the new one also comes to the front */
+    for (int z = 0; z < num_windows; z++) {
+        gui_window_t* win = slots[z_order[z]].win;
+        int active = (win->id == window_id);
+        if (win->active != active) gui_invalidate_window_rect(win->id, 0, 0, win->width, 21);
+        win->active = active;
     }
     active_window = window_id;
+    gui_raise_window(window_id);
 }
 
 /* Get active window */
@@ -186,79 +352,241 @@ int gui_get_active_window(void) {
     return active_window;
 }
 
-/* Close window (hide it) */
+/* Close window - destroys it, the slot and its ID get reused */
 void gui_close_window(int window_id) {
-    if (window_id >= 0 && window_id < num_windows) {
-        windows[window_id].visible = 0;
-        windows[window_id].active = 0;
-        if (active_window == window_id) {
-            active_window = -1;
+    gui_window_t* win = live_window(window_id);
+    if (!win) return;
+    trace("window close", window_id);
+    
+    if (win->ops && win->ops->close) win->ops->close(win);
+    if (win->visible) damage_window(win);
+    
+    int z = z_index(window_id);
+    for (num_windows--; z < num_windows; z++) z_order[z] = z_order[z + 1];
+    
+    /* Its buttons go with it, and their slots are free again */
+    for (int b = 0; b < num_buttons; b++) {
+        if (buttons[b].used && buttons[b].window_id == window_id) {
+            buttons[b].used = 0;
+            buttons[b].visible = 0;
+            buttons[b].window_id = -1;
+            if (pressed_button == b) pressed_button = -1;
+            if (hovered_button == b) hovered_button = -1;
         }
     }
+    while (num_buttons > 0 && !buttons[num_buttons - 1].used) num_buttons--;
+    hit_stale = 1;
+    
+    slots[window_id].win = 0;
+    kmem_cache_free(&window_cache, win);
+    if (active_window == window_id) {
+        active_window = -1;
+    }
+    if (drag_window == window_id) {
+        drag_window = -1;
+    }
+    
+    /* The last window takes the task button along */
+    if (num_windows == 0) gui_add_dirty_rect(0, SCREEN_HEIGHT - 32, SCREEN_WIDTH, 32);
+}
+
+/* Attach app callbacks to a window */
+void gui_set_window_ops(int window_id, const gui_window_ops_t* ops, void* user_data) {
+    gui_window_t* win = live_window(window_id);
+    if (!win) return;
+    win->ops = ops;
+    win->user_data = user_data;
+    gui_invalidate_window(window_id);
+}
+
+/* Input goes straight to the active window's callbacks */
+int gui_dispatch_key(char key) {
+    gui_window_t* win = live_window(active_window);
+    if (!win || !win->visible || !win->ops || !win->ops->key) return 0;
+    win->ops->key(win, key);
+    return 1;
+}
+
+int gui_dispatch_click(int mx, int my) {
+    gui_window_t* win = live_window(active_window);
+    if (!win || !win->visible || !win->ops || !win->ops->click) return 0;
+    if (!point_in_rect(mx, my, win->x, win->y + 16, win->width, win->height - 16)) return 0;
+    win->ops->click(win, mx, my);
+    return 1;
 }
 
 /* ============================================================================
  * CURSOR API 2.0 - Optimized rectangle redraws
  * ============================================================================ */
 
-/* Draw cursor - optimized: only redraws cursor area when moved */
+/* Draw cursor - moves the overlay, which restores what it covered */
 void gui_draw_cursor(int x, int y) {
-    /* Clamp position */
-    if (x < 0) x = 0;
-    if (y < 0) y = 0;
-    if (x > SCREEN_WIDTH - CURSOR_WIDTH) x = SCREEN_WIDTH - CURSOR_WIDTH;
-    if (y > SCREEN_HEIGHT - CURSOR_HEIGHT) y = SCREEN_HEIGHT - CURSOR_HEIGHT;
-    
-    /* If cursor moved, erase old position by redrawing that area */
-    if (cursor_last_x >= 0 && cursor_last_y >= 0 && 
-        (cursor_last_x != x || cursor_last_y != y)) {
-        /* Call kernel function to redraw cursor area */
-        extern void redraw_cursor_area_kernel(int x, int y);
-        redraw_cursor_area_kernel(cursor_last_x, cursor_last_y);
+    vga_cursor_move(x, y);
+    if (!cursor_visible) {
+        vga_cursor_set(cursor_sprite);
+        cursor_visible = 1;
     }
-    
-    /* Update position */
-    cursor_x = x;
-    cursor_y = y;
-    cursor_visible = 1;
-    
-    /* Draw cursor at new position */
-    draw_cursor_at(x, y);
-    
-    /* Update last position */
-    cursor_last_x = x;
-    cursor_last_y = y;
 }
 
-/* Erase cursor - in 2.0, this is a no-op since we redraw everything */
+/* Erase cursor - the overlay never damages the scene, nothing to do */
 void gui_erase_cursor(void) {
-    cursor_visible = 0;
 }
 
-/* Invalidate cursor - in 2.0, just marks cursor as not drawn */
+/* Invalidate cursor - the overlay tracks damage under it, nothing to do */
 void gui_cursor_invalidate(void) {
-    cursor_visible = 0;
 }
 
 /* ============================================================================
- * DIRTY RECT STUBS (kept for API compatibility)
+ * DAMAGE TRACKING - dirty rects repainted back to front through the clip
  * ============================================================================ */
 
+static dirty_rect_t dirty_rects[MAX_DIRTY_RECTS];
 static int num_dirty_rects = 0;
 
+/* Scene painters (see gui_set_painters) */
+static void (*paint_background)(void) = 0;
+static void (*paint_overlay)(void) = 0;
+
+/* Compositor (below) */
+static void composite(const dirty_rect_t* d);
+
+/* Bounding box of two rects */
+static dirty_rect_t rect_union(const dirty_rect_t* a, const dirty_rect_t* b) {
+    dirty_rect_t u;
+    u.x = (a->x < b->x) ? a->x : b->x;
+    u.y = (a->y < b->y) ? a->y : b->y;
+    int x1 = (a->x + a->width > b->x + b->width) ? a->x + a->width : b->x + b->width;
+    int y1 = (a->y + a->height > b->y + b->height) ? a->y + a->height : b->y + b->height;
+    u.width = x1 - u.x;
+    u.height = y1 - u.y;
+    u.dirty = 1;
+    return u;
+}
+
+static int rect_area(const dirty_rect_t* r) {
+    return r->width * r->height;
+}
+
 void gui_add_dirty_rect(int x, int y, int width, int height) {
-    (void)x; (void)y; (void)width; (void)height;
+    /* Clip to the screen */
+    if (x < 0) { width += x; x = 0; }
+    if (y < 0) { height += y; y = 0; }
+    if (x + width > SCREEN_WIDTH) width = SCREEN_WIDTH - x;
+    if (y + height > SCREEN_HEIGHT) height = SCREEN_HEIGHT - y;
+    if (width <= 0 || height <= 0) return;
+    
+    dirty_rect_t r = { x, y, width, height, 1 };
+    
+    /* Merge with every rect whose bounding box costs no more than painting
+     * both; a grown rect may swallow rects it missed before, so rescan */
+    int i = 0;
+    while (i < num_dirty_rects) {
+        dirty_rect_t u = rect_union(&r, &dirty_rects[i]);
+        if (rect_area(&u) <= rect_area(&r) + rect_area(&dirty_rects[i])) {
+            r = u;
+            dirty_rects[i] = dirty_rects[--num_dirty_rects];
+            i = 0;
+        } else {
+            i++;
+        }
+    }
+    
+    if (num_dirty_rects == MAX_DIRTY_RECTS) {
+        /* List full - fold into the rect that grows least */
+        int best = 0, best_growth = -1;
+        for (i = 0; i < num_dirty_rects; i++) {
+            dirty_rect_t u = rect_union(&r, &dirty_rects[i]);
+            int growth = rect_area(&u) - rect_area(&dirty_rects[i]);
+            if (best_growth < 0 || growth < best_growth) {
+                best = i;
+                best_growth = growth;
+            }
+        }
+        dirty_rects[best] = rect_union(&r, &dirty_rects[best]);
+        return;
+    }
+    dirty_rects[num_dirty_rects++] = r;
+}
+
+void gui_invalidate_window_rect(int window_id, int x, int y, int width, int height) {
+    gui_window_t* win = live_window(window_id);
+    if (!win || width <= 0 || height <= 0) return;
+    
+    dirty_rect_t* d = &win->dirty_region;
+    dirty_rect_t r = { x, y, width, height, 1 };
+    *d = d->dirty ? rect_union(d, &r) : r;
+}
+
+void gui_invalidate_window(int window_id) {
+    gui_window_t* win = live_window(window_id);
+    if (win) gui_invalidate_window_rect(window_id, 0, 0, win->width, win->height);
 }
 
 int gui_has_dirty_rects(void) {
+    /* Hidden windows keep their damage but have nothing to repaint */
+    for (int z = 0; z < num_windows; z++) {
+        gui_window_t* win = slots[z_order[z]].win;
+        if (win->visible && win->dirty_region.dirty) return 1;
+    }
     return num_dirty_rects > 0;
 }
 
 void gui_clear_dirty_rects(void) {
+    for (int z = 0; z < num_windows; z++) {
+        slots[z_order[z]].win->dirty_region.dirty = 0;
+    }
     num_dirty_rects = 0;
 }
 
+void gui_set_painters(void (*background)(void), void (*overlay)(void)) {
+    paint_background = background;
+    paint_overlay = overlay;
+}
+
+/* Draw a window's frame, contents and buttons (through the current clip) */
+static void draw_window_layers(int id) {
+    gui_window_t* win = slots[id].win;
+    gui_draw_window(win);
+    
+    /* App draw code may take scratch from frame_arena; it goes afterwards */
+    if (win->ops && win->ops->draw) {
+        ARENA_SCOPE(&frame_arena) {
+            win->ops->draw(win);
+        }
+    }
+    for (int b = 0; b < num_buttons; b++) {
+        if (buttons[b].window_id == id) gui_draw_button(&buttons[b]);
+    }
+}
+
 void gui_redraw_dirty(void) {
+    /* Window damage is rendered into the backing store, then becomes screen
+     * damage where the window is now. Hidden windows keep it until shown. */
+    for (int z = 0; z < num_windows; z++) {
+        gui_window_t* win = slots[z_order[z]].win;
+        dirty_rect_t* d = &win->dirty_region;
+        if (!d->dirty || !win->visible) continue;
+        d->dirty = 0;
+        
+        int x0 = (d->x < 0) ? 0 : d->x;
+        int y0 = (d->y < 0) ? 0 : d->y;
+        int x1 = (d->x + d->width > win->width) ? win->width : d->x + d->width;
+        int y1 = (d->y + d->height > win->height) ? win->height : d->y + d->height;
+        if (x1 <= x0 || y1 <= y0) continue;
+        
+        if (win->surface) {
+            vga_set_target(win->surface, win->x, win->y, win->width, win->height);
+            vga_set_clip(win->x + x0, win->y + y0, x1 - x0, y1 - y0);
+            draw_window_layers(win->id);
+            vga_set_target(0, 0, 0, 0, 0);
+        }
+        gui_add_dirty_rect(win->x + x0, win->y + y0, x1 - x0, y1 - y0);
+    }
+    
+    for (int i = 0; i < num_dirty_rects; i++) {
+        composite(&dirty_rects[i]);
+    }
+    vga_reset_clip();
     num_dirty_rects = 0;
 }
 
@@ -414,27 +742,9 @@ void gui_draw_window(gui_window_t* win) {
     }
     
     /* Close button (X) */
-    int btn_width = 16;
-    int btn_height = 14;
     int btn_y = y + 5;
-    int close_x = x + w - btn_width - 6;
-    
-    /* Red background for close button */
-    vga_fillrect(close_x, btn_y, btn_width, btn_height, COLOR_RED);
-    vga_hline(close_x, btn_y, btn_width, COLOR_LIGHT_RED);
-    vga_vline(close_x, btn_y, btn_height, COLOR_LIGHT_RED);
-    vga_hline(close_x, btn_y + btn_height - 1, btn_width, COLOR_BROWN);
-    vga_vline(close_x + btn_width - 1, btn_y, btn_height, COLOR_BROWN);
-    
-    /* Draw X */
-    int cx = close_x + btn_width / 2;
-    int cy = btn_y + btn_height / 2;
-    for (int d = -3; d <= 3; d++) {
-        vga_putpixel(cx + d, cy + d, COLOR_WHITE);
-        vga_putpixel(cx + d, cy - d, COLOR_WHITE);
-        vga_putpixel(cx + d + 1, cy + d, COLOR_WHITE);
-        vga_putpixel(cx + d + 1, cy - d, COLOR_WHITE);
-    }
+    int close_x = x + w - CLOSE_BTN_WIDTH - 6;
+    vga_sprite_draw(close_btn_sprite, close_x, btn_y);
 }
 
 /* Draw button */
@@ -445,9 +755,9 @@ void gui_draw_button(gui_button_t* btn) {
     int y = btn->y;
     
     /* Offset for window-relative buttons */
-    if (btn->window_id >= 0 && btn->window_id < num_windows) {
-        gui_window_t* win = &windows[btn->window_id];
-        if (!win->visible) return;
+    if (btn->window_id >= 0) {
+        gui_window_t* win = live_window(btn->window_id);
+        if (!win || !win->visible) return;
         x += win->x;
         y += win->y + 16;
     }
@@ -492,7 +802,154 @@ void gui_draw_button(gui_button_t* btn) {
     vga_putstring(text_x, text_y, btn->label, GUI_COLOR_BUTTON_FG, bg_color);
 }
 
-/* Update GUI - handle input */
+/* ============================================================================
+ * HIT TESTING - the topmost thing under a point, without scanning everything
+ * ============================================================================ */
+
+/* Targets are kept top of the stack first, and each cell of a coarse screen
+ * grid has a bitmask of the targets overlapping it. A lookup walks only its
+ * cell's bits, lowest first, so the first rect containing the point wins.
+ * Both come from the heap and grow with the number of windows. */
+#define HIT_CELL_SHIFT 6    /* 64x64 pixel cells */
+#define HIT_GRID_W 16       /* 1024x768; larger screens share the edge cells */
+#define HIT_GRID_H 12
+
+typedef struct {
+    int x, y, width, height;
+    gui_hit_kind_t kind;    /* HIT_WINDOW_BODY stands for the whole window */
+    int id;
+} hit_target_t;
+
+static hit_target_t* hit_targets = 0;
+static int num_hit_targets = 0;
+static int hit_capacity = 0;    /* a multiple of 32 */
+static uint32_t* hit_grid = 0;  /* HIT_GRID_H x HIT_GRID_W cells of hit_capacity / 32 words */
+
+static inline uint32_t* hit_cell_bits(int cx, int cy) {
+    return hit_grid + (cy * HIT_GRID_W + cx) * (hit_capacity / 32);
+}
+
+/* Room for n targets; keeps the old index when memory is short */
+static void hit_reserve(int n) {
+    if (n <= hit_capacity) return;
+    int cap = hit_capacity ? hit_capacity : 64;
+    while (cap < n) cap *= 2;
+    
+    hit_target_t* targets = kmalloc(cap * sizeof(hit_target_t));
+    uint32_t* grid = kmalloc(HIT_GRID_H * HIT_GRID_W * (cap / 32) * sizeof(uint32_t));
+    if (!targets || !grid) {
+        kfree(targets);
+        kfree(grid);
+        return;
+    }
+    kfree(hit_targets);
+    kfree(hit_grid);
+    hit_targets = targets;
+    hit_grid = grid;
+    hit_capacity = cap;
+}
+
+static int hit_cell(int v, int cells) {
+    v >>= HIT_CELL_SHIFT;
+    return (v < cells) ? v : cells - 1;
+}
+
+/* Append a target below all the ones added before it */
+static void hit_add(gui_hit_kind_t kind, int id, int x, int y, int width, int height) {
+    int x0 = (x < 0) ? 0 : x;
+    int y0 = (y < 0) ? 0 : y;
+    int x1 = (x + width > SCREEN_WIDTH) ? SCREEN_WIDTH : x + width;
+    int y1 = (y + height > SCREEN_HEIGHT) ? SCREEN_HEIGHT : y + height;
+    if (x1 <= x0 || y1 <= y0 || num_hit_targets == hit_capacity) return;
+    
+    int n = num_hit_targets++;
+    hit_target_t* t = &hit_targets[n];
+    t->x = x;
+    t->y = y;
+    t->width = width;
+    t->height = height;
+    t->kind = kind;
+    t->id = id;
+    
+    for (int cy = hit_cell(y0, HIT_GRID_H); cy <= hit_cell(y1 - 1, HIT_GRID_H); cy++) {
+        for (int cx = hit_cell(x0, HIT_GRID_W); cx <= hit_cell(x1 - 1, HIT_GRID_W); cx++) {
+            hit_cell_bits(cx, cy)[n / 32] |= 1u << (n % 32);
+        }
+    }
+}
+
+static void hit_rebuild(void) {
+    int icons = 0;
+    while (desktop_icons && desktop_icons[icons].label) icons++;
+    hit_reserve(num_windows + num_buttons + icons);
+    
+    for (int i = 0; i < HIT_GRID_H * HIT_GRID_W * (hit_capacity / 32); i++) hit_grid[i] = 0;
+    num_hit_targets = 0;
+    
+    /* Windows top down, each with its buttons just above it */
+    for (int z = num_windows - 1; z >= 0; z--) {
+        gui_window_t* win = slots[z_order[z]].win;
+        if (!win->visible) continue;
+        for (int b = 0; b < num_buttons; b++) {
+            gui_button_t* btn = &buttons[b];
+            if (btn->visible && btn->window_id == win->id) {
+                hit_add(HIT_BUTTON, b, win->x + btn->x, win->y + 16 + btn->y, btn->width, btn->height);
+            }
+        }
+        hit_add(HIT_WINDOW_BODY, win->id, win->x, win->y, win->width, win->height);
+    }
+    
+    /* Then the desktop */
+    for (int b = 0; b < num_buttons; b++) {
+        gui_button_t* btn = &buttons[b];
+        if (btn->visible && btn->window_id < 0) {
+            hit_add(HIT_BUTTON, b, btn->x, btn->y, btn->width, btn->height);
+        }
+    }
+    for (int i = 0; desktop_icons && desktop_icons[i].label; i++) {
+        hit_add(HIT_ICON, i, desktop_icons[i].x, desktop_icons[i].y, 48, 32);
+    }
+    
+    hit_stale = 0;
+}
+
+gui_hit_t gui_hit_test(int x, int y) {
+    gui_hit_t hit = { HIT_NONE, -1 };
+    if (!point_in_rect(x, y, 0, 0, SCREEN_WIDTH, SCREEN_HEIGHT)) return hit;
+    if (hit_stale) hit_rebuild();
+    
+    const uint32_t* cell = hit_cell_bits(hit_cell(x, HIT_GRID_W), hit_cell(y, HIT_GRID_H));
+    for (int w = 0; w < hit_capacity / 32; w++) {
+        for (uint32_t bits = cell[w]; bits; bits &= bits - 1) {
+            const hit_target_t* t = &hit_targets[w * 32 + __builtin_ctz(bits)];
+            if (!point_in_rect(x, y, t->x, t->y, t->width, t->height)) continue;
+            
+            hit.kind = t->kind;
+            hit.id = t->id;
+            if (t->kind == HIT_WINDOW_BODY) {
+                if (point_in_rect(x, y, t->x + t->width - 22, t->y + 5, 16, 14)) {
+                    hit.kind = HIT_WINDOW_CLOSE;
+                } else if (y < t->y + 20) {
+                    hit.kind = HIT_WINDOW_TITLE;
+                }
+            }
+            return hit;
+        }
+    }
+    return hit;
+}
+
+void gui_set_desktop_icons(const desktop_icon_t* icons) {
+    desktop_icons = icons;
+    hit_stale = 1;
+}
+
+int gui_get_drag_window(void) {
+    return drag_window;
+}
+
+/* Update GUI - handle input. A click goes to whatever is on top under the
+ * pointer; while a window is dragged it only follows the pointer. */
 void gui_update(void) {
     int mx = mouse_get_x();
     int my = mouse_get_y();
@@ -501,107 +958,266 @@ void gui_update(void) {
     int released = mouse_button_released(MOUSE_LEFT);
     
     /* Handle window dragging */
-    for (int i = num_windows - 1; i >= 0; i--) {
-        gui_window_t* win = &windows[i];
-        if (!win->visible) continue;
-        
-        if (win->dragging) {
-            if (down) {
-                win->x = mx - win->drag_offset_x;
-                win->y = my - win->drag_offset_y;
-                
-                /* Keep on screen */
-                if (win->x < 0) win->x = 0;
-                if (win->y < 13) win->y = 13;
-                if (win->x + win->width > SCREEN_WIDTH) 
-                    win->x = SCREEN_WIDTH - win->width;
-                if (win->y + win->height > SCREEN_HEIGHT - 32)
-                    win->y = SCREEN_HEIGHT - 32 - win->height;
-            } else {
-                win->dragging = 0;
-            }
-            return;
+    gui_window_t* dragged = live_window(drag_window);
+    if (dragged) {
+        if (down) {
+            int x = mx - dragged->drag_offset_x;
+            int y = my - dragged->drag_offset_y;
+            
+            /* Keep on screen */
+            if (x < 0) x = 0;
+            if (y < 13) y = 13;
+            if (x + dragged->width > SCREEN_WIDTH) 
+                x = SCREEN_WIDTH - dragged->width;
+            if (y + dragged->height > SCREEN_HEIGHT - 32)
+                y = SCREEN_HEIGHT - 32 - dragged->height;
+            gui_move_window(drag_window, x, y);
+        } else {
+            dragged->dragging = 0;
+            drag_window = -1;
         }
+        return;
     }
     
-    /* Check for window clicks */
-    for (int i = num_windows - 1; i >= 0; i--) {
-        gui_window_t* win = &windows[i];
-        if (!win->visible) continue;
-        
-        /* Check close button */
-        int close_x = win->x + win->width - 22;
-        int close_y = win->y + 5;
-        if (clicked && point_in_rect(mx, my, close_x, close_y, 16, 14)) {
-            win->visible = 0;
-            return;
+    gui_hit_t hit = gui_hit_test(mx, my);
+    
+    /* Update buttons - only the one under the pointer can change */
+    int over = (hit.kind == HIT_BUTTON) ? hit.id : -1;
+    if (hovered_button >= 0 && hovered_button != over) buttons[hovered_button].hovered = 0;
+    hovered_button = over;
+    if (pressed_button >= 0 && pressed_button != over) {
+        buttons[pressed_button].pressed = 0;
+        pressed_button = -1;
+    }
+    if (over >= 0) {
+        gui_button_t* btn = &buttons[over];
+        btn->hovered = 1;
+        if (clicked) {
+            btn->pressed = 1;
+            pressed_button = over;
         }
-        
-        /* Check title bar for dragging */
-        if (clicked && point_in_rect(mx, my, win->x, win->y, win->width, 20)) {
+        if (released && btn->pressed) {
+            btn->pressed = 0;
+            pressed_button = -1;
+            if (btn->callback) {
+                btn->callback();
+            }
+        }
+    }
+    
+    if (!clicked) return;
+    
+    switch (hit.kind) {
+        case HIT_WINDOW_CLOSE:
+            gui_close_window(hit.id);
+            break;
+        case HIT_WINDOW_TITLE: {
+            gui_window_t* win = slots[hit.id].win;
             win->dragging = 1;
             win->drag_offset_x = mx - win->x;
             win->drag_offset_y = my - win->y;
-            gui_set_active_window(i);
-            return;
-        }
-        
-        /* Check window body click to activate */
-        if (clicked && point_in_rect(mx, my, win->x, win->y, win->width, win->height)) {
-            gui_set_active_window(i);
+            drag_window = hit.id;
+            gui_set_active_window(hit.id);
+            break;
         }
+        case HIT_WINDOW_BODY:
+            gui_set_active_window(hit.id);
+            gui_dispatch_click(mx, my);
+            break;
+        case HIT_BUTTON:
+            if (buttons[hit.id].window_id >= 0) gui_set_active_window(buttons[hit.id].window_id);
+            break;
+        case HIT_ICON:
+            if (desktop_icons[hit.id].action) desktop_icons[hit.id].action();
+            break;
+        default:
+            break;
     }
+}
+
+/* ============================================================================
+ * COMPOSITOR - each window is painted only where nothing above covers it
+ * ============================================================================ */
+
+#define REGION_LOCAL_RECTS 16
+
+/* Set of disjoint rects. They start out in the struct and move to the
+ * frame arena if there are more (so a region_t must not be copied). */
+typedef struct {
+    int count;
+    int capacity;
+    dirty_rect_t* rects;
+    dirty_rect_t local[REGION_LOCAL_RECTS];
+} region_t;
+
+/* Region holding the intersection of two rects (empty if they miss) */
+static void region_init(region_t* rg, const dirty_rect_t* a, int x, int y, int w, int h) {
+    int x0 = (a->x > x) ? a->x : x;
+    int y0 = (a->y > y) ? a->y : y;
+    int x1 = (a->x + a->width < x + w) ? a->x + a->width : x + w;
+    int y1 = (a->y + a->height < y + h) ? a->y + a->height : y + h;
+    rg->count = 0;
+    rg->capacity = REGION_LOCAL_RECTS;
+    rg->rects = rg->local;
+    if (x1 <= x0 || y1 <= y0) return;
+    dirty_rect_t r = { x0, y0, x1 - x0, y1 - y0, 1 };
+    rg->rects[rg->count++] = r;
+}
+
+/* Room for at least 'need' rects, 0 if the frame arena is full */
+static int region_grow(region_t* rg, int need) {
+    int capacity = rg->capacity * 2;
+    while (capacity < need) capacity *= 2;
+    dirty_rect_t* rects = arena_alloc(&frame_arena, capacity * sizeof(dirty_rect_t));
+    if (!rects) return 0;
     
-    /* Update buttons */
-    for (int i = 0; i < num_buttons; i++) {
-        gui_button_t* btn = &buttons[i];
-        if (!btn->visible) continue;
+    for (int i = 0; i < rg->count; i++) rects[i] = rg->rects[i];
+    rg->rects = rects;
+    rg->capacity = capacity;
+    return 1;
+}
+
+/* Cut a rect out of the region. Each hit rect splits into up to four
+ * bands; if there is no room for them the rect is kept whole, which only
+ * costs overdraw since everything above is painted later. */
+static void region_subtract(region_t* rg, int x, int y, int w, int h) {
+    int n = rg->count;
+    for (int i = 0; i < n; ) {
+        dirty_rect_t a = rg->rects[i];
+        int ax1 = a.x + a.width, ay1 = a.y + a.height;
+        if (x >= ax1 || x + w <= a.x || y >= ay1 || y + h <= a.y) {
+            i++;
+            continue;
+        }
         
-        int bx = btn->x;
-        int by = btn->y;
+        dirty_rect_t parts[4];
+        int np = 0;
+        int my0 = (y > a.y) ? y : a.y;
+        int my1 = (y + h < ay1) ? y + h : ay1;
+        if (y > a.y) parts[np++] = (dirty_rect_t){ a.x, a.y, a.width, y - a.y, 1 };
+        if (y + h < ay1) parts[np++] = (dirty_rect_t){ a.x, y + h, a.width, ay1 - (y + h), 1 };
+        if (x > a.x) parts[np++] = (dirty_rect_t){ a.x, my0, x - a.x, my1 - my0, 1 };
+        if (x + w < ax1) parts[np++] = (dirty_rect_t){ x + w, my0, ax1 - (x + w), my1 - my0, 1 };
         
-        if (btn->window_id >= 0 && btn->window_id < num_windows) {
-            gui_window_t* win = &windows[btn->window_id];
-            if (!win->visible) continue;
-            bx += win->x;
-            by += win->y + 16;
+        int need = rg->count - 1 + np;
+        if (need > rg->capacity && !region_grow(rg, need)) {
+            i++;
+            continue;
         }
         
-        int hover = point_in_rect(mx, my, bx, by, btn->width, btn->height);
-        btn->hovered = hover;
-        
-        if (hover) {
-            if (clicked) {
-                btn->pressed = 1;
-            }
-            if (released && btn->pressed) {
-                btn->pressed = 0;
-                if (btn->callback) {
-                    btn->callback();
-                }
+        /* Drop rect i (the last unvisited one takes its place), append the parts */
+        rg->rects[i] = rg->rects[n - 1];
+        rg->rects[n - 1] = rg->rects[rg->count - 1];
+        rg->count--;
+        n--;
+        for (int k = 0; k < np; k++) rg->rects[rg->count++] = parts[k];
+    }
+}
+
+/* Paint one layer (-1 = desktop) through each rect of its visible region.
+ * Windows with a backing store are copied from it, never redrawn. */
+static void paint_layer(const region_t* rg, int id) {
+    for (int i = 0; i < rg->count; i++) {
+        const dirty_rect_t* r = &rg->rects[i];
+        vga_set_clip(r->x, r->y, r->width, r->height);
+        if (id < 0) {
+            if (paint_background) paint_background();
+            for (int b = 0; b < num_buttons; b++) {
+                if (buttons[b].window_id < 0) gui_draw_button(&buttons[b]);
             }
+        } else if (slots[id].win->surface) {
+            gui_window_t* win = slots[id].win;
+            vga_drawbitmap(win->x, win->y, win->width, win->height, win->surface);
         } else {
-            btn->pressed = 0;
+            draw_window_layers(id);
         }
     }
 }
 
-/* Draw entire GUI (windows and buttons only) */
-void gui_draw(void) {
-    /* Draw windows (back to front) */
-    for (int i = 0; i < num_windows; i++) {
-        if (i != active_window) {
-            gui_draw_window(&windows[i]);
+/* Repaint one screen rect: every layer minus the windows stacked above it */
+static void composite(const dirty_rect_t* d) {
+    region_t rg;
+    
+    /* Desktop - whatever no window covers */
+    ARENA_SCOPE(&frame_arena) {
+        region_init(&rg, d, 0, 0, SCREEN_WIDTH, SCREEN_HEIGHT);
+        for (int z = 0; z < num_windows && rg.count; z++) {
+            gui_window_t* win = slots[z_order[z]].win;
+            if (win->visible) region_subtract(&rg, win->x, win->y, win->width, win->height);
         }
+        paint_layer(&rg, -1);
     }
     
-    /* Draw active window last (on top) */
-    if (active_window >= 0 && active_window < num_windows) {
-        gui_draw_window(&windows[active_window]);
+    /* Windows bottom to top; fully covered ones paint nothing */
+    for (int z = 0; z < num_windows; z++) {
+        int id = z_order[z];
+        gui_window_t* win = slots[id].win;
+        if (!win->visible) continue;
+        
+        ARENA_SCOPE(&frame_arena) {
+            region_init(&rg, d, win->x, win->y, win->width, win->height);
+            for (int above = z + 1; above < num_windows && rg.count; above++) {
+                gui_window_t* top = slots[z_order[above]].win;
+                if (top->visible) region_subtract(&rg, top->x, top->y, top->width, top->height);
+            }
+            paint_layer(&rg, id);
+        }
     }
     
-    /* Draw buttons */
-    for (int i = 0; i < num_buttons; i++) {
-        gui_draw_button(&buttons[i]);
+    /* Popups over everything */
+    if (paint_overlay) {
+        vga_set_clip(d->x, d->y, d->width, d->height);
+        paint_overlay();
+    }
+}
+
+/* Move a window. When nothing covers it, its pixels are block-copied to
+ * the new spot (latch copy in VRAM, memmove in the shadow) and only the
+ * strips it uncovers are recomposited. */
+void gui_move_window(int window_id, int x, int y) {
+    gui_window_t* win = live_window(window_id);
+    if (!win) return;
+    if (x == win->x && y == win->y) return;
+    hit_stale = 1;
+    if (!win->visible) {
+        win->x = x;
+        win->y = y;
+        return;
     }
+    
+    int covered = 0;
+    for (int z = z_index(window_id) + 1; z < num_windows; z++) {
+        if (slots[z_order[z]].win->visible) covered = 1;
+    }
+    int w = win->width, h = win->height;
+    int fits = point_in_rect(win->x, win->y, 0, 0, SCREEN_WIDTH - w + 1, SCREEN_HEIGHT - h + 1) &&
+               point_in_rect(x, y, 0, 0, SCREEN_WIDTH - w + 1, SCREEN_HEIGHT - h + 1);
+    
+    if (covered || !fits) {
+        damage_window(win);
+        win->x = x;
+        win->y = y;
+        damage_window(win);
+        return;
+    }
+    
+    /* Bring the screen up to date first so the copy moves current pixels */
+    gui_redraw_dirty();
+    vga_copyrect(win->x, win->y, x, y, w, h);
+    
+    region_t rg;
+    dirty_rect_t old = { win->x, win->y, w, h, 1 };
+    region_init(&rg, &old, 0, 0, SCREEN_WIDTH, SCREEN_HEIGHT);
+    region_subtract(&rg, x, y, w, h);
+    win->x = x;
+    win->y = y;
+    for (int i = 0; i < rg.count; i++) {
+        gui_add_dirty_rect(rg.rects[i].x, rg.rects[i].y, rg.rects[i].width, rg.rects[i].height);
+    }
+}
+
+/* Draw entire GUI */
+void gui_draw(void) {
+    gui_add_dirty_rect(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT);
+    gui_redraw_dirty();
 }
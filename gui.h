@@ -8,14 +8,13 @@
 
 #include <stdint.h>
 
-/* Maximum UI elements */
-#define MAX_WINDOWS 8
+/* Maximum UI elements (the window table grows as needed) */
 #define MAX_BUTTONS 32
 #define MAX_DIRTY_RECTS 16
 
-/* Cursor size for backup */
+/* Cursor size */
 #define CURSOR_WIDTH 12
-#define CURSOR_HEIGHT 12
+#define CURSOR_HEIGHT 16
 
 /* Dirty rectangle for partial updates */
 typedef struct {
@@ -24,8 +23,19 @@ typedef struct {
     int dirty;
 } dirty_rect_t;
 
-/* Window structure */
+typedef struct gui_window gui_window_t;
+
+/* Per-window app callbacks (any may be 0). Coordinates are screen ones. */
 typedef struct {
+    void (*draw)(gui_window_t* win);                   /* window contents */
+    void (*key)(gui_window_t* win, char key);          /* while the window is active */
+    void (*click)(gui_window_t* win, int mx, int my);  /* below the title bar */
+    void (*close)(gui_window_t* win);                  /* before it is destroyed */
+} gui_window_ops_t;
+
+/* Window structure */
+struct gui_window {
+    int id;                     /* index in the window table */
     int x, y;
     int width, height;
     const char* title;
@@ -33,11 +43,15 @@ typedef struct {
     int dragging;
     int drag_offset_x, drag_offset_y;
     int visible;
-    dirty_rect_t dirty_region;
-} gui_window_t;
+    dirty_rect_t dirty_region;  /* pending damage, window-relative */
+    uint8_t* surface;           /* backing store, width*height; 0 = drawn directly */
+    const gui_window_ops_t* ops;
+    void* user_data;            /* for the callbacks */
+};
 
 /* Button structure */
 typedef struct {
+    int used;       /* slot holds a button */
     int x, y;
     int width, height;
     const char* label;
@@ -61,10 +75,32 @@ int gui_create_button(int x, int y, int width, int height, const char* label, vo
 int gui_create_window_button(int window_id, int x, int y, int width, int height, 
                               const char* label, void (*callback)(void));
 
-/* Update GUI (handle input) */
+/* Update GUI (handle input): routes a click to the topmost target under
+ * the pointer, including the active window's click callback */
 void gui_update(void);
 
-/* Draw entire GUI */
+/* What is under a point */
+typedef enum {
+    HIT_NONE = 0,
+    HIT_WINDOW_BODY,
+    HIT_WINDOW_TITLE,
+    HIT_WINDOW_CLOSE,
+    HIT_BUTTON,
+    HIT_ICON,
+} gui_hit_kind_t;
+
+typedef struct {
+    gui_hit_kind_t kind;
+    int id;             /* window, button or icon index */
+} gui_hit_t;
+
+/* Topmost target at a point (grid indexed, rebuilt after windows change) */
+gui_hit_t gui_hit_test(int x, int y);
+
+/* Window being dragged by its title bar, -1 if none */
+int gui_get_drag_window(void);
+
+/* Draw entire GUI (repaints the whole screen) */
 void gui_draw(void);
 
 /* Draw desktop background */
@@ -79,19 +115,30 @@ void gui_draw_button(gui_button_t* btn);
 /* Draw mouse cursor */
 void gui_draw_cursor(int x, int y);
 
-/* Erase cursor (restore background) */
+/* Erase cursor (no-op: the cursor is an overlay) */
 void gui_erase_cursor(void);
 
-/* Invalidate cursor backup (call after full redraw) */
+/* Invalidate cursor backup (no-op: the overlay tracks damage itself) */
 void gui_cursor_invalidate(void);
 
-/* Add a dirty rectangle to update */
+/* Add a dirty rectangle to update (screen coordinates) */
 void gui_add_dirty_rect(int x, int y, int width, int height);
 
+/* Mark part of a window for repaint (window-relative, follows the window) */
+void gui_invalidate_window_rect(int window_id, int x, int y, int width, int height);
+
+/* Mark a whole window for repaint */
+void gui_invalidate_window(int window_id);
+
 /* Check if there are dirty rectangles */
 int gui_has_dirty_rects(void);
 
-/* Redraw only dirty areas */
+/* Scene painters for gui_redraw_dirty(): what lies under the windows and
+ * popups over the windows (either may be 0). Window contents come from
+ * each window's draw callback. */
+void gui_set_painters(void (*background)(void), void (*overlay)(void));
+
+/* Redraw only dirty areas, back to front, clipped to each */
 void gui_redraw_dirty(void);
 
 /* Clear all dirty rectangles */
@@ -100,25 +147,51 @@ void gui_clear_dirty_rects(void);
 /* Show/hide window */
 void gui_show_window(int window_id, int visible);
 
-/* Set active window */
+/* Show and activate an open window, returns 0 if the ID is not open */
+int gui_focus_window(int window_id);
+
+/* Set active window (raises it) */
 void gui_set_active_window(int window_id);
 
+/* Window stacking order */
+void gui_raise_window(int window_id);
+void gui_lower_window(int window_id);
+
+/* Move a window, copying its pixels when nothing covers it */
+void gui_move_window(int window_id, int x, int y);
+
 /* Get active window */
 int gui_get_active_window(void);
 
-/* Close window */
+/* Close window - destroys it, its ID may be handed out again */
 void gui_close_window(int window_id);
 
+/* Attach app callbacks to a window (repaints it) */
+void gui_set_window_ops(int window_id, const gui_window_ops_t* ops, void* user_data);
+
+/* Hand a key to the active window, returns 1 if it took it */
+int gui_dispatch_key(char key);
+
+/* Hand a click to the active window if it hit its contents, returns 1 if so */
+int gui_dispatch_click(int mx, int my);
+
 /* Draw menubar */
 void gui_draw_menubar(void);
 
 /* Get window by ID */
 gui_window_t* gui_get_window(int id);
 
+/* Window IDs are below this (the table grows as windows open) */
+int gui_window_slots(void);
+
 /* Desktop icon structure */
 typedef struct {
     int x, y;
     const char* label;
     void (*action)(void);
 } desktop_icon_t;
+
+/* Icons clicked through gui_update, array ends with a 0 label */
+void gui_set_desktop_icons(const desktop_icon_t* icons);
+
 #endif /* GUI_H */
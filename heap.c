@@ -0,0 +1,212 @@
+/*
+ * heap.c - Kernel heap for GegOS
+ * A slab is one page: a header, then objects. Free objects are linked
+ * through their first word; objects never handed out yet are carved off
+ * the end, so a new slab needs no setup. Every block starts in a page
+ * whose header says what it is, so kfree() finds it by masking the
+ * pointer. Allocating and freeing are O(1) apart from asking the PMM for
+ * a page.
+ */
+
+#include "heap.h"
+#include "pmm.h"
+
+typedef struct slab {
+    kmem_cache_t* cache;        /* 0 for a large block */
+    struct slab* next;          /* in the cache's partial list */
+    struct slab* prev;
+    void* free;                 /* freed objects */
+    uint32_t carved;            /* objects handed out from the end so far */
+    uint32_t in_use;
+    uint32_t pages;             /* large block: pages, and bytes asked for */
+    uint32_t size;
+} slab_t;
+
+/* Objects start a cache line in, so they stay 16-byte aligned */
+#define SLAB_HEADER  64
+#define SLAB_SPACE   (PAGE_SIZE - SLAB_HEADER)
+
+/* kmalloc size classes - the two biggest fill a page exactly */
+static const uint32_t class_sizes[] = { 16, 32, 64, 128, 256, 512, 1008, 2016 };
+#define NUM_CLASSES (int)(sizeof(class_sizes) / sizeof(class_sizes[0]))
+
+static kmem_cache_t size_classes[NUM_CLASSES];
+static const char* const class_names[NUM_CLASSES] = {
+    "kmalloc-16", "kmalloc-32", "kmalloc-64", "kmalloc-128",
+    "kmalloc-256", "kmalloc-512", "kmalloc-1008", "kmalloc-2016"
+};
+static int classes_ready = 0;
+
+/* Size class for each multiple of 16 bytes, so kmalloc does not search */
+static uint8_t class_for[KMALLOC_MAX_SLAB / 16 + 1];
+
+static kmem_cache_t* cache_list = 0;
+static heap_large_stats_t large_stats;
+
+static inline slab_t* slab_of(void* ptr) {
+    return (slab_t*)((uintptr_t)ptr & ~(uintptr_t)(PAGE_SIZE - 1));
+}
+
+static void partial_add(kmem_cache_t* cache, slab_t* slab) {
+    slab->prev = 0;
+    slab->next = cache->partial;
+    if (slab->next) slab->next->prev = slab;
+    cache->partial = slab;
+}
+
+static void partial_remove(kmem_cache_t* cache, slab_t* slab) {
+    if (slab->prev) slab->prev->next = slab->next;
+    else cache->partial = slab->next;
+    if (slab->next) slab->next->prev = slab->prev;
+}
+
+void kmem_cache_init(kmem_cache_t* cache, const char* name, uint32_t size) {
+    size = (size + 15) & ~15u;
+    if (size < 16) size = 16;
+    
+    cache->name = name;
+    cache->object_size = size;
+    cache->per_slab = size <= SLAB_SPACE ? SLAB_SPACE / size : 0;
+    cache->partial = 0;
+    cache->spare = 0;
+    cache->slabs = 0;
+    cache->in_use = 0;
+    cache->allocs = 0;
+    cache->failed = 0;
+    
+    cache->next = cache_list;
+    cache_list = cache;
+}
+
+/* A slab with room: the first partial one, the spare, or a new page */
+static slab_t* slab_with_room(kmem_cache_t* cache) {
+    if (cache->partial) return cache->partial;
+    
+    slab_t* slab = cache->spare;
+    if (slab) {
+        cache->spare = 0;
+    } else {
+        slab = (slab_t*)pmm_alloc_page();
+        if (!slab) return 0;
+        slab->cache = cache;
+        slab->free = 0;
+        slab->carved = 0;
+        slab->in_use = 0;
+        cache->slabs++;
+    }
+    partial_add(cache, slab);
+    return slab;
+}
+
+void* kmem_cache_alloc(kmem_cache_t* cache) {
+    slab_t* slab = cache->per_slab ? slab_with_room(cache) : 0;
+    if (!slab) {
+        cache->failed++;
+        return 0;
+    }
+    
+    void* obj;
+    if (slab->free) {
+        obj = slab->free;
+        slab->free = *(void**)obj;
+    } else {
+        obj = (uint8_t*)slab + SLAB_HEADER + slab->carved * cache->object_size;
+        slab->carved++;
+    }
+    
+    if (++slab->in_use == cache->per_slab) partial_remove(cache, slab);
+    cache->in_use++;
+    cache->allocs++;
+    return obj;
+}
+
+void kmem_cache_free(kmem_cache_t* cache, void* obj) {
+    if (!obj) return;
+    slab_t* slab = slab_of(obj);
+    if (slab->cache != cache) return;
+    
+    *(void**)obj = slab->free;
+    slab->free = obj;
+    
+    if (slab->in_use-- == cache->per_slab) partial_add(cache, slab);
+    cache->in_use--;
+    
+    /* Keep one empty slab for the next alloc, hand the rest back */
+    if (slab->in_use == 0) {
+        partial_remove(cache, slab);
+        if (cache->spare) {
+            pmm_free_page((uintptr_t)slab);
+            cache->slabs--;
+        } else {
+            cache->spare = slab;
+        }
+    }
+}
+
+/* ==== kmalloc ==== */
+
+static void init_classes(void) {
+    for (int i = 0; i < NUM_CLASSES; i++) {
+        kmem_cache_init(&size_classes[i], class_names[i], class_sizes[i]);
+    }
+    int c = 0;
+    for (uint32_t n = 0; n <= KMALLOC_MAX_SLAB / 16; n++) {
+        while (class_sizes[c] < n * 16) c++;
+        class_for[n] = c;
+    }
+    classes_ready = 1;
+}
+
+static void* large_alloc(uint32_t size) {
+    if (size > 0x80000000u) return 0;
+    uint32_t pages = (size + SLAB_HEADER + PAGE_SIZE - 1) / PAGE_SIZE;
+    slab_t* block = (slab_t*)pmm_alloc_pages(pages);
+    if (!block) return 0;
+    
+    block->cache = 0;
+    block->pages = pages;
+    block->size = size;
+    large_stats.blocks++;
+    large_stats.pages += pages;
+    large_stats.requested += size;
+    return (uint8_t*)block + SLAB_HEADER;
+}
+
+void* kmalloc(uint32_t size) {
+    if (!size) return 0;
+    if (size > KMALLOC_MAX_SLAB) return large_alloc(size);
+    if (!classes_ready) init_classes();
+    
+    return kmem_cache_alloc(&size_classes[class_for[(size + 15) / 16]]);
+}
+
+void* kzalloc(uint32_t size) {
+    uint8_t* p = kmalloc(size);
+    if (p) {
+        for (uint32_t i = 0; i < size; i++) p[i] = 0;
+    }
+    return p;
+}
+
+void kfree(void* ptr) {
+    if (!ptr) return;
+    slab_t* slab = slab_of(ptr);
+    if (slab->cache) {
+        kmem_cache_free(slab->cache, ptr);
+        return;
+    }
+    
+    large_stats.blocks--;
+    large_stats.pages -= slab->pages;
+    large_stats.requested -= slab->size;
+    pmm_free_pages((uintptr_t)slab, slab->pages);
+}
+
+kmem_cache_t* kmem_caches(void) {
+    if (!classes_ready) init_classes();
+    return cache_list;
+}
+
+void heap_large_stats(heap_large_stats_t* stats) {
+    *stats = large_stats;
+}
@@ -0,0 +1,56 @@
+/*
+ * heap.h - Kernel heap for GegOS
+ * Slab caches of fixed-size objects, and kmalloc()/kfree() on top of a
+ * set of size-class caches. Everything comes from the page allocator.
+ */
+
+#ifndef HEAP_H
+#define HEAP_H
+
+#include <stdint.h>
+
+struct slab;
+
+/* A cache of objects of one size. Declare it static and kmem_cache_init()
+ * it; the caller owns the struct. */
+typedef struct kmem_cache {
+    const char* name;
+    uint32_t object_size;
+    uint32_t per_slab;          /* objects in one page */
+    struct slab* partial;       /* slabs with free objects */
+    struct slab* spare;         /* one empty slab kept back */
+
+    /* Statistics */
+    uint32_t slabs;
+    uint32_t in_use;
+    uint32_t allocs;
+    uint32_t failed;
+
+    struct kmem_cache* next;
+} kmem_cache_t;
+
+/* Objects up to this size come from slabs, bigger ones from whole pages */
+#define KMALLOC_MAX_SLAB 2016
+
+void kmem_cache_init(kmem_cache_t* cache, const char* name, uint32_t size);
+void* kmem_cache_alloc(kmem_cache_t* cache);
+void kmem_cache_free(kmem_cache_t* cache, void* obj);
+
+/* General allocation, 16-byte aligned, 0 when out of memory */
+void* kmalloc(uint32_t size);
+void* kzalloc(uint32_t size);
+void kfree(void* ptr);
+
+/* Every cache, kmalloc's size classes included */
+kmem_cache_t* kmem_caches(void);
+
+/* Blocks too big for a slab */
+typedef struct {
+    uint32_t blocks;
+    uint32_t pages;
+    uint32_t requested;         /* bytes asked for, the rest is slack */
+} heap_large_stats_t;
+
+void heap_large_stats(heap_large_stats_t* stats);
+
+#endif /* HEAP_H */
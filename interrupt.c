@@ -0,0 +1,343 @@
+/*
+ * interrupt.c - GDT, IDT, 8259 PIC and interrupt dispatch for GegOS
+ * Every vector has a small stub that pushes its number and jumps to a
+ * common stub, which saves the registers and calls interrupt_dispatch().
+ * CPU exceptions end in a crash dump (crash.c).
+ *
+ * A double fault gets a stack of its own, so running off the boot stack
+ * into its guard page is reported instead of resetting the machine: the
+ * 64-bit kernel switches to it through the TSS's IST, the 32-bit one
+ * through a task gate to a second TSS.
+ */
+
+#include "interrupt.h"
+#include "crash.h"
+#include "io.h"
+
+/* 8259 PIC ports */
+#define PIC1_CMD   0x20
+#define PIC1_DATA  0x21
+#define PIC2_CMD   0xA0
+#define PIC2_DATA  0xA1
+
+#define PIC_EOI        0x20
+#define PIC_READ_ISR   0x0B
+#define ICW1_INIT      0x11     /* edge triggered, cascade, ICW4 follows */
+#define ICW4_8086      0x01
+
+/* Stubs exist for the CPU exceptions and the PIC vectors */
+#define NUM_STUBS  (IRQ_BASE + 16)
+#define IDT_SIZE   NUM_STUBS
+
+/* Exceptions the CPU pushes an error code for (8, 10-14, 17, 21, 29, 30) */
+#define ERROR_CODE_VECTORS 0x60227D00
+
+#define VECTOR_DF  8
+
+/* Interrupt and task gates, present, ring 0 */
+#define GATE_INTERRUPT 0x8E
+#define GATE_TASK      0x85
+
+/* GDT selectors */
+#define SEL_CODE   0x08
+#define SEL_DATA   0x10
+#define SEL_TSS    0x18     /* 64-bit: takes two slots */
+#define SEL_DF_TSS 0x20     /* 32-bit only */
+#define GDT_SIZE   5
+
+#define SEG_CODE   0x00CF9A000000FFFFULL    /* flat, ring 0 */
+#define SEG_CODE64 0x00AF9A000000FFFFULL
+#define SEG_DATA   0x00CF92000000FFFFULL
+#define TSS_TYPE   0x89                     /* available TSS, present */
+
+#define DF_STACK_SIZE 8192
+
+/* IDT entry */
+typedef struct {
+    uint16_t offset_low;
+    uint16_t selector;
+#ifdef __x86_64__
+    uint8_t ist;
+    uint8_t type;
+    uint16_t offset_mid;
+    uint32_t offset_high;
+    uint32_t reserved;
+#else
+    uint8_t zero;
+    uint8_t type;
+    uint16_t offset_high;
+#endif
+} __attribute__((packed)) idt_entry_t;
+
+typedef struct {
+    uint16_t limit;
+    uintptr_t base;
+} __attribute__((packed)) idt_ptr_t;
+
+/* Task state segment - only for its stacks (64-bit) or as a task (32-bit) */
+typedef struct {
+#ifdef __x86_64__
+    uint32_t reserved0;
+    uint64_t rsp[3];
+    uint64_t reserved1;
+    uint64_t ist[7];
+    uint64_t reserved2;
+    uint16_t reserved3;
+#else
+    uint32_t link;
+    uint32_t esp0, ss0, esp1, ss1, esp2, ss2;
+    uint32_t cr3, eip, eflags;
+    uint32_t eax, ecx, edx, ebx, esp, ebp, esi, edi;
+    uint32_t es, cs, ss, ds, fs, gs, ldt;
+    uint16_t trap;
+#endif
+    uint16_t iomap;
+} __attribute__((packed)) tss_t;
+
+static uint64_t gdt[GDT_SIZE];
+static tss_t tss;
+static uint8_t df_stack[DF_STACK_SIZE] __attribute__((aligned(16)));
+#ifndef __x86_64__
+static tss_t df_tss;
+#endif
+
+static idt_entry_t idt[IDT_SIZE];
+static void (*irq_handlers[16])(void);
+static volatile uint32_t irq_counts[16];
+static uint8_t pic_masks[2] = { 0xFF, 0xFF };
+
+void interrupt_dispatch(interrupt_frame_t* frame);
+
+/* Stubs, 16 bytes apart from isr_stubs for vectors 0 on, and the common
+ * entry. Where the CPU pushes no error code the stub pushes a 0, so every
+ * frame looks the same. 64-bit code also saves the SSE state (the kernel
+ * uses it), and is built with -mno-red-zone so the CPU's pushes are safe. */
+#define STR_(x) #x
+#define STR(x) STR_(x)
+
+__asm__(
+    ".pushsection .text\n"
+    ".align 16\n"
+    "isr_stubs:\n"
+    ".set isr_vector, 0\n"
+    ".rept " STR(NUM_STUBS) "\n"
+    "    .align 16\n"
+    "    .if isr_vector >= 32 || ((" STR(ERROR_CODE_VECTORS) " >> isr_vector) & 1) == 0\n"
+    "    push $0\n"                 /* error code */
+    "    .endif\n"
+    "    push $isr_vector\n"
+    "    jmp isr_common\n"
+    "    .set isr_vector, isr_vector + 1\n"
+    ".endr\n"
+    "isr_common:\n"
+#ifdef __x86_64__
+    "    push %rax\n    push %rcx\n    push %rdx\n    push %rbx\n"
+    "    push %rbp\n    push %rsi\n    push %rdi\n    push %r8\n"
+    "    push %r9\n    push %r10\n    push %r11\n    push %r12\n"
+    "    push %r13\n    push %r14\n    push %r15\n"
+    "    mov %rsp, %rbx\n"
+    "    sub $512, %rsp\n"          /* still 16-byte aligned */
+    "    fxsave (%rsp)\n"
+    "    mov %rbx, %rdi\n"
+    "    cld\n"
+    "    call interrupt_dispatch\n"
+    "    fxrstor (%rsp)\n"
+    "    mov %rbx, %rsp\n"
+    "    pop %r15\n    pop %r14\n    pop %r13\n    pop %r12\n"
+    "    pop %r11\n    pop %r10\n    pop %r9\n    pop %r8\n"
+    "    pop %rdi\n    pop %rsi\n    pop %rbp\n    pop %rbx\n"
+    "    pop %rdx\n    pop %rcx\n    pop %rax\n"
+    "    add $16, %rsp\n"
+    "    iretq\n"
+#else
+    "    pusha\n"
+    "    mov %esp, %eax\n"
+    "    push %eax\n"
+    "    cld\n"
+    "    call interrupt_dispatch\n"
+    "    add $4, %esp\n"
+    "    popa\n"
+    "    add $8, %esp\n"
+    "    iret\n"
+#endif
+    ".popsection\n"
+);
+
+extern char isr_stubs[];
+
+static void idt_set_gate(int vector, uintptr_t handler, uint16_t selector, uint8_t type) {
+    idt_entry_t* e = &idt[vector];
+    e->offset_low = handler & 0xFFFF;
+    e->selector = selector;
+    e->type = type;
+#ifdef __x86_64__
+    e->ist = 0;
+    e->offset_mid = (handler >> 16) & 0xFFFF;
+    e->offset_high = (uint32_t)(handler >> 32);
+    e->reserved = 0;
+#else
+    e->zero = 0;
+    e->offset_high = (handler >> 16) & 0xFFFF;
+#endif
+}
+
+/* Remap the PICs to IRQ_BASE..IRQ_BASE+15 */
+static void pic_remap(void) {
+    outb(PIC1_CMD, ICW1_INIT);
+    io_wait();
+    outb(PIC2_CMD, ICW1_INIT);
+    io_wait();
+    outb(PIC1_DATA, IRQ_BASE);
+    io_wait();
+    outb(PIC2_DATA, IRQ_BASE + 8);
+    io_wait();
+    outb(PIC1_DATA, 1 << IRQ_CASCADE);  /* slave on IRQ2 */
+    io_wait();
+    outb(PIC2_DATA, 2);                 /* slave identity */
+    io_wait();
+    outb(PIC1_DATA, ICW4_8086);
+    io_wait();
+    outb(PIC2_DATA, ICW4_8086);
+    io_wait();
+    
+    outb(PIC1_DATA, pic_masks[0]);
+    outb(PIC2_DATA, pic_masks[1]);
+}
+
+/* ==== GDT and TSS ==== */
+
+static uint64_t tss_descriptor(uintptr_t base) {
+    uint64_t limit = sizeof(tss_t) - 1;
+    return (limit & 0xFFFF) | ((uint64_t)(base & 0xFFFFFF) << 16) |
+           ((uint64_t)TSS_TYPE << 40) | (((limit >> 16) & 0xF) << 48) |
+           ((uint64_t)((base >> 24) & 0xFF) << 56);
+}
+
+#ifndef __x86_64__
+/* The double fault task starts here, on df_stack with the error code
+ * pushed. The faulting state is in tss, where the task switch saved it. */
+static void double_fault_task(void) {
+    interrupt_frame_t frame = {
+        .edi = tss.edi, .esi = tss.esi, .ebp = tss.ebp,
+        .esp = tss.esp - 5 * sizeof(uint32_t),     /* as pusha would have seen it */
+        .ebx = tss.ebx, .edx = tss.edx, .ecx = tss.ecx, .eax = tss.eax,
+        .vector = VECTOR_DF, .error = 0,
+        .eip = tss.eip, .cs = tss.cs, .eflags = tss.eflags
+    };
+    crash_exception(&frame);
+}
+
+static inline uintptr_t read_cr3(void) {
+    uintptr_t v;
+    __asm__ volatile ("mov %%cr3, %0" : "=r"(v));
+    return v;
+}
+#endif
+
+/* Our own flat GDT (the bootloader's may be anywhere), with the TSS */
+static void gdt_init(void) {
+    uintptr_t df_stack_top = (uintptr_t)df_stack + DF_STACK_SIZE;
+    
+    gdt[0] = 0;
+    gdt[SEL_DATA / 8] = SEG_DATA;
+    gdt[SEL_TSS / 8] = tss_descriptor((uintptr_t)&tss);
+    tss.iomap = sizeof(tss_t);      /* no I/O bitmap */
+#ifdef __x86_64__
+    gdt[SEL_CODE / 8] = SEG_CODE64;
+    gdt[SEL_TSS / 8 + 1] = (uint64_t)(uintptr_t)&tss >> 32;
+    tss.ist[0] = df_stack_top;
+#else
+    gdt[SEL_CODE / 8] = SEG_CODE;
+    gdt[SEL_DF_TSS / 8] = tss_descriptor((uintptr_t)&df_tss);
+    df_tss.iomap = sizeof(tss_t);
+    df_tss.cr3 = read_cr3();        /* paging_init has run */
+    df_tss.eip = (uintptr_t)double_fault_task;
+    df_tss.eflags = 0x2;            /* interrupts off */
+    df_tss.esp = df_stack_top;
+    df_tss.cs = SEL_CODE;
+    df_tss.ds = df_tss.es = df_tss.fs = df_tss.gs = df_tss.ss = SEL_DATA;
+#endif
+    
+    idt_ptr_t gdtr = { sizeof(gdt) - 1, (uintptr_t)gdt };
+    __asm__ volatile ("lgdt %0" : : "m"(gdtr));
+#ifdef __x86_64__
+    __asm__ volatile (
+        "pushq $" STR(SEL_CODE) "\n"
+        "lea 1f(%%rip), %%rax\n"
+        "pushq %%rax\n"
+        "lretq\n"
+        "1:\n"
+        : : : "rax", "memory");
+#else
+    __asm__ volatile ("ljmp $" STR(SEL_CODE) ", $1f\n1:\n" : : : "memory");
+#endif
+    __asm__ volatile (
+        "mov %w0, %%ds\n"
+        "mov %w0, %%es\n"
+        "mov %w0, %%fs\n"
+        "mov %w0, %%gs\n"
+        "mov %w0, %%ss\n"
+        : : "r"((uint32_t)SEL_DATA));
+    __asm__ volatile ("ltr %w0" : : "r"((uint32_t)SEL_TSS));
+}
+
+/* ==== IDT and PIC ==== */
+
+void interrupts_init(void) {
+    gdt_init();
+    
+    for (int i = 0; i < NUM_STUBS; i++) {
+        idt_set_gate(i, (uintptr_t)isr_stubs + i * 16, SEL_CODE, GATE_INTERRUPT);
+    }
+#ifdef __x86_64__
+    idt[VECTOR_DF].ist = 1;
+#else
+    idt_set_gate(VECTOR_DF, 0, SEL_DF_TSS, GATE_TASK);
+#endif
+    
+    idt_ptr_t idtr = { sizeof(idt) - 1, (uintptr_t)idt };
+    __asm__ volatile ("lidt %0" : : "m"(idtr));
+    
+    pic_remap();
+}
+
+void irq_install(int irq, void (*handler)(void)) {
+    if (irq < 0 || irq >= 16) return;
+    irq_handlers[irq] = handler;
+    
+    if (irq >= 8) {
+        pic_masks[1] &= ~(1 << (irq - 8));
+        pic_masks[0] &= ~(1 << IRQ_CASCADE);
+        outb(PIC2_DATA, pic_masks[1]);
+    } else {
+        pic_masks[0] &= ~(1 << irq);
+    }
+    outb(PIC1_DATA, pic_masks[0]);
+}
+
+uint32_t irq_get_count(int irq) {
+    return (irq >= 0 && irq < 16) ? irq_counts[irq] : 0;
+}
+
+/* IRQ 7 and 15 also fire spuriously; then the PIC shows nothing in service */
+static int irq_spurious(int irq) {
+    if (irq != 7 && irq != 15) return 0;
+    uint16_t port = (irq == 7) ? PIC1_CMD : PIC2_CMD;
+    outb(port, PIC_READ_ISR);
+    if (inb(port) & 0x80) return 0;
+    if (irq == 15) outb(PIC1_CMD, PIC_EOI);  /* the master did see the cascade */
+    return 1;
+}
+
+void interrupt_dispatch(interrupt_frame_t* frame) {
+    if (frame->vector < IRQ_BASE) crash_exception(frame);
+    
+    int irq = (int)frame->vector - IRQ_BASE;
+    if (irq < 0 || irq >= 16 || irq_spurious(irq)) return;
+    
+    irq_counts[irq]++;
+    if (irq_handlers[irq]) irq_handlers[irq]();
+    
+    if (irq >= 8) outb(PIC2_CMD, PIC_EOI);
+    outb(PIC1_CMD, PIC_EOI);
+}
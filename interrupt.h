@@ -0,0 +1,43 @@
+/*
+ * interrupt.h - IDT, 8259 PIC and IRQ handlers for GegOS
+ */
+
+#ifndef INTERRUPT_H
+#define INTERRUPT_H
+
+#include <stdint.h>
+
+/* IRQ lines */
+#define IRQ_TIMER     0
+#define IRQ_KEYBOARD  1
+#define IRQ_CASCADE   2
+#define IRQ_MOUSE     12
+
+/* The PICs are remapped above the CPU exceptions */
+#define IRQ_BASE      32
+
+/* Registers saved by the interrupt stubs, lowest address first */
+typedef struct {
+#ifdef __x86_64__
+    uint64_t r15, r14, r13, r12, r11, r10, r9, r8;
+    uint64_t rdi, rsi, rbp, rbx, rdx, rcx, rax;
+    uint64_t vector, error;
+    uint64_t rip, cs, rflags, rsp, ss;
+#else
+    uint32_t edi, esi, ebp, esp, ebx, edx, ecx, eax;   /* pusha */
+    uint32_t vector, error;
+    uint32_t eip, cs, eflags;
+#endif
+} interrupt_frame_t;
+
+/* Load the IDT and remap the PICs with every IRQ masked.
+ * Interrupts stay off until sti(). */
+void interrupts_init(void);
+
+/* Call handler on an IRQ (in interrupt context) and unmask the line */
+void irq_install(int irq, void (*handler)(void));
+
+/* Interrupts taken on an IRQ line since boot */
+uint32_t irq_get_count(int irq);
+
+#endif /* INTERRUPT_H */
@@ -32,24 +32,60 @@ static inline uint16_t inw(uint16_t port) {
     return value;
 }
 
+/* Output a dword to a port */
+static inline void outl(uint16_t port, uint32_t value) {
+    __asm__ volatile ("outl %0, %1" : : "a"(value), "Nd"(port));
+}
+
+/* Input a dword from a port */
+static inline uint32_t inl(uint16_t port) {
+    uint32_t value;
+    __asm__ volatile ("inl %1, %0" : "=a"(value) : "Nd"(port));
+    return value;
+}
+
 /* I/O wait (small delay) */
 static inline void io_wait(void) {
     outb(0x80, 0);
 }
 
-/* Enable interrupts */
+/* Enable interrupts. cli/sti/hlt are also compiler barriers, so memory
+ * accesses stay on the side of them they were written on. */
 static inline void sti(void) {
-    __asm__ volatile ("sti");
+    __asm__ volatile ("sti" : : : "memory");
 }
 
 /* Disable interrupts */
 static inline void cli(void) {
-    __asm__ volatile ("cli");
+    __asm__ volatile ("cli" : : : "memory");
+}
+
+/* Interrupt flag set? */
+static inline int interrupts_enabled(void) {
+    unsigned long flags;
+    __asm__ volatile ("pushf; pop %0" : "=r"(flags));
+    return (flags & 0x200) != 0;
 }
 
 /* Halt CPU */
 static inline void hlt(void) {
-    __asm__ volatile ("hlt");
+    __asm__ volatile ("hlt" : : : "memory");
+}
+
+/* CPU identification */
+static inline void cpuid(uint32_t leaf, uint32_t* eax, uint32_t* ebx, uint32_t* ecx, uint32_t* edx) {
+    __asm__ volatile ("cpuid" : "=a"(*eax), "=b"(*ebx), "=c"(*ecx), "=d"(*edx) : "a"(leaf), "c"(0));
+}
+
+/* Model specific registers */
+static inline uint64_t rdmsr(uint32_t msr) {
+    uint32_t lo, hi;
+    __asm__ volatile ("rdmsr" : "=a"(lo), "=d"(hi) : "c"(msr));
+    return ((uint64_t)hi << 32) | lo;
+}
+
+static inline void wrmsr(uint32_t msr, uint64_t value) {
+    __asm__ volatile ("wrmsr" : : "c"(msr), "a"((uint32_t)value), "d"((uint32_t)(value >> 32)));
 }
 
 #endif /* IO_H */
@@ -13,6 +13,15 @@
 #include "apps.h"
 #include "network.h"
 #include "wifi.h"
+#include "event.h"
+#include "interrupt.h"
+#include "timer.h"
+#include "clock.h"
+#include "pmm.h"
+#include "arena.h"
+#include "paging.h"
+#include "serial.h"
+#include "trace.h"
 
 /* Multiboot 2 structures for framebuffer support */
 typedef struct {
@@ -37,72 +46,125 @@ typedef struct {
     uint16_t reserved;
 } multiboot2_framebuffer_tag_t;
 
-/* Global framebuffer information - unused in 32-bit kernel */
-/*
-static uint64_t fb_addr = 0;
-static uint32_t fb_pitch = 0;
-static uint32_t fb_width = 0;
-static uint32_t fb_height = 0;
-static uint8_t fb_bpp = 0;
-*/
+typedef struct {
+    uint32_t type;        // 6
+    uint32_t size;
+    uint32_t entry_size;
+    uint32_t entry_version;
+} multiboot2_mmap_tag_t;
 
-/* Parse Multiboot 2 information structure - commented out for 32-bit kernel */
-/*
+typedef struct {
+    uint64_t base_addr;
+    uint64_t length;
+    uint32_t type;
+    uint32_t reserved;
+} multiboot2_mmap_entry_t;
+
+typedef struct {
+    uint32_t type;        // 4
+    uint32_t size;
+    uint32_t mem_lower;   // KB below 1 MB
+    uint32_t mem_upper;   // KB above 1 MB
+} multiboot2_meminfo_tag_t;
+
+/* Multiboot 1 magic and info fields used here */
+#define MULTIBOOT1_MAGIC     0x2BADB002
+#define MULTIBOOT2_MAGIC     0x36D76289
+#define MB1_FLAG_MEMORY      (1 << 0)
+#define MB1_FLAG_MMAP        (1 << 6)
+#define MB1_FLAG_FRAMEBUFFER (1 << 12)
+
+/* Bootloader memory map, handed to the PMM */
+#define MAX_MEM_REGIONS 32
+static mem_region_t mem_map[MAX_MEM_REGIONS];
+static int mem_map_count = 0;
+
+/* Bootloader framebuffer, kept out of the PMM's hands */
+static uint64_t boot_fb_addr = 0;
+static uint64_t boot_fb_size = 0;
+
+static void add_mem_region(uint64_t base, uint64_t length, uint32_t type) {
+    if (mem_map_count == MAX_MEM_REGIONS || !length) return;
+    mem_map[mem_map_count].base = base;
+    mem_map[mem_map_count].length = length;
+    mem_map[mem_map_count].type = type;
+    mem_map_count++;
+}
+
+static void set_boot_framebuffer(uint64_t addr, uint32_t pitch, uint32_t width,
+                                 uint32_t height, uint8_t bpp) {
+    if (vga_set_framebuffer(addr, pitch, width, height, bpp)) {
+        boot_fb_addr = addr;
+        boot_fb_size = (uint64_t)pitch * height;
+    }
+}
+
+/* Framebuffer type 1 = direct RGB (0 is indexed, 2 is EGA text) */
+#define FB_TYPE_RGB 1
+
+/* Parse Multiboot 2 information structure for the memory map and a framebuffer tag */
 static void parse_multiboot2_info(uint32_t* mb_info) {
     multiboot2_info_header_t* header = (multiboot2_info_header_t*)mb_info;
     uint32_t total_size = header->total_size;
+    multiboot2_meminfo_tag_t* meminfo = 0;
     
     uint32_t offset = 8; // Skip header
     while (offset < total_size) {
         multiboot2_tag_header_t* tag = (multiboot2_tag_header_t*)((uint8_t*)mb_info + offset);
-        
+    
         if (tag->type == 8) { // Framebuffer tag
             multiboot2_framebuffer_tag_t* fb_tag = (multiboot2_framebuffer_tag_t*)tag;
-            fb_addr = fb_tag->framebuffer_addr;
-            fb_pitch = fb_tag->framebuffer_pitch;
-            fb_width = fb_tag->framebuffer_width;
-            fb_height = fb_tag->framebuffer_height;
-            fb_bpp = fb_tag->framebuffer_bpp;
+            if (fb_tag->framebuffer_type == FB_TYPE_RGB) {
+                set_boot_framebuffer(fb_tag->framebuffer_addr, fb_tag->framebuffer_pitch,
+                                     fb_tag->framebuffer_width, fb_tag->framebuffer_height,
+                                     fb_tag->framebuffer_bpp);
+            }
+        } else if (tag->type == 6) { // Memory map tag
+            multiboot2_mmap_tag_t* mmap = (multiboot2_mmap_tag_t*)tag;
+            uint8_t* entry = (uint8_t*)(mmap + 1);
+            uint8_t* end = (uint8_t*)tag + tag->size;
+            for (; mmap->entry_size && entry < end; entry += mmap->entry_size) {
+                multiboot2_mmap_entry_t* e = (multiboot2_mmap_entry_t*)entry;
+                add_mem_region(e->base_addr, e->length, e->type);
+            }
+        } else if (tag->type == 4) { // Basic memory info tag
+            meminfo = (multiboot2_meminfo_tag_t*)tag;
         } else if (tag->type == 0) { // End tag
             break;
         }
-        
+    
         offset += (tag->size + 7) & ~7;
     }
+    
+    /* No map: only the size of the memory above 1 MB */
+    if (!mem_map_count && meminfo) {
+        add_mem_region(0x100000, (uint64_t)meminfo->mem_upper * 1024, MEM_USABLE);
+    }
 }
-*/
-
-/* External app window getters */
-extern int get_browser_win(void);
-extern int get_wifi_win(void);
-extern int get_files_win(void);
-extern int get_notepad_win(void);
-extern int get_terminal_win(void);
-extern int get_calc_win(void);
-extern int get_about_win(void);
-extern int get_settings_win(void);
 
-/* External app content drawers */
-extern void browser_draw_content(gui_window_t* win);
-extern void wifi_draw_content(gui_window_t* win);
-extern void files_draw_content(gui_window_t* win);
-extern void notepad_draw_content(gui_window_t* win);
-extern void terminal_draw_content(gui_window_t* win);
-extern void calc_draw_content(gui_window_t* win);
-extern void about_draw_content(gui_window_t* win);
-extern void settings_draw_content(gui_window_t* win);
-
-/* External app input handlers */
-extern void browser_handle_key(char key);
-extern void wifi_handle_key(char key);
-extern void wifi_handle_click(int x, int y);
-extern void files_handle_key(char key);
-extern void files_handle_click(gui_window_t* win, int mx, int my);
-extern void notepad_handle_key(char key);
-extern void terminal_key_handler(char key);
-extern void calc_handle_key(char key);
-extern void calc_handle_click(gui_window_t* win, int mx, int my);
-extern void settings_handle_click(gui_window_t* win, int mx, int my);
+/* Parse Multiboot 1 information (memory map at byte 44, framebuffer at 88) */
+static void parse_multiboot1_info(uint32_t* mb_info) {
+    uint32_t flags = mb_info[0];
+    uint8_t* info = (uint8_t*)mb_info;
+    
+    if (flags & MB1_FLAG_MMAP) {
+        uint8_t* entry = (uint8_t*)(uintptr_t)*(uint32_t*)(info + 48);
+        uint8_t* end = entry + *(uint32_t*)(info + 44);
+        while (entry < end) {
+            /* The size field does not count itself */
+            add_mem_region(*(uint64_t*)(entry + 4), *(uint64_t*)(entry + 12),
+                           *(uint32_t*)(entry + 20));
+            entry += *(uint32_t*)entry + 4;
+        }
+    } else if (flags & MB1_FLAG_MEMORY) {
+        add_mem_region(0x100000, (uint64_t)*(uint32_t*)(info + 8) * 1024, MEM_USABLE);
+    }
+    
+    if (!(flags & MB1_FLAG_FRAMEBUFFER)) return;
+    if (info[109] != FB_TYPE_RGB) return;
+    set_boot_framebuffer(*(uint64_t*)(info + 88), *(uint32_t*)(info + 96),
+                         *(uint32_t*)(info + 100), *(uint32_t*)(info + 104), info[108]);
+}
 
 /* Game functions */
 extern void pong_run(void);
@@ -132,17 +194,23 @@ static int lock_screen_drawn = 0;
 /* Shutdown state */
 static int shutdown_initiated = 0;
 
+/* Main loop timing, listed by the terminal's perf command */
+static clock_stat_t render_stat = CLOCK_STAT("render");
+static clock_stat_t present_stat = CLOCK_STAT("present");
+static clock_stat_t input_stat = CLOCK_STAT("input");
+static clock_stat_t drag_stat = CLOCK_STAT("drag");     /* move to present */
+
 /* Desktop icon positions */
 
 /* Icon click handlers */
-static void click_wifi(void) { app_wifi(); needs_redraw = 1; }
-static void click_browser(void) { app_browser(); needs_redraw = 1; }
-static void click_files(void) { app_files(); needs_redraw = 1; }
-static void click_notepad(void) { app_notepad(); needs_redraw = 1; }
-static void click_terminal(void) { app_terminal(); needs_redraw = 1; }
-static void click_calc(void) { app_calculator(); needs_redraw = 1; }
-static void click_settings(void) { app_settings(); needs_redraw = 1; }
-static void click_about(void) { app_about(); needs_redraw = 1; }
+static void click_wifi(void) { app_wifi(); }
+static void click_browser(void) { app_browser(); }
+static void click_files(void) { app_files(); }
+static void click_notepad(void) { app_notepad(); }
+static void click_terminal(void) { app_terminal(); }
+static void click_calc(void) { app_calculator(); }
+static void click_settings(void) { app_settings(); }
+static void click_about(void) { app_about(); }
 
 static desktop_icon_t desktop_icons[] = {
     {20, 40, "Potato", click_browser},
@@ -167,28 +235,36 @@ static uint8_t get_desktop_color(void) {
     }
 }
 
-/* Forward declarations */
-static void redraw_start_menu_area(void);
+/* Start menu geometry */
+#define START_MENU_X 2
+#define START_MENU_W 150
+#define START_MENU_H 160
+
+/* The start menu opened, closed or changed */
+static void damage_start_menu(void) {
+    gui_add_dirty_rect(START_MENU_X, SCREEN_HEIGHT - TASKBAR_HEIGHT - START_MENU_H,
+                       START_MENU_W, START_MENU_H);
+}
 
 /* Draw desktop icons */
-static void draw_desktop_icons(void) __attribute__((unused));
 static void draw_desktop_icons(void) {
     for (int i = 0; desktop_icons[i].label; i++) {
         int x = desktop_icons[i].x;
         int y = desktop_icons[i].y;
-        
+        if (!vga_clip_visible(x, y, 48, 32)) continue;
+    
         /* Icon box */
         vga_fillrect(x, y, 48, 32, COLOR_WHITE);
         vga_rect(x, y, 48, 32, COLOR_BLACK);
         /* Icon symbol */
         vga_fillrect(x + 14, y + 4, 20, 16, COLOR_BLUE);
-        
+    
         /* Label */
         int label_len = 0;
         const char* s = desktop_icons[i].label;
         while (*s++) label_len++;
         int lx = x + (48 - label_len * 8) / 2;
-        
+    
         vga_putstring(lx, y + 23, desktop_icons[i].label, COLOR_BLACK, COLOR_WHITE);
     }
 }
@@ -206,7 +282,7 @@ static int handle_start_menu_click(int mx, int my) {
         my >= start_y && my < start_y + start_h) {
         /* Toggle start menu */
         start_menu_open = !start_menu_open;
-        redraw_start_menu_area();  /* Only redraw menu area */
+        damage_start_menu();  /* Only the menu area changes */
         return 1;
     }
     
@@ -217,37 +293,29 @@ static int handle_start_menu_click(int mx, int my) {
         int menu_y = taskbar_y - 160;
         int menu_w = 150;
         int item_h = 28;
-        
+    
         /* Check for menu item clicks */
         if (mx >= menu_x && mx < menu_x + menu_w && my >= menu_y) {
             int item = (my - menu_y - 8) / item_h;
-            
+    
             /* Menu items: Programs (0), Files (1), Settings (2), Lock (3), Shutdown (4) */
             if (item == 0) {
                 /* Programs - open file browser for now */
-                get_files_win();
+                app_files();
                 start_menu_open = 0;
-                needs_redraw = 1;
+                damage_start_menu();
                 return 1;
             } else if (item == 1) {
                 /* Files */
-                gui_window_t* win = gui_get_window(get_files_win());
-                if (win) {
-                    win->visible = 1;
-                    win->active = 1;
-                }
+                app_files();
                 start_menu_open = 0;
-                needs_redraw = 1;
+                damage_start_menu();
                 return 1;
             } else if (item == 2) {
                 /* Settings */
-                gui_window_t* win = gui_get_window(get_settings_win());
-                if (win) {
-                    win->visible = 1;
-                    win->active = 1;
-                }
+                app_settings();
                 start_menu_open = 0;
-                needs_redraw = 1;
+                damage_start_menu();
                 return 1;
             } else if (item == 3) {
                 /* Lock screen */
@@ -266,433 +334,73 @@ static int handle_start_menu_click(int mx, int my) {
                 return 1;
             }
         }
-        /* Click outside menu closes it */
+        /* Click outside menu closes it (and still goes to what is there) */
         start_menu_open = 0;
-        redraw_start_menu_area();  /* Only redraw menu area */
-        return 1;
+        damage_start_menu();  /* Only the menu area changes */
+        return 0;
     }
     
     return 0;
 }
 
-static int check_icon_click(int mx, int my) {
-    for (int i = 0; desktop_icons[i].label; i++) {
-        int x = desktop_icons[i].x;
-        int y = desktop_icons[i].y;
-        
-        if (mx >= x && mx < x + 48 && my >= y && my < y + 32) {
-            if (desktop_icons[i].action) {
-                desktop_icons[i].action();
-                return 1;
-            }
-        }
-    }
-    return 0;
-}
-
-/* Draw app content based on window */
-static void draw_app_contents(void) {
-    gui_window_t* win;
-    
-    win = gui_get_window(get_browser_win());
-    if (win && win->visible) browser_draw_content(win);
-    
-    win = gui_get_window(get_wifi_win());
-    if (win && win->visible) wifi_draw_content(win);
-    
-    win = gui_get_window(get_files_win());
-    if (win && win->visible) files_draw_content(win);
-    
-    win = gui_get_window(get_notepad_win());
-    if (win && win->visible) notepad_draw_content(win);
-    
-    win = gui_get_window(get_terminal_win());
-    if (win && win->visible) terminal_draw_content(win);
-    
-    win = gui_get_window(get_calc_win());
-    if (win && win->visible) calc_draw_content(win);
-    
-    win = gui_get_window(get_settings_win());
-    if (win && win->visible) settings_draw_content(win);
+/* After a resolution change: fit the mouse and windows to the new screen */
+static void screen_size_changed(void) {
+    mouse_set_bounds(0, 0, SCREEN_WIDTH - 1, SCREEN_HEIGHT - 1);
+    int cx = mouse_get_x(), cy = mouse_get_y();
+    if (cx >= SCREEN_WIDTH) cx = SCREEN_WIDTH - 1;
+    if (cy >= SCREEN_HEIGHT) cy = SCREEN_HEIGHT - 1;
+    mouse_set_position(cx, cy);
     
-    win = gui_get_window(get_about_win());
-    if (win && win->visible) about_draw_content(win);
-}
-
-/* Handle keyboard for active app */
-static void handle_app_keyboard(char key, int mx, int my) {
-    gui_window_t* win;
-    
-    /* Erase cursor before any drawing */
-    gui_erase_cursor();
-    
-    win = gui_get_window(get_wifi_win());
-    if (win && win->visible && win->active) {
-        wifi_handle_key(key);
-        wifi_draw_content(win);
-        gui_cursor_invalidate();
-        gui_draw_cursor(mx, my);
-        return;
-    }
-    
-    win = gui_get_window(get_browser_win());
-    if (win && win->visible && win->active) {
-        browser_handle_key(key);
-        browser_draw_content(win);
-        gui_cursor_invalidate();
-        gui_draw_cursor(mx, my);
-        return;
-    }
-    
-    win = gui_get_window(get_files_win());
-    if (win && win->visible && win->active) {
-        files_handle_key(key);
-        files_draw_content(win);
-        gui_cursor_invalidate();
-        gui_draw_cursor(mx, my);
-        return;
-    }
-    
-    win = gui_get_window(get_notepad_win());
-    if (win && win->visible && win->active) {
-        notepad_handle_key(key);
-        notepad_draw_content(win);
-        gui_cursor_invalidate();
-        gui_draw_cursor(mx, my);
-        return;
-    }
-    
-    win = gui_get_window(get_terminal_win());
-    if (win && win->visible && win->active) {
-        terminal_key_handler(key);
-        terminal_draw_content(win);
-        gui_cursor_invalidate();
-        gui_draw_cursor(mx, my);
-        return;
-    }
-    
-    win = gui_get_window(get_calc_win());
-    if (win && win->visible && win->active) {
-        calc_handle_key(key);
-        calc_draw_content(win);
-        gui_cursor_invalidate();
-        gui_draw_cursor(mx, my);
-        return;
-    }
-}
-
-/* Handle mouse click for active app */
-static int handle_app_click(int mx, int my) {
-    gui_window_t* win;
-    
-    /* Erase cursor before any drawing */
-    gui_erase_cursor();
-    
-    win = gui_get_window(get_files_win());
-    if (win && win->visible && win->active) {
-        if (mx >= win->x && mx < win->x + win->width &&
-            my >= win->y + 16 && my < win->y + win->height) {
-            files_handle_click(win, mx, my);
-            files_draw_content(win);
-            gui_cursor_invalidate();
-            gui_draw_cursor(mx, my);
-            return 1;
-        }
-    }
-    
-    win = gui_get_window(get_calc_win());
-    if (win && win->visible && win->active) {
-        if (mx >= win->x && mx < win->x + win->width &&
-            my >= win->y + 16 && my < win->y + win->height) {
-            calc_handle_click(win, mx, my);
-            calc_draw_content(win);
-            gui_cursor_invalidate();
-            gui_draw_cursor(mx, my);
-            return 1;
-        }
+    for (int i = 0; i < gui_window_slots(); i++) {
+        gui_window_t* win = gui_get_window(i);
+        if (!win) continue;
+        int x = win->x, y = win->y;
+        if (x + win->width > SCREEN_WIDTH) x = SCREEN_WIDTH - win->width;
+        if (y + win->height > SCREEN_HEIGHT - TASKBAR_HEIGHT)
+            y = SCREEN_HEIGHT - TASKBAR_HEIGHT - win->height;
+        if (x < 0) x = 0;
+        if (y < 0) y = 0;
+        gui_move_window(i, x, y);
     }
     
-    win = gui_get_window(get_settings_win());
-    if (win && win->visible && win->active) {
-        if (mx >= win->x && mx < win->x + win->width &&
-            my >= win->y + 16 && my < win->y + win->height) {
-            settings_handle_click(win, mx, my);
-            settings_draw_content(win);
-            gui_cursor_invalidate();
-            gui_draw_cursor(mx, my);
-            return 1;
-        }
-    }
-    return 0;
+    needs_redraw = 1;
 }
 
-/* Draw everything - optimized partial redraws */
-static void full_redraw(void) __attribute__((unused));
-static void full_redraw(void) {
-    /* Erase cursor properly before redrawing */
-    gui_erase_cursor();
-
-    /* Wait for vsync before drawing to reduce tearing */
-    vga_vsync();
-
-    /* Only redraw desktop if needed - for now we redraw everything */
-    /* TODO: Implement dirty rectangles for partial redraws */
+/* Everything under the windows: desktop, icons and taskbar */
+static void paint_desktop(void) {
     vga_fillrect(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT - TASKBAR_HEIGHT, get_desktop_color());
-
-    /* Draw desktop icons */
-    for (int i = 0; desktop_icons[i].label; i++) {
-        int ix = desktop_icons[i].x;
-        int iy = desktop_icons[i].y;
-
-        /* Icon box */
-        vga_fillrect(ix, iy, 48, 32, COLOR_WHITE);
-        vga_rect(ix, iy, 48, 32, COLOR_BLACK);
-        /* Icon symbol */
-        vga_fillrect(ix + 14, iy + 4, 20, 16, COLOR_BLUE);
-
-        /* Label */
-        int label_len = 0;
-        const char* s = desktop_icons[i].label;
-        while (*s++) label_len++;
-        int lx = ix + (48 - label_len * 8) / 2;
-        vga_putstring(lx, iy + 23, desktop_icons[i].label, COLOR_BLACK, COLOR_WHITE);
-    }
-
-    /* Draw taskbar */
-    gui_draw_menubar();
-
-    /* Draw start menu if open */
-    if (start_menu_open) {
-        int taskbar_y = SCREEN_HEIGHT - TASKBAR_HEIGHT;
-        int menu_x = 2;
-        int menu_y = taskbar_y - 120;
-        int menu_w = 140;
-        int menu_h = 120;
-        int item_h = 20;
-
-        /* Menu background with border */
-        vga_fillrect(menu_x, menu_y, menu_w, menu_h, COLOR_LIGHT_GRAY);
-        vga_rect(menu_x, menu_y, menu_w, menu_h, COLOR_BLACK);
-
-        /* Menu items: Programs, Files, Settings, Shutdown */
-        const char* menu_items[] = {"Programs", "Files", "Settings", "Shutdown", 0};
-        for (int i = 0; menu_items[i]; i++) {
-            int item_y = menu_y + i * item_h;
-            vga_putstring(menu_x + 8, item_y + 6, menu_items[i], COLOR_BLACK, COLOR_LIGHT_GRAY);
-            /* Separator line */
-            if (i == 2) {
-                vga_hline(menu_x + 2, item_y + item_h - 2, menu_w - 4, COLOR_LIGHT_GRAY);
-            }
-        }
+    draw_desktop_icons();
+    if (vga_clip_visible(0, SCREEN_HEIGHT - TASKBAR_HEIGHT, SCREEN_WIDTH, TASKBAR_HEIGHT)) {
+        gui_draw_menubar();
     }
-
-    /* Draw windows */
-    gui_draw();
-
-    /* Draw app contents inside windows */
-    draw_app_contents();
-
-    /* Invalidate cursor backup since screen changed */
-    gui_cursor_invalidate();
 }
-
-/* Redraw only the start menu area */
-static void redraw_start_menu_area(void) {
-    gui_erase_cursor();
     
-    int taskbar_y = SCREEN_HEIGHT - TASKBAR_HEIGHT;
-    int menu_x = 2;
-    int menu_y = taskbar_y - 160;
-    int menu_w = 150;
-    int menu_h = 160;
+/* Start menu, drawn over the windows while open */
+static void paint_start_menu(void) {
+    if (!start_menu_open) return;
     
-    if (start_menu_open) {
-        /* Draw menu with better spacing */
-        int item_h = 28;
-        vga_fillrect(menu_x, menu_y, menu_w, menu_h, COLOR_LIGHT_GRAY);
-        vga_rect(menu_x, menu_y, menu_w, menu_h, COLOR_BLACK);
-        
-        /* 3D border effect */
-        vga_hline(menu_x + 1, menu_y + 1, menu_w - 2, COLOR_WHITE);
-        vga_vline(menu_x + 1, menu_y + 1, menu_h - 2, COLOR_WHITE);
-        vga_hline(menu_x + 1, menu_y + menu_h - 2, menu_w - 2, COLOR_DARK_GRAY);
-        vga_vline(menu_x + menu_w - 2, menu_y + 1, menu_h - 2, COLOR_DARK_GRAY);
-        
-        const char* menu_items[] = {"Programs", "Files", "Settings", "Lock", "Shutdown", 0};
-        for (int i = 0; menu_items[i]; i++) {
-            int item_y = menu_y + 8 + i * item_h;
-            vga_putstring(menu_x + 12, item_y + 6, menu_items[i], COLOR_BLACK, COLOR_LIGHT_GRAY);
-        }
-    } else {
-        /* Erase menu area - redraw desktop portion */
-        vga_fillrect(menu_x, menu_y, menu_w, menu_h, get_desktop_color());
-        /* Redraw any icons that might be there */
-        for (int i = 0; desktop_icons[i].label; i++) {
-            int ix = desktop_icons[i].x;
-            int iy = desktop_icons[i].y;
-            /* Check if icon overlaps menu area */
-            if (ix < menu_x + menu_w && ix + 48 > menu_x &&
-                iy < menu_y + menu_h && iy + 40 > menu_y) {
-                vga_fillrect(ix, iy, 48, 32, COLOR_WHITE);
-                vga_rect(ix, iy, 48, 32, COLOR_BLACK);
-                vga_fillrect(ix + 14, iy + 4, 20, 16, COLOR_BLUE);
-                int label_len = 0;
-                const char* s = desktop_icons[i].label;
-                while (*s++) label_len++;
-                int lx = ix + (48 - label_len * 8) / 2;
-                vga_putstring(lx, iy + 23, desktop_icons[i].label, COLOR_BLACK, COLOR_WHITE);
-            }
-        }
-    }
+    int menu_x = START_MENU_X;
+    int menu_y = SCREEN_HEIGHT - TASKBAR_HEIGHT - START_MENU_H;
+    int menu_w = START_MENU_W;
+    int menu_h = START_MENU_H;
+    int item_h = 28;
     
-    gui_cursor_invalidate();;
-}
-
-/* Redraw the area around a cursor position (12x16 pixel area) */
-void redraw_cursor_area_kernel(int x, int y) {
-    /* Calculate cursor-sized redraw rectangle: 12x16 pixels */
-    int left = x;
-    int top = y;
-    int width = 12;
-    int height = 16;
-
-    /* Clamp to screen bounds */
-    if (left < 0) {
-        width += left;
-        left = 0;
-    }
-    if (top < 0) {
-        height += top;
-        top = 0;
-    }
-    if (left + width > SCREEN_WIDTH) {
-        width = SCREEN_WIDTH - left;
-    }
-    if (top + height > SCREEN_HEIGHT) {
-        height = SCREEN_HEIGHT - top;
-    }
-
-    if (width <= 0 || height <= 0) return;
-
-    /* Check if cursor area intersects with taskbar - redraw taskbar portion */
-    int taskbar_y = SCREEN_HEIGHT - TASKBAR_HEIGHT;
-    if (top + height > taskbar_y) {
-        /* Redraw taskbar */
-        gui_draw_menubar();
-        return;
-    }
-
-    /* Check if cursor area intersects with any window */
-    for (int i = 0; i < 16; i++) {
-        gui_window_t* win = gui_get_window(i);
-        if (!win || !win->visible) continue;
-
-        if (win->x < left + width && win->x + win->width > left &&
-            win->y < top + height && win->y + win->height > top) {
-            /* Instead of redrawing entire window, just redraw the cursor area within the window */
-            /* Draw window background color in cursor area */
-            vga_fillrect(left, top, width, height, COLOR_LIGHT_GRAY);
-            
-            /* Draw window border if cursor area touches it */
-            if (left <= win->x + win->width - 1 && left + width > win->x &&
-                top <= win->y + win->height - 1 && top + height > win->y) {
-                /* Redraw border segments that intersect cursor area */
-                if (top <= win->y && top + height > win->y) {
-                    vga_hline(left, win->y, width, COLOR_BLACK); /* Top border */
-                }
-                if (top + height > win->y + win->height - 1) {
-                    vga_hline(left, win->y + win->height - 1, width, COLOR_BLACK); /* Bottom border */
-                }
-                if (left <= win->x && left + width > win->x) {
-                    vga_vline(win->x, top, height, COLOR_BLACK); /* Left border */
-                }
-                if (left + width > win->x + win->width - 1) {
-                    vga_vline(win->x + win->width - 1, top, height, COLOR_BLACK); /* Right border */
-                }
-            }
-            
-            /* For terminal windows, redraw the content (terminals are text-based so this is ok) */
-            if (i == get_terminal_win()) {
-                terminal_draw_content(win);
-            }
-            /* Other windows don't need content redraw for cursor area - they'll update when needed */
-            return;
-        }
-    }
-
-    /* Cursor is over desktop - redraw desktop background */
-    vga_fillrect(left, top, width, height, get_desktop_color());
-
-    /* Redraw any desktop icons that intersect this cursor area */
-    for (int i = 0; desktop_icons[i].label; i++) {
-        int ix = desktop_icons[i].x;
-        int iy = desktop_icons[i].y;
-        int iw = 48;
-        int ih = 40;  /* Include label area */
-
-        /* Check if icon intersects cursor area */
-        if (ix < left + width && ix + iw > left &&
-            iy < top + height && iy + ih > top) {
-
-            /* Redraw the icon */
-            vga_fillrect(ix, iy, iw, 32, COLOR_WHITE);
-            vga_rect(ix, iy, iw, 32, COLOR_BLACK);
-            vga_fillrect(ix + 14, iy + 4, 20, 16, COLOR_BLUE);
-
-            int label_len = 0;
-            const char* s = desktop_icons[i].label;
-            while (*s++) label_len++;
-            int lx = ix + (iw - label_len * 8) / 2;
-            vga_putstring(lx, iy + 23, desktop_icons[i].label, COLOR_BLACK, COLOR_WHITE);
-        }
-    }
+    vga_fillrect(menu_x, menu_y, menu_w, menu_h, COLOR_LIGHT_GRAY);
+    vga_rect(menu_x, menu_y, menu_w, menu_h, COLOR_BLACK);
     
-    /* Redraw start menu if open and intersects */
-    if (start_menu_open) {
-        int menu_x = 2;
-        int menu_y = taskbar_y - 160;
-        int menu_w = 150;
-        int menu_h = 160;
-        
-        if (menu_x < left + width && menu_x + menu_w > left &&
-            menu_y < top + height && menu_y + menu_h > top) {
-            
-            vga_fillrect(menu_x, menu_y, menu_w, menu_h, COLOR_LIGHT_GRAY);
-            vga_rect(menu_x, menu_y, menu_w, menu_h, COLOR_BLACK);
-            
-            const char* menu_items[] = {"Programs", "Files", "Settings", "Lock", "Shutdown", 0};
-            int item_h = 28;
-            for (int j = 0; menu_items[j]; j++) {
-                int item_y = menu_y + 8 + j * item_h;
-                vga_putstring(menu_x + 12, item_y + 6, menu_items[j], COLOR_BLACK, COLOR_LIGHT_GRAY);
-            }
-        }
+    /* 3D border effect */
+    vga_hline(menu_x + 1, menu_y + 1, menu_w - 2, COLOR_WHITE);
+    vga_vline(menu_x + 1, menu_y + 1, menu_h - 2, COLOR_WHITE);
+    vga_hline(menu_x + 1, menu_y + menu_h - 2, menu_w - 2, COLOR_DARK_GRAY);
+    vga_vline(menu_x + menu_w - 2, menu_y + 1, menu_h - 2, COLOR_DARK_GRAY);
+    
+    const char* menu_items[] = {"Programs", "Files", "Settings", "Lock", "Shutdown", 0};
+    for (int i = 0; menu_items[i]; i++) {
+        int item_y = menu_y + 8 + i * item_h;
+        vga_putstring(menu_x + 12, item_y + 6, menu_items[i], COLOR_BLACK, COLOR_LIGHT_GRAY);
     }
 }
 
-/* Redraw only a specific window and its content - for future use */
-static void redraw_window(int win_id) __attribute__((unused));
-static void redraw_window(int win_id) {
-    gui_erase_cursor();
-    
-    gui_window_t* win = gui_get_window(win_id);
-    if (!win || !win->visible) return;
-    
-    /* Draw this window */
-    gui_draw_window(win);
-    
-    /* Draw its content */
-    if (win_id == get_browser_win()) browser_draw_content(win);
-    else if (win_id == get_files_win()) files_draw_content(win);
-    else if (win_id == get_notepad_win()) notepad_draw_content(win);
-    else if (win_id == get_terminal_win()) terminal_draw_content(win);
-    else if (win_id == get_calc_win()) calc_draw_content(win);
-    else if (win_id == get_settings_win()) settings_draw_content(win);
-    else if (win_id == get_about_win()) about_draw_content(win);
-    
-    gui_cursor_invalidate();
-}
-
 /* Display games menu and return selected game index, -1 for desktop */
 static int show_games_menu(void) {
     /* Game list */
@@ -741,17 +449,18 @@ static int show_games_menu(void) {
             }
             last_selected = selected;
         }
-        
+    
         /* Wait for keyboard input */
         while (!keyboard_haskey()) {
             mouse_update();
             if (mouse_button_down(MOUSE_LEFT)) {
                 return -1;
             }
+            hlt();  /* until the next IRQ */
         }
-        
+    
         char key = keyboard_getchar();
-        
+    
         if (key == (char)KEY_UP) {  /* Up arrow */
             selected--;
             if (selected < 0) selected = num_games - 1;
@@ -770,6 +479,12 @@ static int show_games_menu(void) {
 
 /* Launch selected game */
 static void launch_game(int game_id) {
+    trace("game", game_id);
+    
+    /* Games draw into the shadow framebuffer and present once per frame */
+    int shadow = vga_shadow_enabled();
+    vga_set_shadow(1);
+    
     switch (game_id) {
         case 0:  /* Pong */
             pong_run();
@@ -781,19 +496,42 @@ static void launch_game(int game_id) {
             snake_run();
             break;
     }
+    
+    vga_set_shadow(shadow);
 }
 
+/* How long the loading screen stays up */
+#define BOOT_SPLASH_MS 500
+
 /* Kernel main entry point */
 void kernel_main(uint32_t magic, uint32_t* multiboot_info) {
-    (void)magic;
-    (void)multiboot_info;
+    /* Crash dumps go to COM1 too */
+    serial_init();
+    
+    /* Pick up the memory map and the bootloader framebuffer, if it set one */
+    if (multiboot_info) {
+        if (magic == MULTIBOOT2_MAGIC) parse_multiboot2_info(multiboot_info);
+        else if (magic == MULTIBOOT1_MAGIC) parse_multiboot1_info(multiboot_info);
+    }
+    
+    /* Page frames - the bitmap may land on the boot info, which is read by now */
+    pmm_init(mem_map, mem_map_count);
+    if (boot_fb_size) pmm_reserve(boot_fb_addr, boot_fb_size);
+    frame_arena_init();
+    paging_init();
     
-    /* Initialize subsystems */
+    /* Initialize subsystems (drivers hook their IRQs as they come up) */
+    interrupts_init();
+    timer_init(TIMER_HZ);
+    clock_init();
     vga_init();
     keyboard_init();
     mouse_init();
     network_init();
     
+    /* Timer, keyboard and mouse input by IRQ from here on */
+    sti();
+    
     /* Show loading screen */
     vga_clear(COLOR_BLUE);
     vga_fillrect(220, 180, 200, 80, COLOR_WHITE);
@@ -802,13 +540,13 @@ void kernel_main(uint32_t magic, uint32_t* multiboot_info) {
     vga_putstring(250, 230, "Starting...", COLOR_DARK_GRAY, COLOR_WHITE);
     
     /* Delay during startup */
-    for (volatile int i = 0; i < 3000000; i++);
+    sleep_ms(BOOT_SPLASH_MS);
     
     /* Initialize input devices */
     keyboard_init();
     
     /* Clear keyboard buffer thoroughly */
-    for (volatile int j = 0; j < 500000; j++);
+    sleep_ms(20);
     while (keyboard_haskey()) {
         keyboard_getchar();
     }
@@ -825,6 +563,8 @@ void kernel_main(uint32_t magic, uint32_t* multiboot_info) {
     
     /* Initialize GUI and apps */
     gui_init();
+    gui_set_painters(paint_desktop, paint_start_menu);
+    gui_set_desktop_icons(desktop_icons);
     apps_init();
     
     /* Show games menu at startup */
@@ -835,16 +575,23 @@ void kernel_main(uint32_t magic, uint32_t* multiboot_info) {
         launch_game(selected_game);
     }
     
+    /* Desktop draws into the shadow framebuffer, flushed once per frame */
+    vga_set_shadow(1);
+    
     /* Initial draw */
     needs_redraw = 1;
     
     /* Previous mouse state */
     int last_mx = -1, last_my = -1;
     int last_mouse_btn = 0;
-    int active_win_id = -1;
     
-    /* Main loop */
+    /* Main loop - sleeps until there is input or something to repaint */
+    event_post(EVENT_REDRAW);
     while (1) {
+        uint32_t events = event_wait();
+        uint64_t input_at = event_input_cycles();
+        if (events & EVENT_TIMER) timer_run();
+    
         /* === SHUTDOWN HANDLING === */
         if (shutdown_initiated) {
             /* Draw shutdown screen */
@@ -852,13 +599,14 @@ void kernel_main(uint32_t magic, uint32_t* multiboot_info) {
             vga_putstring(220, 200, "Shutting down...", COLOR_WHITE, COLOR_BLUE);
             vga_putstring(180, 230, "It is now safe to turn off", COLOR_WHITE, COLOR_BLUE);
             vga_putstring(200, 250, "your computer.", COLOR_WHITE, COLOR_BLUE);
-            
+            vga_swap();
+    
             /* Halt the CPU */
             while(1) {
                 __asm__ volatile("hlt");
             }
         }
-        
+    
         /* === LOCK SCREEN HANDLING === */
         if (screen_locked) {
             /* Only draw lock screen once */
@@ -867,27 +615,30 @@ void kernel_main(uint32_t magic, uint32_t* multiboot_info) {
                 vga_fillrect(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT, COLOR_BLUE);
                 vga_putstring(260, 150, "GegOS Locked", COLOR_WHITE, COLOR_BLUE);
                 vga_putstring(200, 200, "Enter password:", COLOR_WHITE, COLOR_BLUE);
-                
+    
                 /* Password input box (highlighted to show it's selected) */
                 vga_fillrect(200, 220, 200, 24, COLOR_WHITE);
                 vga_rect(200, 220, 200, 24, COLOR_BLUE);  /* Blue border to show selection */
                 vga_rect(201, 221, 198, 22, COLOR_BLACK); /* Inner black border */
-                
+    
                 /* Show asterisks for password */
                 for (int i = 0; i < lock_input_pos && i < 20; i++) {
                     vga_putstring(208 + i * 8, 226, "*", COLOR_BLACK, COLOR_WHITE);
                 }
-                
+    
                 /* Show message if password was wrong */
                 if (lock_input_pos == 0 && lock_input[0] == 0) {
                     vga_putstring(180, 260, "If you mistyped, press Enter and try again", COLOR_LIGHT_GRAY, COLOR_BLUE);
                 }
-                
+    
                 lock_screen_drawn = 1;
             }
-            
+    
+            /* Keep the controller drained, mouse bytes block the keyboard */
+            if (events & EVENT_MOUSE) mouse_update();
+    
             /* Handle lock screen keyboard input */
-            if (keyboard_haskey()) {
+            if ((events & EVENT_KEY) && keyboard_haskey()) {
                 char key = keyboard_getchar();
                 if (key == '\n') {
                     /* Check password */
@@ -922,90 +673,68 @@ void kernel_main(uint32_t magic, uint32_t* multiboot_info) {
                     lock_screen_drawn = 0;  /* Redraw to update asterisks */
                 }
             }
-            
-            for (volatile int i = 0; i < 50000; i++);
+    
+            vga_swap();
+    
+            /* Asterisks changed, or unlocked */
+            if (!lock_screen_drawn || !screen_locked) event_post(EVENT_REDRAW);
             continue;
         }
-        
+    
         /* === INPUT HANDLING === */
-        
+    
         /* Update mouse state */
-        mouse_update();
-        
+        if (events & EVENT_MOUSE) mouse_update();
+    
         int mx = mouse_get_x();
         int my = mouse_get_y();
         int mouse_btn = mouse_button_down(MOUSE_LEFT);
         int mouse_clicked = mouse_btn && !last_mouse_btn;
         int mouse_released = !mouse_btn && last_mouse_btn;
         int mouse_moved = (mx != last_mx || my != last_my);
-        
+    
         /* Track dragging for windows */
         static int is_dragging = 0;
-        
+        uint64_t drag_at = 0;
+    
         /* Handle mouse clicks */
         if (mouse_clicked) {
-            int old_active = active_win_id;
-            gui_update();
-            
-            /* Check start menu first */
-            handle_start_menu_click(mx, my);
-            
-            /* Check desktop icons */
-            if (my > 12) {
-                check_icon_click(mx, my);
-            }
-            
-            /* Handle app-specific clicks - returns 1 if handled */
-            int app_handled = handle_app_click(mx, my);
-            
-            /* Find active window */
-            active_win_id = -1;
-            for (int i = 0; i < 16; i++) {
-                gui_window_t* win = gui_get_window(i);
-                if (win && win->visible && win->active) {
-                    active_win_id = i;
-                    break;
-                }
-            }
-            
-            /* Only trigger full redraw if window activation changed */
-            if (old_active != active_win_id && !app_handled) {
-                needs_redraw = 1;
-            }
+            trace("click", (uintptr_t)((mx << 16) | my));
             
-            /* Check if we started dragging */
-            for (int i = 0; i < 16; i++) {
-                gui_window_t* win = gui_get_window(i);
-                if (win && win->dragging) {
-                    is_dragging = 1;
-                    /* Don't redraw while starting drag */
-                    break;
+            /* The start menu is over everything; otherwise the click goes to
+             * the topmost window, button or icon under the pointer */
+            if (!handle_start_menu_click(mx, my)) {
+                int old_mode = vga_get_mode();
+                gui_update();
+                if (vga_get_mode() != old_mode) {
+                    screen_size_changed();  /* Settings switched resolution */
                 }
             }
+    
+            is_dragging = (gui_get_drag_window() >= 0);
         } else if (mouse_btn && is_dragging && mouse_moved) {
-            /* Window is being dragged - update position */
+            /* Window is being dragged - moved once per frame to where all of
+             * this frame's mouse packets took it */
+            drag_at = now_cycles();
             gui_update();
-            /* Skip full redraw during drag - too slow */
         } else if (mouse_released) {
-            if (is_dragging) {
-                is_dragging = 0;
-                needs_redraw = 1;  /* Only redraw after drag ends */
-            }
+            is_dragging = 0;
+            gui_update();  /* drop the window, release buttons */
         }
-        
+    
         last_mouse_btn = mouse_btn;
-        
+        last_mx = mx;
+        last_my = my;
+    
         /* Handle keyboard input */
-        if (keyboard_haskey()) {
+        if ((events & EVENT_KEY) && keyboard_haskey()) {
             char key = keyboard_getchar();
             if (key != 0) {
+                trace("key", (uint8_t)key);
+                
                 /* Alt+F4 closes active window */
                 if (key == (char)KEY_F4 && (keyboard_get_modifiers() & MOD_ALT)) {
-                    if (active_win_id >= 0) {
-                        gui_close_window(active_win_id);
-                        active_win_id = -1;
-                        needs_redraw = 1;
-                    }
+                    gui_close_window(gui_get_active_window());
                 } 
                 /* Meta+L or Super+L locks screen */
                 else if ((key == 'l' || key == 'L') && (keyboard_get_modifiers() & MOD_SUPER)) {
@@ -1015,75 +744,44 @@ void kernel_main(uint32_t magic, uint32_t* multiboot_info) {
                     needs_redraw = 1;
                 }
                 else {
-                    handle_app_keyboard(key, mx, my);
+                    gui_dispatch_key(key);
                 }
             }
         }
-        
+    
         /* === RENDERING === */
-        
-        /* Redraw screen when needed (major changes only) */
+    
+        /* Whole screen invalid (unlock, resolution change) */
         if (needs_redraw) {
-            /* Full redraw - this is the simple, reliable approach */
-            vga_vsync();
-            
-            /* Desktop */
-            vga_fillrect(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT - TASKBAR_HEIGHT, get_desktop_color());
-            
-            /* Desktop icons */
-            for (int i = 0; desktop_icons[i].label; i++) {
-                int ix = desktop_icons[i].x;
-                int iy = desktop_icons[i].y;
-                vga_fillrect(ix, iy, 48, 32, COLOR_WHITE);
-                vga_rect(ix, iy, 48, 32, COLOR_BLACK);
-                vga_fillrect(ix + 14, iy + 4, 20, 16, COLOR_BLUE);
-                int label_len = 0;
-                const char* s = desktop_icons[i].label;
-                while (*s++) label_len++;
-                int lx = ix + (48 - label_len * 8) / 2;
-                vga_putstring(lx, iy + 23, desktop_icons[i].label, COLOR_BLACK, COLOR_WHITE);
-            }
-            
-            /* Taskbar */
-            gui_draw_menubar();
-            
-            /* Start menu if open */
-            if (start_menu_open) {
-                int taskbar_y = SCREEN_HEIGHT - TASKBAR_HEIGHT;
-                int menu_x = 2;
-                int menu_y = taskbar_y - 160;
-                int menu_w = 150;
-                int menu_h = 160;
-                int item_h = 28;
-                vga_fillrect(menu_x, menu_y, menu_w, menu_h, COLOR_LIGHT_GRAY);
-                vga_rect(menu_x, menu_y, menu_w, menu_h, COLOR_BLACK);
-                /* 3D border */
-                vga_hline(menu_x + 1, menu_y + 1, menu_w - 2, COLOR_WHITE);
-                vga_vline(menu_x + 1, menu_y + 1, menu_h - 2, COLOR_WHITE);
-                vga_hline(menu_x + 1, menu_y + menu_h - 2, menu_w - 2, COLOR_DARK_GRAY);
-                vga_vline(menu_x + menu_w - 2, menu_y + 1, menu_h - 2, COLOR_DARK_GRAY);
-                const char* menu_items[] = {"Programs", "Files", "Settings", "Lock", "Shutdown", 0};
-                for (int j = 0; menu_items[j]; j++) {
-                    int item_y = menu_y + 8 + j * item_h;
-                    vga_putstring(menu_x + 12, item_y + 6, menu_items[j], COLOR_BLACK, COLOR_LIGHT_GRAY);
-                }
-            }
-            
-            /* Windows */
-            gui_draw();
-            
-            /* App contents */
-            draw_app_contents();
-            
+            gui_add_dirty_rect(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT);
             needs_redraw = 0;
         }
-        
-        /* Update cursor position - optimized rectangle redraw */
-        if (mouse_moved) {
+    
+        CLOCK_TIME(render_stat) {
+            /* Repaint only what changed, into the shadow - flushed at vsync below */
+            gui_redraw_dirty();
+            
+            /* Move the cursor overlay (no-op when it has not moved) */
             gui_draw_cursor(mx, my);
         }
-
-        /* Frame rate limiting */
-        for (volatile int i = 0; i < 50000; i++);
+    
+        /* Present this frame's damage (waits for vsync when there is any) */
+        CLOCK_TIME(present_stat) {
+            vga_swap();
+        }
+    
+        /* From the IRQ posting the input to its frame on screen */
+        if (input_at) clock_stat_add(&input_stat, now_cycles() - input_at);
+    
+        /* One drag frame, from moving the window to it being on screen */
+        if (drag_at) clock_stat_add(&drag_stat, now_cycles() - drag_at);
+    
+        /* This frame's scratch is done with */
+        arena_reset(&frame_arena);
+    
+        /* Damage added while painting, or a lock/shutdown started */
+        if (gui_has_dirty_rects() || screen_locked || shutdown_initiated) {
+            event_post(EVENT_REDRAW);
+        }
     }
 }
@@ -1,10 +1,14 @@
 /*
  * keyboard.c - PS/2 Keyboard Driver for GegOS
- * Polling-based keyboard input with scancode translation
+ * IRQ1 queues scancodes in a ring (polled until interrupts are set up),
+ * translated to characters as they are read
  */
 
 #include "keyboard.h"
 #include "io.h"
+#include "ring.h"
+#include "event.h"
+#include "interrupt.h"
 
 /* PS/2 Keyboard Ports */
 #define KB_DATA_PORT    0x60
@@ -19,6 +23,10 @@
 static uint8_t modifiers = 0;
 static uint8_t key_states[128] = {0};
 
+/* Scancodes from the IRQ handler */
+static ring_t kb_ring;
+static int kb_irq_installed = 0;
+
 /* US QWERTY scancode to ASCII (normal) */
 static const char scancode_to_ascii[128] = {
     0,   27,  '1', '2', '3', '4', '5', '6', '7', '8', '9', '0', '-', '=', '\b',
@@ -54,6 +62,26 @@ static const char scancode_to_ascii_shift[128] = {
 #define SC_ALT        0x38
 #define SC_CAPSLOCK   0x3A
 
+/* IRQ1 - take the byte only if it is keyboard data */
+static void keyboard_irq(void) {
+    uint8_t status = inb(KB_STATUS_PORT);
+    if ((status & KB_STATUS_OUTPUT) && !(status & 0x20)) {
+        ring_put(&kb_ring, inb(KB_DATA_PORT));
+        event_post(EVENT_KEY);
+    }
+}
+
+/* Next scancode, returns 0 if there is none */
+static int keyboard_read(uint8_t* scancode) {
+    if (kb_irq_installed) return ring_get(&kb_ring, scancode);
+    
+    uint8_t status = inb(KB_STATUS_PORT);
+    /* Only process if data available AND not from mouse */
+    if (!(status & KB_STATUS_OUTPUT) || (status & 0x20)) return 0;
+    *scancode = inb(KB_DATA_PORT);
+    return 1;
+}
+
 /* Initialize keyboard */
 void keyboard_init(void) {
     /* Clear keyboard buffer */
@@ -68,10 +96,16 @@ void keyboard_init(void) {
     for (int i = 0; i < 128; i++) {
         key_states[i] = 0;
     }
+    
+    /* From here on scancodes arrive through IRQ1 */
+    irq_install(IRQ_KEYBOARD, keyboard_irq);
+    kb_irq_installed = 1;
 }
 
 /* Check if key available (not mouse data) */
 int keyboard_haskey(void) {
+    if (kb_irq_installed) return !ring_empty(&kb_ring);
+    
     uint8_t status = inb(KB_STATUS_PORT);
     /* Bit 0 = data available, Bit 5 = from mouse (must NOT be set) */
     return (status & KB_STATUS_OUTPUT) && !(status & 0x20);
@@ -92,11 +126,9 @@ int keyboard_key_held(uint8_t scancode) {
 
 /* Update keyboard state */
 void keyboard_update(void) {
-    uint8_t status = inb(KB_STATUS_PORT);
-    /* Only process if data available AND not from mouse */
-    if (!(status & KB_STATUS_OUTPUT) || (status & 0x20)) return;
+    uint8_t scancode;
+    if (!keyboard_read(&scancode)) return;
     
-    uint8_t scancode = inb(KB_DATA_PORT);
     int released = (scancode & 0x80) != 0;
     uint8_t key = scancode & 0x7F;
     
@@ -124,13 +156,10 @@ void keyboard_update(void) {
     }
 }
 
-/* Get character (polling) */
+/* Get character (next scancode, 0 if it is not a character) */
 char keyboard_getchar(void) {
-    uint8_t status = inb(KB_STATUS_PORT);
-    /* Only process if data available AND not from mouse */
-    if (!(status & KB_STATUS_OUTPUT) || (status & 0x20)) return 0;
-    
-    uint8_t scancode = inb(KB_DATA_PORT);
+    uint8_t scancode;
+    if (!keyboard_read(&scancode)) return 0;
     
     /* Ignore key release */
     if (scancode & 0x80) {
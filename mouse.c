@@ -1,11 +1,14 @@
 /*
  * mouse.c - PS/2 Mouse Driver for GegOS
- * Polling-based mouse input
+ * IRQ12 queues packet bytes in a ring (polled until interrupts are set up)
  */
 
 #include "mouse.h"
 #include "io.h"
 #include "vga.h"
+#include "ring.h"
+#include "event.h"
+#include "interrupt.h"
 
 /* PS/2 Ports */
 #define MOUSE_DATA_PORT   0x60
@@ -18,6 +21,9 @@
 #define MOUSE_GET_COMPAQ  0x20
 #define MOUSE_SET_COMPAQ  0x60
 
+/* Most packets taken by one mouse_update() */
+#define MOUSE_MAX_PACKETS 32
+
 /* Mouse commands */
 #define MOUSE_SET_DEFAULTS   0xF6
 #define MOUSE_ENABLE_PACKET  0xF4
@@ -28,8 +34,12 @@ static mouse_state_t mouse_state;
 static int mouse_cycle = 0;
 static int8_t mouse_bytes[3];
 static int min_x = 0, min_y = 0;
-static int max_x = SCREEN_WIDTH - 1;
-static int max_y = SCREEN_HEIGHT - 1;
+static int max_x = 0;
+static int max_y = 0;
+
+/* Packet bytes from the IRQ handler */
+static ring_t mouse_ring;
+static int mouse_irq_installed = 0;
 
 /* Wait for mouse controller to be ready for input */
 static void mouse_wait_write(void) {
@@ -61,13 +71,39 @@ static uint8_t mouse_read(void) {
     return inb(MOUSE_DATA_PORT);
 }
 
+/* IRQ12 - take the byte only if it is mouse data */
+static void mouse_irq(void) {
+    uint8_t status = inb(MOUSE_STATUS_PORT);
+    if ((status & 0x01) && (status & 0x20)) {
+        ring_put(&mouse_ring, inb(MOUSE_DATA_PORT));
+        event_post(EVENT_MOUSE);
+    }
+}
+
+/* Next byte of packet data, returns 0 if there is none */
+static int mouse_next_byte(uint8_t* data) {
+    if (mouse_irq_installed) return ring_get(&mouse_ring, data);
+    
+    uint8_t status = inb(MOUSE_STATUS_PORT);
+    if (!(status & 0x01)) return 0;  /* No data */
+    if (!(status & 0x20)) return 0;  /* Not from mouse */
+    *data = inb(MOUSE_DATA_PORT);
+    return 1;
+}
+
 /* Initialize mouse */
 void mouse_init(void) {
     uint8_t status;
     
+    /* The handler would take the ACKs read below */
+    int irqs = interrupts_enabled();
+    cli();
+    
     /* Initialize state */
     mouse_state.x = SCREEN_WIDTH / 2;
     mouse_state.y = SCREEN_HEIGHT / 2;
+    max_x = SCREEN_WIDTH - 1;
+    max_y = SCREEN_HEIGHT - 1;
     mouse_state.dx = 0;
     mouse_state.dy = 0;
     mouse_state.buttons = 0;
@@ -111,18 +147,15 @@ void mouse_init(void) {
     while (inb(MOUSE_STATUS_PORT) & 0x01) {
         inb(MOUSE_DATA_PORT);
     }
+    
+    /* From here on packets arrive through IRQ12 */
+    irq_install(IRQ_MOUSE, mouse_irq);
+    mouse_irq_installed = 1;
+    if (irqs) sti();
 }
 
-/* Update mouse state */
-void mouse_update(void) {
-    /* Check if data available */
-    uint8_t status = inb(MOUSE_STATUS_PORT);
-    
-    if (!(status & 0x01)) return;  /* No data */
-    if (!(status & 0x20)) return;  /* Not from mouse */
-    
-    uint8_t data = inb(MOUSE_DATA_PORT);
-    
+/* Feed one byte of a packet, returns 1 when the packet is complete */
+static int mouse_handle_byte(uint8_t data) {
     switch (mouse_cycle) {
         case 0:
             /* First byte - buttons and overflow */
@@ -143,9 +176,6 @@ void mouse_update(void) {
             mouse_bytes[2] = data;
             mouse_cycle = 0;
             
-            /* Save previous buttons */
-            mouse_state.prev_buttons = mouse_state.buttons;
-            
             /* Update buttons */
             mouse_state.buttons = mouse_bytes[0] & 0x07;
             
@@ -171,8 +201,41 @@ void mouse_update(void) {
             if (mouse_state.x > max_x) mouse_state.x = max_x;
             if (mouse_state.y < min_y) mouse_state.y = min_y;
             if (mouse_state.y > max_y) mouse_state.y = max_y;
-            break;
+            return 1;
     }
+    return 0;
+}
+
+/* Update mouse state - takes every packet that has arrived since the last
+ * call, so a frame sees the motion of all of them at once. Stops after a
+ * packet that changes the buttons so no click or release is missed. */
+void mouse_update(void) {
+    uint8_t buttons = mouse_state.buttons;
+    int dx = 0, dy = 0, packets = 0;
+    
+    for (int n = 0; n < MOUSE_MAX_PACKETS * 3; n++) {
+        uint8_t data;
+        if (!mouse_next_byte(&data)) break;
+        if (!mouse_handle_byte(data)) continue;
+        packets++;
+        dx += mouse_state.dx;
+        dy += mouse_state.dy;
+        if (mouse_state.buttons != buttons) break;
+    }
+    
+    if (packets) {
+        mouse_state.prev_buttons = buttons;
+        mouse_state.dx = dx;
+        mouse_state.dy = dy;
+    }
+}
+
+/* Mouse bytes waiting */
+int mouse_has_data(void) {
+    if (mouse_irq_installed) return !ring_empty(&mouse_ring);
+    
+    uint8_t status = inb(MOUSE_STATUS_PORT);
+    return (status & 0x01) && (status & 0x20);
 }
 
 /* Get mouse state */
@@ -28,6 +28,9 @@ void mouse_init(void);
 /* Update mouse state (call in main loop) */
 void mouse_update(void);
 
+/* Check if mouse data is waiting */
+int mouse_has_data(void);
+
 /* Get current mouse state */
 mouse_state_t* mouse_get_state(void);
 
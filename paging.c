@@ -0,0 +1,195 @@
+/*
+ * paging.c - Page tables for GegOS
+ * The 32-bit kernel gets a page directory of 4 MB pages here; the 64-bit
+ * one keeps the 2 MB pages boot64.s set up. A large page is split into
+ * a table of 4 KB pages (from the PMM) the first time part of it needs
+ * different treatment.
+ *
+ * Write-combining: PAT entry 1 (PWT set, PCD clear) is reprogrammed from
+ * write-through to WC, so no mapping needs the PAT bit. A WC PAT type
+ * wins over an uncached MTRR, so framebuffers need no MTRR changes.
+ */
+
+#include "paging.h"
+#include "pmm.h"
+#include "io.h"
+
+/* From boot.s / boot64.s: the page below the boot stack */
+extern char stack_guard[];
+
+#define PTE_PRESENT    0x001
+#define PTE_WRITE      0x002
+#define PTE_PWT        0x008
+#define PTE_PCD        0x010
+#define PTE_LARGE      0x080    /* in a directory entry */
+#define PTE_PAT_4K     0x080    /* in a table entry */
+#define PTE_PAT_LARGE  0x1000   /* in a directory entry */
+#define PTE_CACHE      (PTE_PWT | PTE_PCD)
+
+#define CPUID_PSE      (1 << 3)
+#define CPUID_PAT      (1 << 16)
+
+#define MSR_PAT        0x277
+#define PAT_WC         0x01
+#define CR0_PG         0x80000000
+#define CR4_PSE        0x10
+
+#ifdef __x86_64__
+typedef uint64_t pte_t;
+#define PT_ENTRIES     512
+#define LARGE_SHIFT    21
+#define ADDR_MASK      0x000FFFFFFFFFF000ULL
+#else
+typedef uint32_t pte_t;
+#define PT_ENTRIES     1024
+#define LARGE_SHIFT    22
+#define ADDR_MASK      0xFFFFF000u
+#endif
+#define LARGE_SIZE     (1UL << LARGE_SHIFT)
+#define LARGE_MASK     (ADDR_MASK & ~(pte_t)(LARGE_SIZE - 1))
+
+#define MAP_LIMIT      0x100000000ULL   /* identity mapped: the low 4 GB */
+
+static int paging_on = 0;
+static int have_pat = 0;
+
+#ifndef __x86_64__
+static pte_t page_dir[PT_ENTRIES] __attribute__((aligned(PAGE_SIZE)));
+#endif
+
+static inline uintptr_t read_cr3(void) {
+    uintptr_t v;
+    __asm__ volatile ("mov %%cr3, %0" : "=r"(v));
+    return v;
+}
+
+static inline void write_cr3(uintptr_t v) {
+    __asm__ volatile ("mov %0, %%cr3" : : "r"(v) : "memory");
+}
+
+/* Reload CR3 to drop every (non-global) TLB entry */
+static void flush_tlb(void) {
+    write_cr3(read_cr3());
+}
+
+/* Directory entry mapping addr, 0 if there is none */
+static pte_t* dir_entry(uintptr_t addr) {
+#ifdef __x86_64__
+    pte_t* pml4 = (pte_t*)(uintptr_t)(read_cr3() & ADDR_MASK);
+    pte_t e = pml4[(addr >> 39) & 511];
+    if (!(e & PTE_PRESENT)) return 0;
+    pte_t* pdpt = (pte_t*)(uintptr_t)(e & ADDR_MASK);
+    e = pdpt[(addr >> 30) & 511];
+    if (!(e & PTE_PRESENT) || (e & PTE_LARGE)) return 0;
+    pte_t* pd = (pte_t*)(uintptr_t)(e & ADDR_MASK);
+    return &pd[(addr >> LARGE_SHIFT) & 511];
+#else
+    return &page_dir[addr >> LARGE_SHIFT];
+#endif
+}
+
+/* Replace a large page by a table of 4 KB pages with the same attributes */
+static int split_large(pte_t* dir) {
+    pte_t* table = (pte_t*)pmm_alloc_page();
+    if (!table) return 0;
+    
+    pte_t base = *dir & LARGE_MASK;
+    pte_t flags = *dir & (PTE_PRESENT | PTE_WRITE | PTE_CACHE);
+    if (*dir & PTE_PAT_LARGE) flags |= PTE_PAT_4K;
+    for (int i = 0; i < PT_ENTRIES; i++) {
+        table[i] = (base + (pte_t)i * PAGE_SIZE) | flags;
+    }
+    *dir = (uintptr_t)table | PTE_PRESENT | PTE_WRITE;
+    return 1;
+}
+
+/* Table entry for one 4 KB page, splitting its large page if needed */
+static pte_t* page_entry(uintptr_t addr) {
+    pte_t* dir = dir_entry(addr);
+    if (!dir || !(*dir & PTE_PRESENT)) return 0;
+    if ((*dir & PTE_LARGE) && !split_large(dir)) return 0;
+    pte_t* table = (pte_t*)(uintptr_t)(*dir & ADDR_MASK);
+    return &table[(addr >> PAGE_SHIFT) & (PT_ENTRIES - 1)];
+}
+
+void paging_init(void) {
+    uint32_t eax, ebx, ecx, edx;
+    cpuid(1, &eax, &ebx, &ecx, &edx);
+    
+#ifndef __x86_64__
+    /* Without 4 MB pages the tables would take 4 MB: stay unpaged */
+    if (!(edx & CPUID_PSE)) return;
+    
+    for (uint32_t i = 0; i < PT_ENTRIES; i++) {
+        page_dir[i] = (i << LARGE_SHIFT) | PTE_PRESENT | PTE_WRITE | PTE_LARGE;
+    }
+    uintptr_t cr0, cr4;
+    __asm__ volatile ("mov %%cr4, %0" : "=r"(cr4));
+    __asm__ volatile ("mov %0, %%cr4" : : "r"(cr4 | CR4_PSE));
+    write_cr3((uintptr_t)page_dir);
+    __asm__ volatile ("mov %%cr0, %0" : "=r"(cr0));
+    __asm__ volatile ("mov %0, %%cr0" : : "r"(cr0 | CR0_PG) : "memory");
+#endif
+    paging_on = 1;
+    
+    if (edx & CPUID_PAT) {
+        int irqs = interrupts_enabled();
+        cli();
+        __asm__ volatile ("wbinvd" ::: "memory");
+        uint64_t pat = rdmsr(MSR_PAT);
+        wrmsr(MSR_PAT, (pat & ~0xFF00ULL) | ((uint64_t)PAT_WC << 8));
+        __asm__ volatile ("wbinvd" ::: "memory");
+        flush_tlb();
+        if (irqs) sti();
+        have_pat = 1;
+    }
+    
+    /* A boot stack overflow now faults instead of running into .bss */
+    paging_unmap((uintptr_t)stack_guard);
+}
+
+void paging_unmap(uintptr_t addr) {
+    if (!paging_on) return;
+    pte_t* pte = page_entry(addr);
+    if (!pte) return;
+    *pte = 0;
+    __asm__ volatile ("invlpg (%0)" : : "r"(addr) : "memory");
+}
+
+void paging_set_cache(uint64_t base, uint64_t length, int type) {
+    if (!paging_on) return;
+    if (type == PAGE_CACHE_WRITECOMBINE && !have_pat) return;
+    
+    pte_t bits = 0;
+    if (type == PAGE_CACHE_WRITECOMBINE) bits = PTE_PWT;
+    else if (type == PAGE_CACHE_UNCACHED) bits = PTE_PWT | PTE_PCD;
+    
+    uint64_t addr = base & ~(uint64_t)(PAGE_SIZE - 1);
+    uint64_t end = base + length;
+    if (end > MAP_LIMIT) end = MAP_LIMIT;
+    
+    while (addr < end) {
+        pte_t* dir = dir_entry((uintptr_t)addr);
+        if (!dir || !(*dir & PTE_PRESENT)) {
+            addr = (addr | (LARGE_SIZE - 1)) + 1;
+            continue;
+        }
+        
+        /* Whole large pages keep being large pages */
+        if ((*dir & PTE_LARGE) && !(addr & (LARGE_SIZE - 1)) && end - addr >= LARGE_SIZE) {
+            *dir = (*dir & ~(pte_t)(PTE_CACHE | PTE_PAT_LARGE)) | bits;
+            addr += LARGE_SIZE;
+            continue;
+        }
+        
+        pte_t* pte = page_entry((uintptr_t)addr);
+        if (pte && (*pte & PTE_PRESENT)) {
+            *pte = (*pte & ~(pte_t)(PTE_CACHE | PTE_PAT_4K)) | bits;
+        }
+        addr += PAGE_SIZE;
+    }
+    
+    /* No stale lines or translations with the old type */
+    __asm__ volatile ("wbinvd" ::: "memory");
+    flush_tlb();
+}
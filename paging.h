@@ -0,0 +1,27 @@
+/*
+ * paging.h - Page tables for GegOS
+ * Both kernels identity map the low 4 GB with large pages; ranges that
+ * need finer control are split into 4 KB pages on demand.
+ */
+
+#ifndef PAGING_H
+#define PAGING_H
+
+#include <stdint.h>
+
+/* Memory types for paging_set_cache() */
+#define PAGE_CACHE_WRITEBACK     0
+#define PAGE_CACHE_WRITECOMBINE  1   /* needs PAT, else left alone */
+#define PAGE_CACHE_UNCACHED      2
+
+/* Turn paging on (32-bit) or take over the boot tables (64-bit), set up
+ * PAT and unmap the guard page under the boot stack. Call after pmm_init. */
+void paging_init(void);
+
+/* Memory type for a physical range, rounded out to whole pages */
+void paging_set_cache(uint64_t base, uint64_t length, int type);
+
+/* Leave a page unmapped, so any access faults */
+void paging_unmap(uintptr_t addr);
+
+#endif /* PAGING_H */
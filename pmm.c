@@ -0,0 +1,173 @@
+/*
+ * pmm.c - Physical memory manager for GegOS
+ * A bitmap with one bit per page frame (set = used), sized to the highest
+ * usable address and kept in the first free stretch above the kernel.
+ * Allocation is next-fit, skipping full words 32 pages at a time.
+ */
+
+#include "pmm.h"
+
+/* From the linker script */
+extern char kernel_start[];
+extern char kernel_end[];
+
+#define LOW_MEMORY   0x100000ULL        /* BIOS, VGA memory and ROMs */
+#define MAX_ADDRESS  0x100000000ULL     /* 4 GB */
+
+static uint32_t* bitmap = 0;
+static uint32_t bitmap_pages = 0;       /* pages the bitmap covers */
+static uint32_t total_pages = 0;        /* usable pages */
+static uint32_t free_pages = 0;
+static uint32_t next_page = 0;          /* where the next search starts */
+
+static inline int page_used(uint32_t page) {
+    return (bitmap[page >> 5] >> (page & 31)) & 1;
+}
+
+static inline void page_set_used(uint32_t page) {
+    bitmap[page >> 5] |= 1u << (page & 31);
+}
+
+static inline void page_set_free(uint32_t page) {
+    bitmap[page >> 5] &= ~(1u << (page & 31));
+}
+
+static uint64_t align_up(uint64_t addr) {
+    return (addr + PAGE_SIZE - 1) & ~(uint64_t)(PAGE_SIZE - 1);
+}
+
+static uint64_t align_down(uint64_t addr) {
+    return addr & ~(uint64_t)(PAGE_SIZE - 1);
+}
+
+/* Whole pages inside a usable region, clamped to what we manage */
+static int usable_range(const mem_region_t* r, uint64_t* start, uint64_t* end) {
+    if (r->type != MEM_USABLE) return 0;
+    *start = align_up(r->base < LOW_MEMORY ? LOW_MEMORY : r->base);
+    uint64_t limit = r->base + r->length;
+    *end = align_down(limit > MAX_ADDRESS ? MAX_ADDRESS : limit);
+    return *start < *end;
+}
+
+void pmm_init(const mem_region_t* map, int count) {
+    uint64_t start, end;
+    
+    /* Size the bitmap to the highest usable page */
+    uint64_t highest = 0;
+    for (int i = 0; i < count; i++) {
+        if (usable_range(&map[i], &start, &end) && end > highest) highest = end;
+    }
+    bitmap_pages = (uint32_t)(highest >> PAGE_SHIFT);
+    uint32_t bitmap_bytes = ((bitmap_pages + 31) / 32) * 4;
+    if (!bitmap_pages) return;
+    
+    /* First usable stretch past the kernel that holds it */
+    uint64_t image_end = align_up((uintptr_t)kernel_end);
+    bitmap = 0;
+    for (int i = 0; i < count && !bitmap; i++) {
+        if (!usable_range(&map[i], &start, &end)) continue;
+        if (start < image_end) start = image_end;
+        if (start < end && end - start >= bitmap_bytes) {
+            bitmap = (uint32_t*)(uintptr_t)start;
+        }
+    }
+    if (!bitmap) {
+        bitmap_pages = 0;
+        return;
+    }
+    
+    /* Everything starts used; free what the map calls usable */
+    for (uint32_t i = 0; i < bitmap_bytes / 4; i++) {
+        bitmap[i] = 0xFFFFFFFF;
+    }
+    for (int i = 0; i < count; i++) {
+        if (!usable_range(&map[i], &start, &end)) continue;
+        for (uint32_t p = start >> PAGE_SHIFT; p < (end >> PAGE_SHIFT); p++) {
+            if (!page_used(p)) continue;    /* overlapping entries */
+            page_set_free(p);
+            total_pages++;
+            free_pages++;
+        }
+    }
+    
+    /* Some BIOSes report reserved holes inside usable entries */
+    for (int i = 0; i < count; i++) {
+        if (map[i].type != MEM_USABLE) pmm_reserve(map[i].base, map[i].length);
+    }
+    pmm_reserve((uintptr_t)kernel_start, (uintptr_t)kernel_end - (uintptr_t)kernel_start);
+    pmm_reserve((uintptr_t)bitmap, bitmap_bytes);
+    next_page = 0;
+}
+
+void pmm_reserve(uint64_t base, uint64_t length) {
+    uint64_t start = align_down(base) >> PAGE_SHIFT;
+    uint64_t end = align_up(base + length) >> PAGE_SHIFT;
+    if (end > bitmap_pages) end = bitmap_pages;
+    
+    for (uint64_t p = start; p < end; p++) {
+        if (page_used((uint32_t)p)) continue;
+        page_set_used((uint32_t)p);
+        free_pages--;
+    }
+}
+
+uintptr_t pmm_alloc_pages(uint32_t count) {
+    if (!count || count > free_pages) return 0;
+    
+    /* One lap from next_page, plus enough to finish a run across it */
+    uint32_t page = next_page;
+    uint32_t run = 0;
+    for (uint32_t n = 0; n < bitmap_pages + count; n++, page++) {
+        if (page >= bitmap_pages) {
+            page = 0;
+            run = 0;
+        }
+        
+        /* Skip full words */
+        if (!(page & 31) && bitmap[page >> 5] == 0xFFFFFFFF) {
+            page += 31;
+            n += 31;
+            run = 0;
+            continue;
+        }
+        if (page_used(page)) {
+            run = 0;
+            continue;
+        }
+        if (++run < count) continue;
+        
+        uint32_t first = page - count + 1;
+        for (uint32_t p = first; p <= page; p++) {
+            page_set_used(p);
+        }
+        free_pages -= count;
+        next_page = page + 1;
+        return (uintptr_t)first << PAGE_SHIFT;
+    }
+    return 0;
+}
+
+uintptr_t pmm_alloc_page(void) {
+    return pmm_alloc_pages(1);
+}
+
+void pmm_free_pages(uintptr_t addr, uint32_t count) {
+    uint32_t first = (uint32_t)(addr >> PAGE_SHIFT);
+    for (uint32_t p = first; p < first + count && p < bitmap_pages; p++) {
+        if (!page_used(p)) continue;    /* double free */
+        page_set_free(p);
+        free_pages++;
+    }
+}
+
+void pmm_free_page(uintptr_t addr) {
+    pmm_free_pages(addr, 1);
+}
+
+uint32_t pmm_total_pages(void) {
+    return total_pages;
+}
+
+uint32_t pmm_free_count(void) {
+    return free_pages;
+}
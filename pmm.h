@@ -0,0 +1,45 @@
+/*
+ * pmm.h - Physical memory manager for GegOS
+ * Page frames from the bootloader's memory map, one bit each.
+ */
+
+#ifndef PMM_H
+#define PMM_H
+
+#include <stdint.h>
+
+#define PAGE_SIZE  4096
+#define PAGE_SHIFT 12
+
+/* Memory map entry types (Multiboot 1 and 2 agree) */
+#define MEM_USABLE       1
+#define MEM_RESERVED     2
+#define MEM_ACPI         3
+#define MEM_NVS          4
+#define MEM_BAD          5
+
+typedef struct {
+    uint64_t base;
+    uint64_t length;
+    uint32_t type;
+} mem_region_t;
+
+/* Take over the usable regions. Everything below 1 MB, the kernel image
+ * and the bitmap itself stay reserved. Memory is used up to 4 GB, which
+ * is what both kernels can address. */
+void pmm_init(const mem_region_t* map, int count);
+
+/* Mark a range used, e.g. a framebuffer the map calls usable */
+void pmm_reserve(uint64_t base, uint64_t length);
+
+/* Contiguous page frames, physical address or 0 when out of memory */
+uintptr_t pmm_alloc_page(void);
+uintptr_t pmm_alloc_pages(uint32_t count);
+void pmm_free_page(uintptr_t addr);
+void pmm_free_pages(uintptr_t addr, uint32_t count);
+
+/* Page counts */
+uint32_t pmm_total_pages(void);
+uint32_t pmm_free_count(void);
+
+#endif /* PMM_H */
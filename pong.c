@@ -7,12 +7,14 @@
 #include "gui.h"
 #include "mouse.h"
 #include "io.h"
+#include "timer.h"
 
 #define PADDLE_WIDTH   8
 #define PADDLE_HEIGHT  40
 #define BALL_SIZE      4
 #define PONG_WIDTH     320
 #define PONG_HEIGHT    180
+#define PONG_FRAME_MS  16
 
 typedef struct {
     int x, y;
@@ -151,6 +153,7 @@ void pong_handle_mouse(int x, int y) {
 void pong_run(void) {
     pong_init();
     int frame_count = 0;
+    uint64_t next_frame = timer_ms();
     
     while (pong_running && frame_count < 300) {
         mouse_update();
@@ -160,10 +163,12 @@ void pong_run(void) {
         pong_update();
         pong_draw();
         pong_handle_mouse(mx, my);
+        vga_swap();  /* Present the frame at vsync */
         
         frame_count++;
         
         /* Limit game speed */
-        for (volatile int i = 0; i < 400000; i++);
+        next_frame += PONG_FRAME_MS;
+        sleep_until_ms(next_frame);
     }
 }
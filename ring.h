@@ -0,0 +1,48 @@
+/*
+ * ring.h - Single-producer/single-consumer byte ring for GegOS
+ * An IRQ handler fills it and the main loop drains it, without locks:
+ * each side only ever writes its own index.
+ */
+
+#ifndef RING_H
+#define RING_H
+
+#include <stdint.h>
+
+#define RING_SIZE 256   /* power of two */
+
+typedef struct {
+    volatile uint32_t head;     /* next write, producer only */
+    volatile uint32_t tail;     /* next read, consumer only */
+    uint32_t dropped;           /* bytes lost to a full ring */
+    uint8_t data[RING_SIZE];
+} ring_t;
+
+/* Producer side, returns 0 if the ring is full */
+static inline int ring_put(ring_t* r, uint8_t byte) {
+    uint32_t head = r->head;
+    if (head - r->tail == RING_SIZE) {
+        r->dropped++;
+        return 0;
+    }
+    r->data[head % RING_SIZE] = byte;
+    __asm__ volatile ("" ::: "memory");  /* data before index (x86 keeps store order) */
+    r->head = head + 1;
+    return 1;
+}
+
+/* Consumer side, returns 0 if the ring is empty */
+static inline int ring_get(ring_t* r, uint8_t* byte) {
+    uint32_t tail = r->tail;
+    if (tail == r->head) return 0;
+    *byte = r->data[tail % RING_SIZE];
+    __asm__ volatile ("" ::: "memory");  /* read before the slot is freed */
+    r->tail = tail + 1;
+    return 1;
+}
+
+static inline int ring_empty(const ring_t* r) {
+    return r->tail == r->head;
+}
+
+#endif /* RING_H */
@@ -0,0 +1,58 @@
+/*
+ * serial.c - COM1 serial port for GegOS
+ */
+
+#include "serial.h"
+#include "io.h"
+
+#define COM1            0x3F8
+#define UART_DATA       0       /* DLL while DLAB is set */
+#define UART_IER        1       /* DLM while DLAB is set */
+#define UART_FCR        2
+#define UART_LCR        3
+#define UART_MCR        4
+#define UART_LSR        5
+#define UART_SCRATCH    7
+
+#define LCR_8N1         0x03
+#define LCR_DLAB        0x80
+#define FCR_ENABLE      0xC7    /* enable and clear FIFOs, 14-byte trigger */
+#define MCR_DTR_RTS     0x03
+#define LSR_THR_EMPTY   0x20
+
+#define BAUD_DIVISOR    1       /* 115200 / 115200 */
+
+/* Give up on a character after this many status reads */
+#define TX_TIMEOUT      100000
+
+static int serial_present = 0;
+
+void serial_init(void) {
+    /* An absent UART reads back 0xFF, so check the scratch register */
+    outb(COM1 + UART_SCRATCH, 0x5A);
+    if (inb(COM1 + UART_SCRATCH) != 0x5A) return;
+    
+    outb(COM1 + UART_IER, 0x00);
+    outb(COM1 + UART_LCR, LCR_DLAB);
+    outb(COM1 + UART_DATA, BAUD_DIVISOR & 0xFF);
+    outb(COM1 + UART_IER, BAUD_DIVISOR >> 8);
+    outb(COM1 + UART_LCR, LCR_8N1);
+    outb(COM1 + UART_FCR, FCR_ENABLE);
+    outb(COM1 + UART_MCR, MCR_DTR_RTS);
+    serial_present = 1;
+}
+
+void serial_putc(char c) {
+    if (!serial_present) return;
+    for (int i = 0; i < TX_TIMEOUT; i++) {
+        if (inb(COM1 + UART_LSR) & LSR_THR_EMPTY) break;
+    }
+    outb(COM1 + UART_DATA, (uint8_t)c);
+}
+
+void serial_write(const char* str) {
+    while (*str) {
+        if (*str == '\n') serial_putc('\r');
+        serial_putc(*str++);
+    }
+}
@@ -0,0 +1,17 @@
+/*
+ * serial.h - COM1 serial port for GegOS
+ * Polled output only: enough for crash dumps and debug logs, which an
+ * emulator can send to a file or a terminal (qemu -serial stdio).
+ */
+
+#ifndef SERIAL_H
+#define SERIAL_H
+
+/* 115200 baud, 8N1. Safe to call with no UART fitted. */
+void serial_init(void);
+
+/* Write a character or string, waiting for the transmitter */
+void serial_putc(char c);
+void serial_write(const char* str);
+
+#endif /* SERIAL_H */
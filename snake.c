@@ -7,12 +7,14 @@
 #include "keyboard.h"
 #include "mouse.h"
 #include "io.h"
+#include "timer.h"
 
 #define GRID_SIZE    20   /* 20x20 grid */
 #define CELL_SIZE    10   /* Each cell is 10x10 pixels */
 #define GAME_WIDTH   (GRID_SIZE * CELL_SIZE)
 #define GAME_HEIGHT  (GRID_SIZE * CELL_SIZE)
 #define MAX_SNAKE    200
+#define FRAME_MS     20   /* snake moves every 5 frames */
 
 typedef struct {
     int x, y;  /* Grid coordinates */
@@ -246,6 +248,7 @@ void snake_handle_key(char key) {
 void snake_run(void) {
     snake_init();
     int frame_count = 0;
+    uint64_t next_frame = timer_ms();
     
     while (!game_over && frame_count < 6000) {
         /* Handle input */
@@ -262,10 +265,12 @@ void snake_run(void) {
             snake_update();
         }
         snake_draw();
+        vga_swap();  /* Present the frame at vsync */
         
         frame_count++;
         
         /* Frame delay */
-        for (volatile int i = 0; i < 800000; i++);
+        next_frame += FRAME_MS;
+        sleep_until_ms(next_frame);
     }
 }
@@ -0,0 +1,14 @@
+# symbols.awk - Kernel symbol table from `nm -n` output (see symbols.h)
+BEGIN {
+    print "/* Generated by symbols.awk - do not edit */"
+    print "#include \"symbols.h\""
+    print ""
+    print "const ksym_t kernel_symbols[] = {"
+}
+$2 == "T" || $2 == "t" {
+    printf "    { 0x%s, \"%s\" },\n", $1, $3
+}
+END {
+    print "    { 0, 0 }"
+    print "};"
+}
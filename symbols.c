@@ -0,0 +1,22 @@
+/*
+ * symbols.c - Kernel symbol table lookups for GegOS
+ */
+
+#include "symbols.h"
+
+/* From the linker scripts */
+extern char kernel_start[], text_end[];
+
+const char* ksym_lookup(uintptr_t addr, uintptr_t* offset) {
+    if (!kernel_symbols) return 0;
+    if (addr < (uintptr_t)kernel_start || addr >= (uintptr_t)text_end) return 0;
+    
+    /* Only read after a crash, so a linear scan will do */
+    const ksym_t* best = 0;
+    for (const ksym_t* s = kernel_symbols; s->name && s->addr <= addr; s++) {
+        best = s;
+    }
+    if (!best) return 0;
+    *offset = addr - best->addr;
+    return best->name;
+}
@@ -0,0 +1,25 @@
+/*
+ * symbols.h - Kernel symbol table for GegOS
+ * The Makefile links the kernel once, lists its functions with nm and
+ * links again with the list (symbols.awk). The table only adds .rodata,
+ * so no function moves between the two links.
+ */
+
+#ifndef SYMBOLS_H
+#define SYMBOLS_H
+
+#include <stdint.h>
+
+typedef struct {
+    uintptr_t addr;
+    const char* name;
+} ksym_t;
+
+/* Sorted by address, ends with { 0, 0 }. Weak: 0 in a kernel linked
+ * without it (the first link). */
+extern const ksym_t kernel_symbols[] __attribute__((weak));
+
+/* Function containing addr and the offset into it, 0 if unknown */
+const char* ksym_lookup(uintptr_t addr, uintptr_t* offset);
+
+#endif /* SYMBOLS_H */
@@ -4,18 +4,25 @@
 
 #include "terminal.h"
 #include "vga.h"
+#include "timer.h"
+#include "clock.h"
+#include "pmm.h"
+#include "heap.h"
+#include "arena.h"
+#include "paging.h"
 #include <stdint.h>
 
 #define MAX_CMD_LEN 64
 #define MAX_HISTORY 10
-#define MAX_OUTPUT_LINES 100
+#define MAX_OUTPUT_LINES 500  /* scrollback, lines are allocated as needed */
+#define LINE_HEIGHT 12
 
 static char cmd_buffer[MAX_CMD_LEN];
 static int cmd_pos = 0;
-static int last_cmd_pos = -1;  /* Track last cursor position */
-static char output_lines[MAX_OUTPUT_LINES][MAX_CMD_LEN];
+static char* output_lines[MAX_OUTPUT_LINES];
 static int output_count = 0;
-static int last_output_count = -1;  /* Track last output count */
+static kmem_cache_t text_lines;     /* MAX_CMD_LEN buffers for output_lines */
+static int text_lines_ready = 0;
 static int scroll_offset = 0;  /* Lines scrolled up from bottom */
 
 /* String utilities */
@@ -49,69 +56,119 @@ static int str_startswith(const char* str, const char* prefix) {
     return 1;
 }
 
+/* Append a decimal number, returns the new end of the string */
+static char* str_put_uint(char* dst, uint32_t v) {
+    char digits[10];
+    int n = 0;
+    do {
+        digits[n++] = '0' + (v % 10);
+        v /= 10;
+    } while (v);
+    while (n) *dst++ = digits[--n];
+    *dst = 0;
+    return dst;
+}
+
+static char* str_put(char* dst, const char* src) {
+    while (*src) *dst++ = *src++;
+    *dst = 0;
+    return dst;
+}
+
 /* Output helpers */
 static void add_output(const char* line) {
+    char* buf;
     if (output_count >= MAX_OUTPUT_LINES) {
-        /* Scroll up */
+        /* Scroll up, reusing the oldest line */
+        buf = output_lines[0];
         for (int i = 0; i < MAX_OUTPUT_LINES - 1; i++) {
-            str_cpy(output_lines[i], output_lines[i + 1]);
+            output_lines[i] = output_lines[i + 1];
         }
         output_count = MAX_OUTPUT_LINES - 1;
+    } else {
+        buf = kmem_cache_alloc(&text_lines);
+        if (!buf) return;
     }
-    str_cpy(output_lines[output_count], line);
-    output_count++;
+    str_cpy(buf, line);
+    output_lines[output_count++] = buf;
 }
 
-/* Simple in-memory filesystem */
-#define MAX_FS_ENTRIES 32
+static void clear_output(void) {
+    for (int i = 0; i < output_count; i++) {
+        kmem_cache_free(&text_lines, output_lines[i]);
+    }
+    output_count = 0;
+}
+
+/* Simple in-memory filesystem - entries come from the heap as they are
+ * created, so the only limit is memory */
 #define MAX_FILENAME 32
 #define MAX_FILECONTENT 256
 
-typedef struct {
+typedef struct fs_entry {
     char name[MAX_FILENAME];
     char content[MAX_FILECONTENT];
     int is_dir;
-    int exists;
+    struct fs_entry* next;
 } fs_entry_t;
 
-static fs_entry_t filesystem[MAX_FS_ENTRIES];
+static fs_entry_t* filesystem = 0;      /* in creation order */
+static kmem_cache_t fs_nodes;
 static char current_dir[MAX_CMD_LEN] = "/home/user";
 static int fs_initialized = 0;
 
 /* External password access */
 extern char lock_password[32];
 
-static void init_filesystem(void) {
-    if (fs_initialized) return;
-    
-    /* Initialize with some default directories and files */
-    for (int i = 0; i < MAX_FS_ENTRIES; i++) {
-        filesystem[i].exists = 0;
+static fs_entry_t* fs_find(const char* name) {
+    for (fs_entry_t* e = filesystem; e; e = e->next) {
+        if (str_cmp(e->name, name) == 0) return e;
     }
+    return 0;
+}
+
+/* Append a new entry, 0 when out of memory. Names are cut to fit. */
+static fs_entry_t* fs_create(const char* name, int is_dir) {
+    fs_entry_t* e = kmem_cache_alloc(&fs_nodes);
+    if (!e) return 0;
     
-    /* Default directories */
-    str_cpy(filesystem[0].name, "Desktop");
-    filesystem[0].is_dir = 1;
-    filesystem[0].exists = 1;
+    int i = 0;
+    while (name[i] && i < MAX_FILENAME - 1) {
+        e->name[i] = name[i];
+        i++;
+    }
+    e->name[i] = 0;
+    e->content[0] = 0;
+    e->is_dir = is_dir;
+    e->next = 0;
     
-    str_cpy(filesystem[1].name, "Documents");
-    filesystem[1].is_dir = 1;
-    filesystem[1].exists = 1;
+    fs_entry_t** link = &filesystem;
+    while (*link) link = &(*link)->next;
+    *link = e;
+    return e;
+}
+
+static void fs_remove(fs_entry_t* e) {
+    fs_entry_t** link = &filesystem;
+    while (*link != e) link = &(*link)->next;
+    *link = e->next;
+    kmem_cache_free(&fs_nodes, e);
+}
+
+static void init_filesystem(void) {
+    if (fs_initialized) return;
+    kmem_cache_init(&fs_nodes, "fs-node", sizeof(fs_entry_t));
     
-    str_cpy(filesystem[2].name, "Downloads");
-    filesystem[2].is_dir = 1;
-    filesystem[2].exists = 1;
+    /* Default directories */
+    fs_create("Desktop", 1);
+    fs_create("Documents", 1);
+    fs_create("Downloads", 1);
     
     /* Default files */
-    str_cpy(filesystem[3].name, "readme.txt");
-    str_cpy(filesystem[3].content, "Welcome to GegOS!");
-    filesystem[3].is_dir = 0;
-    filesystem[3].exists = 1;
-    
-    str_cpy(filesystem[4].name, "hello.txt");
-    str_cpy(filesystem[4].content, "Hello, World!");
-    filesystem[4].is_dir = 0;
-    filesystem[4].exists = 1;
+    fs_entry_t* e = fs_create("readme.txt", 0);
+    if (e) str_cpy(e->content, "Welcome to GegOS!");
+    e = fs_create("hello.txt", 0);
+    if (e) str_cpy(e->content, "Hello, World!");
     
     fs_initialized = 1;
 }
@@ -128,29 +185,34 @@ static void exec_help(void) {
     add_output("  touch FILE - Create empty file");
     add_output("  nano FILE  - Edit file (simulated)");
     add_output("  cat FILE   - Show file contents");
+    add_output("  rm NAME    - Remove file or directory");
     add_output("  passwd     - Change lock password");
     add_output("  uname      - System information");
+    add_output("  uptime     - Time since boot");
+    add_output("  free       - Memory usage");
+    add_output("  slabinfo   - Heap caches");
+    add_output("  perf       - Main loop timings");
+    add_output("  perf reset - Restart the timings");
+    add_output("  vram wc|uc - Framebuffer write-combined/uncached");
     add_output("  echo TEXT  - Print text");
 }
 
 static void exec_clear(void) {
-    output_count = 0;
+    clear_output();
     scroll_offset = 0;
 }
 
 static void exec_ls(void) {
     init_filesystem();
-    for (int i = 0; i < MAX_FS_ENTRIES; i++) {
-        if (filesystem[i].exists) {
-            char line[MAX_CMD_LEN];
-            str_cpy(line, filesystem[i].name);
-            if (filesystem[i].is_dir) {
-                int len = str_len(line);
-                line[len] = '/';
-                line[len+1] = 0;
-            }
-            add_output(line);
+    for (fs_entry_t* e = filesystem; e; e = e->next) {
+        char line[MAX_CMD_LEN];
+        str_cpy(line, e->name);
+        if (e->is_dir) {
+            int len = str_len(line);
+            line[len] = '/';
+            line[len+1] = 0;
         }
+        add_output(line);
     }
 }
 
@@ -187,17 +249,11 @@ static void exec_mkdir(const char* args) {
         return;
     }
     const char* dirname = args + 6;
-    /* Find free slot */
-    for (int i = 0; i < MAX_FS_ENTRIES; i++) {
-        if (!filesystem[i].exists) {
-            str_cpy(filesystem[i].name, dirname);
-            filesystem[i].is_dir = 1;
-            filesystem[i].exists = 1;
-            add_output("Directory created");
-            return;
-        }
+    if (fs_create(dirname, 1)) {
+        add_output("Directory created");
+    } else {
+        add_output("Error: No space for new directory");
     }
-    add_output("Error: No space for new directory");
 }
 
 static void exec_touch(const char* args) {
@@ -207,36 +263,13 @@ static void exec_touch(const char* args) {
         return;
     }
     const char* filename = args + 6;
-    /* Check if exists */
-    for (int i = 0; i < MAX_FS_ENTRIES; i++) {
-        if (filesystem[i].exists) {
-            int match = 1;
-            int j = 0;
-            while (filesystem[i].name[j] || filename[j]) {
-                if (filesystem[i].name[j] != filename[j]) {
-                    match = 0;
-                    break;
-                }
-                j++;
-            }
-            if (match) {
-                add_output("File already exists");
-                return;
-            }
-        }
-    }
-    /* Find free slot */
-    for (int i = 0; i < MAX_FS_ENTRIES; i++) {
-        if (!filesystem[i].exists) {
-            str_cpy(filesystem[i].name, filename);
-            filesystem[i].content[0] = 0;
-            filesystem[i].is_dir = 0;
-            filesystem[i].exists = 1;
-            add_output("File created");
-            return;
-        }
+    if (fs_find(filename)) {
+        add_output("File already exists");
+    } else if (fs_create(filename, 0)) {
+        add_output("File created");
+    } else {
+        add_output("Error: No space for new file");
     }
-    add_output("Error: No space for new file");
 }
 
 static void exec_cat(const char* args) {
@@ -246,28 +279,30 @@ static void exec_cat(const char* args) {
         return;
     }
     const char* filename = args + 4;
-    for (int i = 0; i < MAX_FS_ENTRIES; i++) {
-        if (filesystem[i].exists && !filesystem[i].is_dir) {
-            int match = 1;
-            int j = 0;
-            while (filesystem[i].name[j] || filename[j]) {
-                if (filesystem[i].name[j] != filename[j]) {
-                    match = 0;
-                    break;
-                }
-                j++;
-            }
-            if (match) {
-                if (filesystem[i].content[0]) {
-                    add_output(filesystem[i].content);
-                } else {
-                    add_output("(empty file)");
-                }
-                return;
-            }
-        }
+    fs_entry_t* e = fs_find(filename);
+    if (!e || e->is_dir) {
+        add_output("File not found");
+    } else if (e->content[0]) {
+        add_output(e->content);
+    } else {
+        add_output("(empty file)");
+    }
+}
+
+static void exec_rm(const char* args) {
+    init_filesystem();
+    if (str_len(args) <= 3) {
+        add_output("Usage: rm <name>");
+        return;
+    }
+    fs_entry_t* e = fs_find(args + 3);
+    if (!e) {
+        add_output("File not found");
+        return;
     }
-    add_output("File not found");
+    int is_dir = e->is_dir;
+    fs_remove(e);
+    add_output(is_dir ? "Directory removed" : "File removed");
 }
 
 static void exec_nano(const char* args) {
@@ -328,6 +363,131 @@ static void exec_ver(void) {
     add_output("(c) 2026 GegOS Corporation.");
 }
 
+static void exec_uptime(void) {
+    char line[MAX_CMD_LEN];
+    uint32_t secs = (uint32_t)timer_ms() / 1000;     /* wraps after 49 days */
+    
+    char* p = str_put(line, "up ");
+    p = str_put_uint(p, secs / 3600);
+    p = str_put(p, "h ");
+    p = str_put_uint(p, secs / 60 % 60);
+    p = str_put(p, "m ");
+    p = str_put_uint(p, secs % 60);
+    p = str_put(p, "s");
+    add_output(line);
+    
+    p = str_put(line, "TSC ");
+    if (clock_tsc_khz()) {
+        p = str_put_uint(p, clock_tsc_khz() / 1000);
+        p = str_put(p, " MHz");
+    } else {
+        p = str_put(p, "not calibrated");
+    }
+    add_output(line);
+}
+
+static void exec_free(void) {
+    char line[MAX_CMD_LEN];
+    uint32_t total = pmm_total_pages() * (PAGE_SIZE / 1024);
+    uint32_t avail = pmm_free_count() * (PAGE_SIZE / 1024);
+    
+    char* p = str_put(line, "Mem: ");
+    p = str_put_uint(p, total);
+    p = str_put(p, " KB total, ");
+    p = str_put_uint(p, total - avail);
+    p = str_put(p, " KB used, ");
+    p = str_put_uint(p, avail);
+    p = str_put(p, " KB free");
+    add_output(line);
+}
+
+/* Per cache: objects in use of the slots its slabs hold, and the bytes
+ * the free slots waste */
+static void exec_slabinfo(void) {
+    char line[MAX_CMD_LEN];
+    add_output("cache          size  used/slots  slabs  idle KB");
+    
+    for (kmem_cache_t* c = kmem_caches(); c; c = c->next) {
+        uint32_t slots = c->slabs * c->per_slab;
+        char* p = str_put(line, c->name);
+        while (p < line + 13) *p++ = ' ';
+        p = str_put(p, "  ");
+        p = str_put_uint(p, c->object_size);
+        p = str_put(p, "  ");
+        p = str_put_uint(p, c->in_use);
+        p = str_put(p, "/");
+        p = str_put_uint(p, slots);
+        p = str_put(p, "  ");
+        p = str_put_uint(p, c->slabs);
+        p = str_put(p, "  ");
+        p = str_put_uint(p, (slots - c->in_use) * c->object_size / 1024);
+        add_output(line);
+    }
+    
+    heap_large_stats_t large;
+    heap_large_stats(&large);
+    char* p = str_put(line, "large: ");
+    p = str_put_uint(p, large.blocks);
+    p = str_put(p, " blocks, ");
+    p = str_put_uint(p, large.pages * (PAGE_SIZE / 1024));
+    p = str_put(p, " KB for ");
+    p = str_put_uint(p, large.requested / 1024);
+    p = str_put(p, " KB asked");
+    add_output(line);
+}
+
+/* Every timing stat that has taken a sample */
+static void exec_perf(void) {
+    char line[MAX_CMD_LEN];
+    add_output("name        count   avg us   max us");
+    
+    for (clock_stat_t* s = clock_stats(); s; s = s->next) {
+        char* p = str_put(line, s->name);
+        while (p < line + 10) *p++ = ' ';
+        p = str_put(p, "  ");
+        p = str_put_uint(p, s->count);
+        p = str_put(p, "  ");
+        p = str_put_uint(p, clock_stat_avg_us(s));
+        p = str_put(p, "  ");
+        p = str_put_uint(p, clock_stat_max_us(s));
+        add_output(line);
+    }
+    
+    char* p = str_put(line, "frame arena: peak ");
+    p = str_put_uint(p, frame_arena.peak / 1024);
+    p = str_put(p, " of ");
+    p = str_put_uint(p, frame_arena.size / 1024);
+    p = str_put(p, " KB, ");
+    p = str_put_uint(p, frame_arena.failed);
+    p = str_put(p, " misses");
+    add_output(line);
+}
+
+static void exec_perf_reset(void) {
+    for (clock_stat_t* s = clock_stats(); s; s = s->next) {
+        clock_stat_reset(s);
+    }
+    add_output("Timings reset");
+}
+
+/* Switch the framebuffer's memory type, to compare present times */
+static void exec_vram(const char* args) {
+    int type;
+    if (str_cmp(args, "vram wc") == 0) {
+        type = PAGE_CACHE_WRITECOMBINE;
+    } else if (str_cmp(args, "vram uc") == 0) {
+        type = PAGE_CACHE_UNCACHED;
+    } else {
+        add_output("Usage: vram wc|uc");
+        return;
+    }
+    if (vga_set_framebuffer_cache(type)) {
+        add_output(type == PAGE_CACHE_UNCACHED ? "Framebuffer uncached" : "Framebuffer write-combined");
+    } else {
+        add_output("No linear framebuffer in this mode");
+    }
+}
+
 static void exec_echo(const char* args) {
     if (str_len(args) > 5) {
         add_output(args + 5);
@@ -363,12 +523,26 @@ static void exec_command(const char* cmd) {
         exec_touch(cmd);
     } else if (str_startswith(cmd, "cat ")) {
         exec_cat(cmd);
+    } else if (str_startswith(cmd, "rm ")) {
+        exec_rm(cmd);
     } else if (str_startswith(cmd, "nano ")) {
         exec_nano(cmd);
     } else if (str_startswith(cmd, "passwd")) {
         exec_passwd(cmd);
     } else if (str_cmp(cmd, "uname") == 0) {
         exec_uname();
+    } else if (str_cmp(cmd, "uptime") == 0) {
+        exec_uptime();
+    } else if (str_cmp(cmd, "free") == 0) {
+        exec_free();
+    } else if (str_cmp(cmd, "slabinfo") == 0) {
+        exec_slabinfo();
+    } else if (str_cmp(cmd, "perf") == 0) {
+        exec_perf();
+    } else if (str_cmp(cmd, "perf reset") == 0) {
+        exec_perf_reset();
+    } else if (str_startswith(cmd, "vram")) {
+        exec_vram(cmd);
     } else if (str_cmp(cmd, "apt list") == 0) {
         exec_apt_list();
     } else if (str_cmp(cmd, "apt update") == 0) {
@@ -385,8 +559,13 @@ static void exec_command(const char* cmd) {
 }
 
 void terminal_init(void) {
+    if (!text_lines_ready) {
+        kmem_cache_init(&text_lines, "text-line", MAX_CMD_LEN);
+        text_lines_ready = 1;
+    }
+    
     cmd_pos = 0;
-    output_count = 0;
+    clear_output();
     cmd_buffer[0] = 0;
     
     add_output("GegOS Terminal v2.1");
@@ -427,73 +606,65 @@ void terminal_scroll_down(void) {
     if (scroll_offset < 0) scroll_offset = 0;
 }
 
-void terminal_draw(int x, int y, int width, int height) {
-    int line_height = 12;
-    (void)y;  /* Suppress unused warning */
-    int max_lines = (height - 30) / line_height;
-    
-    /* Calculate visible range with scroll offset */
-    int end_line = output_count - scroll_offset;
-    int start_line = (end_line > max_lines) ? (end_line - max_lines) : 0;
-    
-    /* Clamp scroll offset */
-    if (scroll_offset < 0) scroll_offset = 0;
+/* Output lines that fit an area of the given height, after clamping the scroll */
+static void visible_range(int height, int* start_line, int* end_line) {
+    int max_lines = (height - 30) / LINE_HEIGHT;
     if (scroll_offset > output_count - max_lines && output_count > max_lines) {
         scroll_offset = output_count - max_lines;
     }
+    if (scroll_offset < 0) scroll_offset = 0;
     
-    /* Force redraw if scroll changed or output changed */
-    static int last_scroll_offset = -1;
-    if (last_output_count != output_count || last_scroll_offset != scroll_offset) {
-        /* Gray background */
-        vga_fillrect(x, y, width, height, COLOR_LIGHT_GRAY);
-        
-        /* Black terminal area (sunken) */
-        int term_x = x + 3;
-        int term_y = y + 3;
-        int term_w = width - 6;
-        int term_h_inner = height - 6;
-
-        vga_fillrect(term_x, term_y, term_w, term_h_inner, COLOR_BLACK);
-        /* Sunken border */
-        vga_hline(term_x, term_y, term_w, COLOR_DARK_GRAY);
-        vga_vline(term_x, term_y, term_h_inner, COLOR_DARK_GRAY);
-        vga_hline(term_x, term_y + term_h_inner - 1, term_w, COLOR_WHITE);
-        vga_vline(term_x + term_w - 1, term_y, term_h_inner, COLOR_WHITE);
-        
-        /* Draw output lines */
-        for (int i = start_line; i < end_line && i < output_count; i++) {
-            int line_y = term_y + 5 + (i - start_line) * line_height;
-            vga_putstring(term_x + 5, line_y, output_lines[i], COLOR_WHITE, COLOR_BLACK);
-        }
-        last_output_count = output_count;
-        last_scroll_offset = scroll_offset;
-    }
+    *end_line = output_count - scroll_offset;
+    *start_line = (*end_line > max_lines) ? (*end_line - max_lines) : 0;
+}
+
+/* Offset of the prompt line from the top of the terminal area, -1 if hidden */
+int terminal_prompt_y(int height) {
+    int start_line, end_line;
+    visible_range(height, &start_line, &end_line);
+    if (scroll_offset != 0) return -1;
+    
+    int prompt_y = 3 + 5 + (end_line - start_line) * LINE_HEIGHT;
+    if (prompt_y >= height - 15) return -1;
+    return prompt_y;
+}
+
+void terminal_draw(int x, int y, int width, int height) {
+    int start_line, end_line;
+    visible_range(height, &start_line, &end_line);
     
-    /* Draw prompt line only if at bottom */
+    /* Gray background */
+    vga_fillrect(x, y, width, height, COLOR_LIGHT_GRAY);
+        
+    /* Black terminal area (sunken) */
     int term_x = x + 3;
     int term_y = y + 3;
-    (void)height;  /* Used in calculations above */
-    
-    if (scroll_offset == 0) {
-        int visible_lines = (end_line - start_line);
-        int prompt_y = term_y + 5 + visible_lines * line_height;
+    int term_w = width - 6;
+    int term_h_inner = height - 6;
+
+    vga_fillrect(term_x, term_y, term_w, term_h_inner, COLOR_BLACK);
+    /* Sunken border */
+    vga_hline(term_x, term_y, term_w, COLOR_DARK_GRAY);
+    vga_vline(term_x, term_y, term_h_inner, COLOR_DARK_GRAY);
+    vga_hline(term_x, term_y + term_h_inner - 1, term_w, COLOR_WHITE);
+    vga_vline(term_x + term_w - 1, term_y, term_h_inner, COLOR_WHITE);
         
-        if (prompt_y < y + height - 15) {
-            /* Only redraw prompt line if cursor position changed */
-            if (last_cmd_pos != cmd_pos) {
-                /* Clear only the prompt line */
-                vga_fillrect(term_x, prompt_y, width - 6, line_height, COLOR_BLACK);
-                
-                vga_putstring(term_x + 5, prompt_y, "$ ", COLOR_LIGHT_GREEN, COLOR_BLACK);
-                vga_putstring(term_x + 20, prompt_y, cmd_buffer, COLOR_WHITE, COLOR_BLACK);
-                
-                /* Cursor */
-                int cursor_x = term_x + 20 + (cmd_pos * 8);
-                vga_fillrect(cursor_x, prompt_y, 8, 10, COLOR_WHITE);
+    /* Draw output lines */
+    for (int i = start_line; i < end_line && i < output_count; i++) {
+        int line_y = term_y + 5 + (i - start_line) * LINE_HEIGHT;
+        if (!vga_clip_visible(term_x, line_y, term_w, 8)) continue;
+        vga_putstring(term_x + 5, line_y, output_lines[i], COLOR_WHITE, COLOR_BLACK);
+    }
+    
+    /* Prompt line, only when scrolled to the bottom */
+    int prompt_y = terminal_prompt_y(height);
+    if (prompt_y >= 0) {
+        prompt_y += y;
+        vga_putstring(term_x + 5, prompt_y, "$ ", COLOR_LIGHT_GREEN, COLOR_BLACK);
+        vga_putstring(term_x + 20, prompt_y, cmd_buffer, COLOR_WHITE, COLOR_BLACK);
                 
-                last_cmd_pos = cmd_pos;
-            }
-        }
+        /* Cursor */
+        int cursor_x = term_x + 20 + (cmd_pos * 8);
+        vga_fillrect(cursor_x, prompt_y, 8, 10, COLOR_WHITE);
     }
 }
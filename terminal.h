@@ -8,6 +8,7 @@
 void terminal_init(void);
 void terminal_handle_key(char c);
 void terminal_draw(int x, int y, int width, int height);
+int terminal_prompt_y(int height);
 void terminal_scroll_up(void);
 void terminal_scroll_down(void);
 
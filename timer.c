@@ -0,0 +1,158 @@
+/*
+ * timer.c - PIT system timer for GegOS
+ * IRQ0 counts ticks. Callback timers hang in a timer wheel: one list per
+ * slot, indexed by expiry tick, so starting, stopping and each tick are
+ * O(1) however many timers exist. A late timer_run() walks at most one
+ * turn of the wheel, and an empty wheel just jumps to the current tick.
+ * Callbacks run from the main loop.
+ */
+
+#include "timer.h"
+#include "io.h"
+#include "event.h"
+#include "interrupt.h"
+
+/* 8253/8254 PIT */
+#define PIT_FREQUENCY  1193182
+#define PIT_CHANNEL0   0x40
+#define PIT_COMMAND    0x43
+#define PIT_RATE_GEN   0x34     /* channel 0, lobyte/hibyte, mode 2 */
+#define PIT_MIN_HZ     19       /* divisor has to fit 16 bits */
+#define PIT_MAX_HZ     10000
+
+#define WHEEL_SLOTS    256      /* power of two */
+
+static volatile uint64_t ticks = 0;
+static uint32_t tick_hz = 0;
+/* 16.16 fixed point, so the 32-bit kernel needs no 64-bit division */
+static uint32_t ms_per_tick = 0;
+static uint32_t ticks_per_ms = 0;
+
+static timer_entry_t* wheel[WHEEL_SLOTS];
+static uint64_t wheel_tick = 0;     /* last tick timer_run() handled */
+static uint32_t armed = 0;          /* timers in the wheel */
+
+/* IRQ0 - count, and wake the main loop if this tick's slot has timers */
+static void timer_irq(void) {
+    uint64_t now = ticks + 1;
+    ticks = now;
+    if (wheel[now % WHEEL_SLOTS]) event_post(EVENT_TIMER);
+}
+
+void timer_init(uint32_t hz) {
+    if (hz < PIT_MIN_HZ) hz = PIT_MIN_HZ;
+    if (hz > PIT_MAX_HZ) hz = PIT_MAX_HZ;
+    uint32_t divisor = PIT_FREQUENCY / hz;
+    tick_hz = PIT_FREQUENCY / divisor;
+    ms_per_tick = (1000u << 16) / tick_hz;
+    ticks_per_ms = (tick_hz << 16) / 1000;
+    
+    outb(PIT_COMMAND, PIT_RATE_GEN);
+    outb(PIT_CHANNEL0, divisor & 0xFF);
+    outb(PIT_CHANNEL0, (divisor >> 8) & 0xFF);
+    
+    wheel_tick = timer_ticks();
+    irq_install(IRQ_TIMER, timer_irq);
+}
+
+/* The IRQ is the only writer; on 32-bit the two halves are read apart */
+uint64_t timer_ticks(void) {
+    uint64_t t;
+    do {
+        t = ticks;
+    } while (t != ticks);
+    return t;
+}
+
+uint32_t timer_hz(void) {
+    return tick_hz;
+}
+
+uint64_t timer_ms(void) {
+    return (timer_ticks() * ms_per_tick) >> 16;
+}
+
+static uint64_t ms_to_ticks(uint32_t ms) {
+    return ((uint64_t)ms * ticks_per_ms + 0xFFFF) >> 16;
+}
+
+void sleep_until_ms(uint64_t deadline_ms) {
+    while (timer_ms() < deadline_ms) {
+        hlt();
+    }
+}
+
+void sleep_ms(uint32_t ms) {
+    sleep_until_ms(timer_ms() + ms);
+}
+
+/* Hang a timer in the slot of its expiry tick */
+static void wheel_insert(timer_entry_t* t) {
+    /* Ticks timer_run() has already passed would wait a whole turn */
+    if (t->expires <= wheel_tick) t->expires = wheel_tick + 1;
+    
+    timer_entry_t** slot = &wheel[t->expires % WHEEL_SLOTS];
+    t->next = *slot;
+    if (t->next) t->next->link = &t->next;
+    t->link = slot;
+    *slot = t;
+    armed++;
+    
+    /* Already due: the IRQ may have passed this slot */
+    if (t->expires <= timer_ticks()) event_post(EVENT_TIMER);
+}
+
+static void wheel_remove(timer_entry_t* t) {
+    *t->link = t->next;
+    if (t->next) t->next->link = t->link;
+    t->link = 0;
+    armed--;
+}
+
+void timer_start(timer_entry_t* t, uint32_t ms, uint32_t period_ms,
+                 void (*callback)(void* data), void* data) {
+    if (t->link) wheel_remove(t);
+    uint64_t now = timer_ticks();
+    if (!armed) wheel_tick = now;   /* nothing between here and now to run */
+    t->expires = now + ms_to_ticks(ms);
+    t->period = period_ms ? ms_to_ticks(period_ms) : 0;
+    t->callback = callback;
+    t->data = data;
+    wheel_insert(t);
+}
+
+void timer_stop(timer_entry_t* t) {
+    if (t->link) wheel_remove(t);
+}
+
+void timer_run(void) {
+    uint64_t now = timer_ticks();
+    
+    /* More than a turn behind (the main loop was busy): one turn visits
+     * every slot, and overdue timers fire in slot order */
+    if (now - wheel_tick > WHEEL_SLOTS) wheel_tick = now - WHEEL_SLOTS;
+    
+    while (wheel_tick < now && armed) {
+        wheel_tick++;
+        
+        /* A slot also holds timers for later turns of the wheel. Rescan
+         * after each callback, since it may start or stop any timer. */
+        timer_entry_t* t = wheel[wheel_tick % WHEEL_SLOTS];
+        while (t) {
+            if (t->expires > wheel_tick) {
+                t = t->next;
+                continue;
+            }
+            wheel_remove(t);
+            if (t->period) {
+                /* Periods missed while the main loop was busy are dropped */
+                t->expires += t->period;
+                if (t->expires <= now) t->expires = now + t->period;
+                wheel_insert(t);
+            }
+            t->callback(t->data);
+            t = wheel[wheel_tick % WHEEL_SLOTS];
+        }
+    }
+    if (!armed) wheel_tick = now;
+}
@@ -0,0 +1,43 @@
+/*
+ * timer.h - PIT system timer for GegOS
+ */
+
+#ifndef TIMER_H
+#define TIMER_H
+
+#include <stdint.h>
+
+/* Default tick rate */
+#define TIMER_HZ 1000
+
+/* Callback timer. The caller owns the struct; keep it alive while started. */
+typedef struct timer_entry {
+    uint64_t expires;               /* tick it fires on */
+    uint32_t period;                /* ticks between repeats, 0 = once */
+    void (*callback)(void* data);   /* runs from timer_run(), not the IRQ */
+    void* data;
+    struct timer_entry* next;
+    struct timer_entry** link;      /* pointer pointing at us, 0 if stopped */
+} timer_entry_t;
+
+/* Program PIT channel 0 for hz ticks per second and hook IRQ0 */
+void timer_init(uint32_t hz);
+
+/* Monotonic time since timer_init */
+uint64_t timer_ticks(void);
+uint32_t timer_hz(void);
+uint64_t timer_ms(void);
+
+/* Halt until time has passed (needs interrupts on) */
+void sleep_ms(uint32_t ms);
+void sleep_until_ms(uint64_t deadline_ms);
+
+/* Run callback after ms, then every period_ms if that is not 0 */
+void timer_start(timer_entry_t* t, uint32_t ms, uint32_t period_ms,
+                 void (*callback)(void* data), void* data);
+void timer_stop(timer_entry_t* t);
+
+/* Run the callbacks that are due - call on EVENT_TIMER */
+void timer_run(void);
+
+#endif /* TIMER_H */
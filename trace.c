@@ -0,0 +1,31 @@
+/*
+ * trace.c - Kernel event trace for GegOS
+ */
+
+#include "trace.h"
+#include "clock.h"
+#include "io.h"
+
+static trace_entry_t entries[TRACE_SIZE];
+static uint32_t next = 0;
+
+void trace(const char* what, uintptr_t arg) {
+    /* IRQ handlers trace too: keep them off the slot being filled */
+    int irqs = interrupts_enabled();
+    cli();
+    trace_entry_t* e = &entries[next & (TRACE_SIZE - 1)];
+    e->cycles = now_cycles();
+    e->what = what;
+    e->arg = arg;
+    next++;
+    if (irqs) sti();
+}
+
+uint32_t trace_count(void) {
+    return next;
+}
+
+const trace_entry_t* trace_get(uint32_t n) {
+    if (n >= next || n >= TRACE_SIZE) return 0;
+    return &entries[(next - 1 - n) & (TRACE_SIZE - 1)];
+}
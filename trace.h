@@ -0,0 +1,29 @@
+/*
+ * trace.h - Kernel event trace for GegOS
+ * A ring of the last few things the kernel did, kept for crash dumps.
+ * Recording costs an rdtsc and three stores, so it can stay on.
+ */
+
+#ifndef TRACE_H
+#define TRACE_H
+
+#include <stdint.h>
+
+#define TRACE_SIZE 64           /* entries kept, a power of two */
+
+typedef struct {
+    uint64_t cycles;            /* TSC when recorded */
+    const char* what;           /* a string literal */
+    uintptr_t arg;
+} trace_entry_t;
+
+/* Record an event (also from interrupt handlers) */
+void trace(const char* what, uintptr_t arg);
+
+/* Entries recorded since boot */
+uint32_t trace_count(void);
+
+/* The n-th most recent entry (0 = newest), 0 once it has been overwritten */
+const trace_entry_t* trace_get(uint32_t n);
+
+#endif /* TRACE_H */
@@ -1,190 +1,80 @@
 /*
- * vga.c - VGA Graphics Driver for GegOS
- * Mode 12h: 640x480, 16 colors, planar
+ * vga.c - Graphics front end for GegOS
+ * Clipping, shadow framebuffer and mode switching on top of the display
+ * drivers (Mode 12h planar, Mode 13h chunky, BGA and bootloader LFB)
  */
 
 #include "vga.h"
+#include "display.h"
+#include "font.h"
 #include "io.h"
+#include "trace.h"
+#include "paging.h"
 
-/* VGA framebuffer address */
-static uint8_t* const VGA_MEMORY = (uint8_t*)0xA0000;
-
-/* VGA registers */
-#define VGA_MISC_WRITE      0x3C2
-#define VGA_SEQ_INDEX       0x3C4
-#define VGA_SEQ_DATA        0x3C5
-#define VGA_CRTC_INDEX      0x3D4
-#define VGA_CRTC_DATA       0x3D5
-#define VGA_GC_INDEX        0x3CE
-#define VGA_GC_DATA         0x3CF
-#define VGA_AC_INDEX        0x3C0
-#define VGA_AC_WRITE        0x3C0
-#define VGA_INSTAT_READ     0x3DA
-
-/* Graphics controller registers */
-#define GC_GRAPHICS_MODE    0x05
-#define GC_BIT_MASK         0x08
-#define GC_READ_MAP_SELECT  0x04
-
-/* Sequencer registers */
-#define SEQ_MAP_MASK        0x02
-
-/* Mode 12h register values (640x480, 16 color) */
-static const uint8_t mode12h_misc = 0xE3;
-
-static const uint8_t mode12h_seq[] = {
-    0x03, 0x01, 0x0F, 0x00, 0x06
-};
+/* Screen size of the current mode */
+int screen_width = 640;
+int screen_height = 480;
 
-static const uint8_t mode12h_crtc[] = {
-    0x5F, 0x4F, 0x50, 0x82, 0x54, 0x80, 0x0B, 0x3E,
-    0x00, 0x40, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
-    0xEA, 0x0C, 0xDF, 0x28, 0x00, 0xE7, 0x04, 0xE3,
-    0xFF
+/* Standard 16-colour VGA palette as 0x00RRGGBB */
+const uint32_t display_palette[16] = {
+    0x000000, 0x0000AA, 0x00AA00, 0x00AAAA,
+    0xAA0000, 0xAA00AA, 0xAA5500, 0xAAAAAA,
+    0x555555, 0x5555FF, 0x55FF55, 0x55FFFF,
+    0xFF5555, 0xFF55FF, 0xFFFF55, 0xFFFFFF
 };
 
-static const uint8_t mode12h_gc[] = {
-    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x05, 0x0F,
-    0xFF
-};
+/* Active driver */
+static display_driver_t* drv = &planar_driver;
 
-static const uint8_t mode12h_ac[] = {
-    0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x14, 0x07,
-    0x38, 0x39, 0x3A, 0x3B, 0x3C, 0x3D, 0x3E, 0x3F,
-    0x01, 0x00, 0x0F, 0x00, 0x00
-};
+/* Current mode (VGA_MODE_*) */
+static int current_vga_mode = VGA_MODE_640x480;
 
-/* Simple 8x8 bitmap font */
-static const uint8_t font8x8[128][8] = {
-    [0 ... 31] = {0,0,0,0,0,0,0,0},
-    [' '] = {0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00},
-    ['!'] = {0x18,0x18,0x18,0x18,0x18,0x00,0x18,0x00},
-    ['"'] = {0x6C,0x6C,0x24,0x00,0x00,0x00,0x00,0x00},
-    ['#'] = {0x6C,0x6C,0xFE,0x6C,0xFE,0x6C,0x6C,0x00},
-    ['$'] = {0x18,0x7E,0xC0,0x7C,0x06,0xFC,0x18,0x00},
-    ['%'] = {0x00,0xC6,0xCC,0x18,0x30,0x66,0xC6,0x00},
-    ['&'] = {0x38,0x6C,0x38,0x76,0xDC,0xCC,0x76,0x00},
-    [39]  = {0x18,0x18,0x30,0x00,0x00,0x00,0x00,0x00},
-    ['('] = {0x0C,0x18,0x30,0x30,0x30,0x18,0x0C,0x00},
-    [')'] = {0x30,0x18,0x0C,0x0C,0x0C,0x18,0x30,0x00},
-    ['*'] = {0x00,0x66,0x3C,0xFF,0x3C,0x66,0x00,0x00},
-    ['+'] = {0x00,0x18,0x18,0x7E,0x18,0x18,0x00,0x00},
-    [','] = {0x00,0x00,0x00,0x00,0x00,0x18,0x18,0x30},
-    ['-'] = {0x00,0x00,0x00,0x7E,0x00,0x00,0x00,0x00},
-    ['.'] = {0x00,0x00,0x00,0x00,0x00,0x18,0x18,0x00},
-    ['/'] = {0x06,0x0C,0x18,0x30,0x60,0xC0,0x80,0x00},
-    ['0'] = {0x7C,0xC6,0xCE,0xD6,0xE6,0xC6,0x7C,0x00},
-    ['1'] = {0x18,0x38,0x18,0x18,0x18,0x18,0x7E,0x00},
-    ['2'] = {0x7C,0xC6,0x06,0x1C,0x30,0x66,0xFE,0x00},
-    ['3'] = {0x7C,0xC6,0x06,0x3C,0x06,0xC6,0x7C,0x00},
-    ['4'] = {0x1C,0x3C,0x6C,0xCC,0xFE,0x0C,0x1E,0x00},
-    ['5'] = {0xFE,0xC0,0xC0,0xFC,0x06,0xC6,0x7C,0x00},
-    ['6'] = {0x38,0x60,0xC0,0xFC,0xC6,0xC6,0x7C,0x00},
-    ['7'] = {0xFE,0xC6,0x0C,0x18,0x30,0x30,0x30,0x00},
-    ['8'] = {0x7C,0xC6,0xC6,0x7C,0xC6,0xC6,0x7C,0x00},
-    ['9'] = {0x7C,0xC6,0xC6,0x7E,0x06,0x0C,0x78,0x00},
-    [':'] = {0x00,0x18,0x18,0x00,0x00,0x18,0x18,0x00},
-    [';'] = {0x00,0x18,0x18,0x00,0x00,0x18,0x18,0x30},
-    ['<'] = {0x06,0x0C,0x18,0x30,0x18,0x0C,0x06,0x00},
-    ['='] = {0x00,0x00,0x7E,0x00,0x00,0x7E,0x00,0x00},
-    ['>'] = {0x60,0x30,0x18,0x0C,0x18,0x30,0x60,0x00},
-    ['?'] = {0x7C,0xC6,0x0C,0x18,0x18,0x00,0x18,0x00},
-    ['@'] = {0x7C,0xC6,0xDE,0xDE,0xDE,0xC0,0x78,0x00},
-    ['A'] = {0x38,0x6C,0xC6,0xFE,0xC6,0xC6,0xC6,0x00},
-    ['B'] = {0xFC,0x66,0x66,0x7C,0x66,0x66,0xFC,0x00},
-    ['C'] = {0x3C,0x66,0xC0,0xC0,0xC0,0x66,0x3C,0x00},
-    ['D'] = {0xF8,0x6C,0x66,0x66,0x66,0x6C,0xF8,0x00},
-    ['E'] = {0xFE,0x62,0x68,0x78,0x68,0x62,0xFE,0x00},
-    ['F'] = {0xFE,0x62,0x68,0x78,0x68,0x60,0xF0,0x00},
-    ['G'] = {0x3C,0x66,0xC0,0xC0,0xCE,0x66,0x3A,0x00},
-    ['H'] = {0xC6,0xC6,0xC6,0xFE,0xC6,0xC6,0xC6,0x00},
-    ['I'] = {0x3C,0x18,0x18,0x18,0x18,0x18,0x3C,0x00},
-    ['J'] = {0x1E,0x0C,0x0C,0x0C,0xCC,0xCC,0x78,0x00},
-    ['K'] = {0xE6,0x66,0x6C,0x78,0x6C,0x66,0xE6,0x00},
-    ['L'] = {0xF0,0x60,0x60,0x60,0x62,0x66,0xFE,0x00},
-    ['M'] = {0xC6,0xEE,0xFE,0xFE,0xD6,0xC6,0xC6,0x00},
-    ['N'] = {0xC6,0xE6,0xF6,0xDE,0xCE,0xC6,0xC6,0x00},
-    ['O'] = {0x7C,0xC6,0xC6,0xC6,0xC6,0xC6,0x7C,0x00},
-    ['P'] = {0xFC,0x66,0x66,0x7C,0x60,0x60,0xF0,0x00},
-    ['Q'] = {0x7C,0xC6,0xC6,0xC6,0xC6,0xCE,0x7C,0x0E},
-    ['R'] = {0xFC,0x66,0x66,0x7C,0x6C,0x66,0xE6,0x00},
-    ['S'] = {0x7C,0xC6,0x60,0x38,0x0C,0xC6,0x7C,0x00},
-    ['T'] = {0x7E,0x7E,0x5A,0x18,0x18,0x18,0x3C,0x00},
-    ['U'] = {0xC6,0xC6,0xC6,0xC6,0xC6,0xC6,0x7C,0x00},
-    ['V'] = {0xC6,0xC6,0xC6,0xC6,0xC6,0x6C,0x38,0x00},
-    ['W'] = {0xC6,0xC6,0xC6,0xD6,0xD6,0xFE,0x6C,0x00},
-    ['X'] = {0xC6,0xC6,0x6C,0x38,0x6C,0xC6,0xC6,0x00},
-    ['Y'] = {0x66,0x66,0x66,0x3C,0x18,0x18,0x3C,0x00},
-    ['Z'] = {0xFE,0xC6,0x8C,0x18,0x32,0x66,0xFE,0x00},
-    ['['] = {0x3C,0x30,0x30,0x30,0x30,0x30,0x3C,0x00},
-    [92]  = {0xC0,0x60,0x30,0x18,0x0C,0x06,0x02,0x00},
-    [']'] = {0x3C,0x0C,0x0C,0x0C,0x0C,0x0C,0x3C,0x00},
-    ['^'] = {0x10,0x38,0x6C,0xC6,0x00,0x00,0x00,0x00},
-    ['_'] = {0x00,0x00,0x00,0x00,0x00,0x00,0x00,0xFF},
-    ['`'] = {0x30,0x18,0x0C,0x00,0x00,0x00,0x00,0x00},
-    ['a'] = {0x00,0x00,0x78,0x0C,0x7C,0xCC,0x76,0x00},
-    ['b'] = {0xE0,0x60,0x7C,0x66,0x66,0x66,0xDC,0x00},
-    ['c'] = {0x00,0x00,0x7C,0xC6,0xC0,0xC6,0x7C,0x00},
-    ['d'] = {0x1C,0x0C,0x7C,0xCC,0xCC,0xCC,0x76,0x00},
-    ['e'] = {0x00,0x00,0x7C,0xC6,0xFE,0xC0,0x7C,0x00},
-    ['f'] = {0x3C,0x66,0x60,0xF8,0x60,0x60,0xF0,0x00},
-    ['g'] = {0x00,0x00,0x76,0xCC,0xCC,0x7C,0x0C,0xF8},
-    ['h'] = {0xE0,0x60,0x6C,0x76,0x66,0x66,0xE6,0x00},
-    ['i'] = {0x18,0x00,0x38,0x18,0x18,0x18,0x3C,0x00},
-    ['j'] = {0x06,0x00,0x06,0x06,0x06,0x66,0x66,0x3C},
-    ['k'] = {0xE0,0x60,0x66,0x6C,0x78,0x6C,0xE6,0x00},
-    ['l'] = {0x38,0x18,0x18,0x18,0x18,0x18,0x3C,0x00},
-    ['m'] = {0x00,0x00,0xEC,0xFE,0xD6,0xD6,0xD6,0x00},
-    ['n'] = {0x00,0x00,0xDC,0x66,0x66,0x66,0x66,0x00},
-    ['o'] = {0x00,0x00,0x7C,0xC6,0xC6,0xC6,0x7C,0x00},
-    ['p'] = {0x00,0x00,0xDC,0x66,0x66,0x7C,0x60,0xF0},
-    ['q'] = {0x00,0x00,0x76,0xCC,0xCC,0x7C,0x0C,0x1E},
-    ['r'] = {0x00,0x00,0xDC,0x76,0x60,0x60,0xF0,0x00},
-    ['s'] = {0x00,0x00,0x7E,0xC0,0x7C,0x06,0xFC,0x00},
-    ['t'] = {0x30,0x30,0xFC,0x30,0x30,0x36,0x1C,0x00},
-    ['u'] = {0x00,0x00,0xCC,0xCC,0xCC,0xCC,0x76,0x00},
-    ['v'] = {0x00,0x00,0xC6,0xC6,0xC6,0x6C,0x38,0x00},
-    ['w'] = {0x00,0x00,0xC6,0xD6,0xD6,0xFE,0x6C,0x00},
-    ['x'] = {0x00,0x00,0xC6,0x6C,0x38,0x6C,0xC6,0x00},
-    ['y'] = {0x00,0x00,0xC6,0xC6,0xC6,0x7E,0x06,0xFC},
-    ['z'] = {0x00,0x00,0x7E,0x4C,0x18,0x32,0x7E,0x00},
-    ['{'] = {0x0E,0x18,0x18,0x70,0x18,0x18,0x0E,0x00},
-    ['|'] = {0x18,0x18,0x18,0x18,0x18,0x18,0x18,0x00},
-    ['}'] = {0x70,0x18,0x18,0x0E,0x18,0x18,0x70,0x00},
-    ['~'] = {0x76,0xDC,0x00,0x00,0x00,0x00,0x00,0x00},
-    [127] = {0x00,0x00,0x00,0x00,0x00,0x00,0x00,0x00}
-};
+/* Bootloader framebuffer, if any (see vga_set_framebuffer) */
+static int have_boot_fb = 0;
 
-/* Bytes per line in planar mode */
-#define BYTES_PER_LINE 80
+/* Set once a driver has programmed the hardware */
+static int drv_started = 0;
 
-/* Set read plane */
-static void set_read_plane(uint8_t plane) {
-    outb(VGA_GC_INDEX, GC_READ_MAP_SELECT);
-    outb(VGA_GC_DATA, plane);
-}
-/* Set write mode (0 or 2) */
-static inline void set_write_mode(int mode) {
-    outb(VGA_GC_INDEX, GC_GRAPHICS_MODE);
-    outb(VGA_GC_DATA, mode);
-}
+/* Framebuffer the driver mapped with display_map_framebuffer(), and the
+ * memory type it gets (vga_set_framebuffer_cache) */
+static uint64_t fb_map_base = 0;
+static uint64_t fb_map_length = 0;
+static int fb_map_type = PAGE_CACHE_WRITECOMBINE;
+
+/* Off-screen render target (vga_set_target), 0 while drawing to the screen.
+ * Callers keep using screen coordinates; primitives shift them by the
+ * target's position, and the clip rect is kept in target coordinates. */
+static uint8_t* target = 0;
+static int target_x = 0, target_y = 0;
+static int target_w = 0, target_h = 0;
 
-/* Fast plane mask - all planes */
-static inline void set_all_planes(void) {
-    outb(VGA_SEQ_INDEX, SEQ_MAP_MASK);
-    outb(VGA_SEQ_DATA, 0x0F);
+/* Drawing clip rectangle (x1/y1 exclusive), the whole screen by default */
+static int clip_x0 = 0, clip_y0 = 0;
+static int clip_x1 = 640, clip_y1 = 480;
+
+/* ===== Helpers shared by the drivers ===== */
+
+/* Clip a rectangle to the clip rect, returns 0 if nothing is left */
+int display_clip_rect(int* x, int* y, int* w, int* h) {
+    if (*x < clip_x0) { *w -= clip_x0 - *x; *x = clip_x0; }
+    if (*y < clip_y0) { *h -= clip_y0 - *y; *y = clip_y0; }
+    if (*x + *w > clip_x1) *w = clip_x1 - *x;
+    if (*y + *h > clip_y1) *h = clip_y1 - *y;
+    return *w > 0 && *h > 0;
 }
-/* Initialize VGA Mode 12h (640x480, 16 colors) */
-void vga_init(void) {
+
+/* Program a standard VGA mode from register tables (no BIOS needed) */
+void display_program_vga(uint8_t misc, const uint8_t* seq, const uint8_t* crtc,
+                         const uint8_t* gc, const uint8_t* ac) {
     int i;
     
     /* Write miscellaneous register */
-    outb(VGA_MISC_WRITE, mode12h_misc);
+    outb(VGA_MISC_WRITE, misc);
     
     /* Write sequencer registers */
     for (i = 0; i < 5; i++) {
         outb(VGA_SEQ_INDEX, i);
-        outb(VGA_SEQ_DATA, mode12h_seq[i]);
+        outb(VGA_SEQ_DATA, seq[i]);
     }
     
     /* Unlock CRTC registers */
@@ -196,104 +86,595 @@ void vga_init(void) {
     /* Write CRTC registers */
     for (i = 0; i < 25; i++) {
         outb(VGA_CRTC_INDEX, i);
-        outb(VGA_CRTC_DATA, mode12h_crtc[i]);
+        outb(VGA_CRTC_DATA, crtc[i]);
     }
     
     /* Write graphics controller registers */
     for (i = 0; i < 9; i++) {
         outb(VGA_GC_INDEX, i);
-        outb(VGA_GC_DATA, mode12h_gc[i]);
+        outb(VGA_GC_DATA, gc[i]);
     }
     
     /* Write attribute controller registers */
     inb(VGA_INSTAT_READ);  /* Reset flip-flop */
     for (i = 0; i < 21; i++) {
         outb(VGA_AC_INDEX, i);
-        outb(VGA_AC_WRITE, mode12h_ac[i]);
+        outb(VGA_AC_WRITE, ac[i]);
     }
     
     /* Enable display */
     inb(VGA_INSTAT_READ);
     outb(VGA_AC_INDEX, 0x20);
+}
+
+/* Load the 16-colour palette into DAC entries 0-15 */
+void display_load_dac(void) {
+    outb(VGA_DAC_WRITE_INDEX, 0);
+    for (int i = 0; i < 16; i++) {
+        uint32_t rgb = display_palette[i];
+        outb(VGA_DAC_DATA, (uint8_t)((rgb >> 18) & 0x3F));
+        outb(VGA_DAC_DATA, (uint8_t)((rgb >> 10) & 0x3F));
+        outb(VGA_DAC_DATA, (uint8_t)((rgb >> 2) & 0x3F));
+    }
+}
+
+/* Map a framebuffer that takes plain stores (write-combining by default) */
+void display_map_framebuffer(uint64_t base, uint64_t length) {
+    fb_map_base = base;
+    fb_map_length = length;
+    paging_set_cache(base, length, fb_map_type);
+}
+
+/* Wait for vertical retrace. Bounded, so a framebuffer without VGA
+ * underneath (status reads 0xFF) cannot hang the caller. */
+void display_vga_vsync(void) {
+    int timeout = 1000000;
+    while ((inb(VGA_INSTAT_READ) & 0x08) && --timeout);
+    while (!(inb(VGA_INSTAT_READ) & 0x08) && --timeout);
+}
+
+/* ===== 8bpp chunky helpers (shadow framebuffer and Mode 13h) ===== */
+
+/* Fill a clipped rectangle */
+void chunky_fill(uint8_t* base, int pitch, int x, int y, int w, int h, uint8_t color) {
+    uint8_t* row = base + y * pitch + x;
+    for (int j = 0; j < h; j++) {
+        for (int i = 0; i < w; i++) {
+            row[i] = color;
+        }
+        row += pitch;
+    }
+}
+
+/* Copy a clipped rectangle (overlap safe) */
+void chunky_copy(uint8_t* base, int pitch, int sx, int sy, int dx, int dy, int w, int h) {
+    int step = (dy > sy) ? -1 : 1;
+    int row0 = (dy > sy) ? h - 1 : 0;
+    for (int j = 0, r = row0; j < h; j++, r += step) {
+        uint8_t* src = base + (sy + r) * pitch + sx;
+        uint8_t* dst = base + (dy + r) * pitch + dx;
+        if (dx > sx) {
+            for (int i = w - 1; i >= 0; i--) dst[i] = src[i];
+        } else {
+            for (int i = 0; i < w; i++) dst[i] = src[i];
+        }
+    }
+}
+
+/* Draw a clipped bitmap, VGA_TRANSPARENT pixels are skipped */
+void chunky_blit(uint8_t* base, int pitch, int x, int y, int w, int h, const uint8_t* src, int src_pitch) {
+    for (int j = 0; j < h; j++) {
+        const uint8_t* s = src + j * src_pitch;
+        uint8_t* dst = base + (y + j) * pitch + x;
+        for (int i = 0; i < w; i++) {
+            if (s[i] != VGA_TRANSPARENT) dst[i] = s[i] & 0x0F;
+        }
+    }
+}
+
+/* Draw a run of n characters on one line (clipped here) */
+void chunky_text(uint8_t* base, int pitch, int x, int y, const char* str, int n, uint8_t fg, uint8_t bg) {
+    int cx = x, cy = y, cw = n * 8, ch = 8;
+    if (!display_clip_rect(&cx, &cy, &cw, &ch)) return;
     
-    /* Clear screen */
-    vga_clear(COLOR_BLACK);
+    fg &= 0x0F;
+    bg &= 0x0F;
+    for (int j = cy; j < cy + ch; j++) {
+        uint8_t* dst = base + j * pitch;
+        for (int px = cx; px < cx + cw; px++) {
+            int col = px - x;
+            unsigned char c = (unsigned char)str[col >> 3];
+            uint8_t g = font8x8[c > 127 ? '?' : c][j - y];
+            dst[px] = (g & (0x80 >> (col & 7))) ? fg : bg;
+        }
+    }
 }
 
-/* Clear screen - write to all planes */
-void vga_clear(uint8_t color) {
-    for (int plane = 0; plane < 4; plane++) {
-        outb(VGA_SEQ_INDEX, SEQ_MAP_MASK);
-        outb(VGA_SEQ_DATA, 1 << plane);
-        uint8_t plane_val = (color & (1 << plane)) ? 0xFF : 0x00;
-        
-        uint8_t* vga = VGA_MEMORY;
-        for (int i = 0; i < BYTES_PER_LINE * SCREEN_HEIGHT; i++) {
-            vga[i] = plane_val;
+/*
+ * Shadow framebuffer - optional 8bpp chunky copy of the screen in system
+ * RAM. While enabled every primitive draws here at memory speed and
+ * records the damaged area; vga_swap() hands only the damaged rectangles
+ * to the driver during vertical retrace.
+ */
+#define SHADOW_MAX_PIXELS (1280 * 1024)
+#define MAX_DAMAGE_RECTS  16
+
+typedef struct {
+    int x0, y0, x1, y1;  /* x0/x1 aligned to 8 pixels, x1/y1 exclusive */
+} damage_rect_t;
+
+static uint8_t shadow_fb[SHADOW_MAX_PIXELS];
+static int shadow_enabled = 0;
+static damage_rect_t damage[MAX_DAMAGE_RECTS];
+static int num_damage = 0;
+
+/* Page flipping: the hidden page is one frame behind, so it needs the
+ * previous frame's damage as well as this one's */
+static damage_rect_t prev_damage[MAX_DAMAGE_RECTS];
+static int num_prev_damage = 0;
+static int back_stale = 1;      /* hidden page content unknown - present all */
+
+/* Record a damaged (already clipped) area, merging with overlapping rects */
+static void add_damage(int x, int y, int w, int h) {
+    damage_rect_t r = { x & ~7, y, (x + w + 7) & ~7, y + h };
+    
+    for (int i = 0; i < num_damage; i++) {
+        damage_rect_t* d = &damage[i];
+        if (r.x0 <= d->x1 && r.x1 >= d->x0 && r.y0 <= d->y1 && r.y1 >= d->y0) {
+            /* Touching or overlapping - grow in place */
+            if (r.x0 < d->x0) d->x0 = r.x0;
+            if (r.y0 < d->y0) d->y0 = r.y0;
+            if (r.x1 > d->x1) d->x1 = r.x1;
+            if (r.y1 > d->y1) d->y1 = r.y1;
+            return;
         }
     }
-    outb(VGA_SEQ_INDEX, SEQ_MAP_MASK);
-    outb(VGA_SEQ_DATA, 0x0F);
+    
+    if (num_damage == MAX_DAMAGE_RECTS) {
+        /* List full - collapse everything into one bounding rect */
+        for (int i = 1; i < num_damage; i++) {
+            if (damage[i].x0 < damage[0].x0) damage[0].x0 = damage[i].x0;
+            if (damage[i].y0 < damage[0].y0) damage[0].y0 = damage[i].y0;
+            if (damage[i].x1 > damage[0].x1) damage[0].x1 = damage[i].x1;
+            if (damage[i].y1 > damage[0].y1) damage[0].y1 = damage[i].y1;
+        }
+        num_damage = 1;
+        add_damage(x, y, w, h);
+        return;
+    }
+    damage[num_damage++] = r;
 }
 
-/* Draw pixel using write mode 2 */
-void vga_putpixel(int x, int y, uint8_t color) {
-    if (x < 0 || x >= SCREEN_WIDTH || y < 0 || y >= SCREEN_HEIGHT) return;
+static inline uint8_t* shadow_at(int x, int y) {
+    return shadow_fb + y * SCREEN_WIDTH + x;
+}
+
+/* Cursor overlay (below) */
+static int cursor_overlaps(int x, int y, int w, int h);
+static int cursor_begin(int x, int y, int w, int h);
+static void cursor_end(int hit);
+static void cursor_present(void);
+
+/* Hand all pending damage to the driver, then lay the cursor over it */
+static void shadow_flush(void) {
+    int hit = 0;
+    for (int i = 0; i < num_damage; i++) {
+        damage_rect_t* r = &damage[i];
+        int x1 = (r->x1 > SCREEN_WIDTH) ? SCREEN_WIDTH : r->x1;
+        drv->present(shadow_fb, SCREEN_WIDTH, r->x0, r->y0, x1, r->y1);
+        hit |= cursor_overlaps(r->x0, r->y0, x1 - r->x0, r->y1 - r->y0);
+    }
+    num_damage = 0;
+    if (hit) cursor_present();
+}
+
+/* Present this frame into the hidden page, then flip at vsync */
+static void shadow_flip(void) {
+    if (back_stale) {
+        /* The other page is stale too; it gets everything on the next flip */
+        num_damage = 0;
+        add_damage(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT);
+        prev_damage[0] = damage[0];
+        num_prev_damage = 1;
+        back_stale = 0;
+        shadow_flush();
+    } else {
+        /* Presented below is this frame + last frame; keep this frame for next time */
+        damage_rect_t frame[MAX_DAMAGE_RECTS];
+        int num_frame = num_damage;
+        for (int i = 0; i < num_damage; i++) frame[i] = damage[i];
+        for (int i = 0; i < num_prev_damage; i++) {
+            damage_rect_t* r = &prev_damage[i];
+            add_damage(r->x0, r->y0, r->x1 - r->x0, r->y1 - r->y0);
+        }
+        for (int i = 0; i < num_frame; i++) prev_damage[i] = frame[i];
+        num_prev_damage = num_frame;
+        shadow_flush();
+    }
+    num_damage = 0;
+    drv->flip();
+}
+
+/* ===== Sprites ===== */
+
+#define MAX_SPRITES 32
+
+static display_sprite_t sprites[MAX_SPRITES];
+static int num_sprites = 0;
+
+/* Register a sprite (pixels must stay valid), returns sprite ID */
+int vga_sprite_create(int width, int height, const uint8_t* pixels) {
+    if (num_sprites >= MAX_SPRITES || width <= 0 || height <= 0) return -1;
     
-    int offset = y * BYTES_PER_LINE + x / 8;
-    uint8_t mask = 0x80 >> (x & 7);
+    display_sprite_t* spr = &sprites[num_sprites];
+    spr->pixels = pixels;
+    spr->width = width;
+    spr->height = height;
+    spr->cache = 0;
+    spr->opaque = 1;
+    for (int i = 0; i < width * height && spr->opaque; i++) {
+        if (pixels[i] == VGA_TRANSPARENT) spr->opaque = 0;
+    }
+    return num_sprites++;
+}
+
+/* Draw a sprite - driver fast path when it has one */
+void vga_sprite_draw(int id, int x, int y) {
+    if (id < 0 || id >= num_sprites) return;
+    display_sprite_t* spr = &sprites[id];
     
-    outb(VGA_GC_INDEX, GC_GRAPHICS_MODE);
-    outb(VGA_GC_DATA, 0x02);
+    /* Driver sprites are not clipped, so they must lie inside the clip rect */
+    if (!target && !shadow_enabled && drv->sprite && x >= clip_x0 && y >= clip_y0 &&
+        x + spr->width <= clip_x1 && y + spr->height <= clip_y1) {
+        int hit = cursor_begin(x, y, spr->width, spr->height);
+        int done = drv->sprite(spr, x, y);
+        cursor_end(hit);
+        if (done) return;
+    }
+    vga_drawbitmap(x, y, spr->width, spr->height, spr->pixels);
+}
+
+/* ===== Cursor overlay ===== */
+
+/*
+ * The cursor is never part of the scene. In shadow mode it is laid over
+ * the shadow only while presenting, so the shadow is its save-under.
+ * Drawing directly, cursor_under holds the pixels it covers, and any
+ * primitive touching that area takes the cursor off and puts it back.
+ */
+#define CURSOR_MAX 16
+
+static int cursor_id = -1;          /* sprite, -1 when hidden */
+static int cursor_x = 0, cursor_y = 0;
+static int cursor_drawn = 0;        /* direct mode: on screen, cursor_under valid */
+static uint8_t cursor_under[CURSOR_MAX * CURSOR_MAX];
+
+/* Does the cursor cover any of this rect? */
+static int cursor_overlaps(int x, int y, int w, int h) {
+    if (cursor_id < 0) return 0;
+    display_sprite_t* spr = &sprites[cursor_id];
+    return x < cursor_x + spr->width && x + w > cursor_x &&
+           y < cursor_y + spr->height && y + h > cursor_y;
+}
+
+/* Direct mode: put back what the cursor covers */
+static void cursor_remove(void) {
+    if (!cursor_drawn) return;
+    display_sprite_t* spr = &sprites[cursor_id];
+    drv->blit(cursor_x, cursor_y, spr->width, spr->height, cursor_under, spr->width);
+    cursor_drawn = 0;
+}
+
+/* Direct mode: save what is under the cursor, then draw it */
+static void cursor_place(void) {
+    if (cursor_id < 0 || cursor_drawn || shadow_enabled) return;
+    display_sprite_t* spr = &sprites[cursor_id];
+    uint8_t* under = cursor_under;
+    for (int j = 0; j < spr->height; j++) {
+        for (int i = 0; i < spr->width; i++) {
+            *under++ = drv->getpixel(cursor_x + i, cursor_y + j);
+        }
+    }
+    drv->blit(cursor_x, cursor_y, spr->width, spr->height, spr->pixels, spr->width);
+    cursor_drawn = 1;
+}
+
+/* Direct mode: lift the cursor around a primitive that touches it */
+static int cursor_begin(int x, int y, int w, int h) {
+    if (!cursor_drawn || !cursor_overlaps(x, y, w, h)) return 0;
+    cursor_remove();
+    return 1;
+}
+
+static void cursor_end(int hit) {
+    if (hit) cursor_place();
+}
+
+/* Shadow mode: present the cursor rect with the cursor drawn into the
+ * shadow just for the copy (cursor_under is free in this mode) */
+static void cursor_present(void) {
+    display_sprite_t* spr = &sprites[cursor_id];
+    int w = spr->width, h = spr->height;
+    for (int j = 0; j < h; j++) {
+        uint8_t* row = shadow_at(cursor_x, cursor_y + j);
+        const uint8_t* src = spr->pixels + j * w;
+        for (int i = 0; i < w; i++) {
+            cursor_under[j * w + i] = row[i];
+            if (src[i] != VGA_TRANSPARENT) row[i] = src[i] & 0x0F;
+        }
+    }
+    int x0 = cursor_x & ~7;
+    int x1 = (cursor_x + w + 7) & ~7;
+    if (x1 > SCREEN_WIDTH) x1 = SCREEN_WIDTH;
+    drv->present(shadow_fb, SCREEN_WIDTH, x0, cursor_y, x1, cursor_y + h);
+    for (int j = 0; j < h; j++) {
+        uint8_t* row = shadow_at(cursor_x, cursor_y + j);
+        for (int i = 0; i < w; i++) {
+            row[i] = cursor_under[j * w + i];
+        }
+    }
+}
+
+/* Keep the whole cursor on screen */
+static void cursor_clamp(int* x, int* y) {
+    display_sprite_t* spr = &sprites[cursor_id];
+    if (*x > SCREEN_WIDTH - spr->width) *x = SCREEN_WIDTH - spr->width;
+    if (*y > SCREEN_HEIGHT - spr->height) *y = SCREEN_HEIGHT - spr->height;
+    if (*x < 0) *x = 0;
+    if (*y < 0) *y = 0;
+}
+
+/* Move the cursor - costs only the old and new cursor areas */
+void vga_cursor_move(int x, int y) {
+    if (cursor_id < 0) {
+        cursor_x = x;
+        cursor_y = y;
+        return;
+    }
+    cursor_clamp(&x, &y);
+    if (x == cursor_x && y == cursor_y) return;
+
+    display_sprite_t* spr = &sprites[cursor_id];
+    if (shadow_enabled) {
+        add_damage(cursor_x, cursor_y, spr->width, spr->height);
+        cursor_x = x;
+        cursor_y = y;
+        add_damage(x, y, spr->width, spr->height);
+    } else {
+        cursor_remove();
+        cursor_x = x;
+        cursor_y = y;
+        cursor_place();
+    }
+}
+
+/* Show a sprite as the cursor (at most 16x16), -1 hides it */
+void vga_cursor_set(int sprite_id) {
+    if (sprite_id >= num_sprites) return;
+    if (sprite_id >= 0 && (sprites[sprite_id].width > CURSOR_MAX ||
+                           sprites[sprite_id].height > CURSOR_MAX)) return;
+    if (sprite_id == cursor_id) return;
+
+    if (cursor_id >= 0) {
+        display_sprite_t* spr = &sprites[cursor_id];
+        if (shadow_enabled) add_damage(cursor_x, cursor_y, spr->width, spr->height);
+        cursor_remove();
+    }
+    cursor_id = sprite_id;
+    if (cursor_id < 0) return;
+
+    cursor_clamp(&cursor_x, &cursor_y);
+    if (shadow_enabled) {
+        add_damage(cursor_x, cursor_y, sprites[cursor_id].width, sprites[cursor_id].height);
+    } else {
+        cursor_place();
+    }
+}
+
+/* ===== Driver selection ===== */
+
+/* Bring up a driver, returns 0 (old driver kept) if it is not there */
+static int start_driver(display_driver_t* d) {
+    display_driver_t* old = drv;
+    if (drv_started && old != d && old->leave) old->leave();
+    fb_map_length = 0;      /* init maps its own, if it has one */
+    if (!d->init()) {
+        if (drv_started && old != d) old->init();
+        return 0;
+    }
     
-    outb(VGA_GC_INDEX, GC_BIT_MASK);
-    outb(VGA_GC_DATA, mask);
+    drv = d;
+    drv_started = 1;
+    screen_width = d->width;
+    screen_height = d->height;
+    
+    vga_reset_clip();
+    
+    /* Driver caches do not survive a mode set */
+    for (int i = 0; i < num_sprites; i++) {
+        sprites[i].cache = 0;
+    }
+    cursor_drawn = 0;
+    if (cursor_id >= 0) cursor_clamp(&cursor_x, &cursor_y);
     
-    volatile uint8_t dummy = VGA_MEMORY[offset];
-    (void)dummy;
-    VGA_MEMORY[offset] = color;
+    /* Shadow contents are stale; the caller redraws everything */
+    num_damage = 0;
+    back_stale = 1;
+    if (screen_width * screen_height > SHADOW_MAX_PIXELS) {
+        shadow_enabled = 0;
+    }
+    return 1;
+}
+
+/* Start the driver for a VGA_MODE_* value */
+static int start_mode(int mode) {
+    switch (mode) {
+    case VGA_MODE_320x200:
+        return start_driver(&mode13_driver);
+    case VGA_MODE_HIGHRES:
+        /* Bochs/QEMU adapter if present, else the bootloader framebuffer */
+        if (start_driver(&bga_driver)) return 1;
+        return have_boot_fb && start_driver(&multiboot_driver);
+    default:
+        /* BGA gives a page flipped 640x480; plain VGA falls back to Mode 12h */
+        if (start_driver(&bga640_driver)) return 1;
+        return start_driver(&planar_driver);
+    }
+}
+
+/* Hand over the bootloader's framebuffer (call before vga_init) */
+int vga_set_framebuffer(uint64_t addr, uint32_t pitch, uint32_t width, uint32_t height, uint8_t bpp) {
+    have_boot_fb = multiboot_fb_setup(addr, pitch, width, height, bpp);
+    return have_boot_fb;
+}
+
+/* Initialize graphics - bootloader framebuffer if there is one, else Mode 12h */
+void vga_init(void) {
+    if (have_boot_fb && start_driver(&multiboot_driver)) {
+        current_vga_mode = VGA_MODE_HIGHRES;
+    } else {
+        start_mode(VGA_MODE_640x480);
+        current_vga_mode = VGA_MODE_640x480;
+    }
+    vga_clear(COLOR_BLACK);
+}
+
+/* Set mode - keeps the old mode if the new one is not available. The
+ * screen content is lost; callers redraw. */
+void vga_set_mode(int mode) {
+    if (mode == current_vga_mode) return;
+    trace("video mode", mode);
+    if (!start_mode(mode)) return;
+    current_vga_mode = mode;
+    vga_clear(COLOR_BLACK);
+    cursor_place();
+}
+
+/* Get current mode */
+int vga_get_mode(void) {
+    return current_vga_mode;
+}
+
+int vga_started(void) {
+    return drv_started;
+}
+
+int vga_set_framebuffer_cache(int type) {
+    fb_map_type = type;
+    if (!fb_map_length) return 0;
+    paging_set_cache(fb_map_base, fb_map_length, type);
+    return 1;
+}
+
+/* ===== Drawing ===== */
+
+/* Restrict drawing to a rectangle (clipped to the screen or target) */
+void vga_set_clip(int x, int y, int width, int height) {
+    int w = SCREEN_WIDTH, h = SCREEN_HEIGHT;
+    if (target) {
+        x -= target_x;
+        y -= target_y;
+        w = target_w;
+        h = target_h;
+    }
+    clip_x0 = (x < 0) ? 0 : x;
+    clip_y0 = (y < 0) ? 0 : y;
+    clip_x1 = (x + width > w) ? w : x + width;
+    clip_y1 = (y + height > h) ? h : y + height;
+}
+
+/* Draw to the whole screen (or target) again */
+void vga_reset_clip(void) {
+    clip_x0 = 0;
+    clip_y0 = 0;
+    clip_x1 = target ? target_w : SCREEN_WIDTH;
+    clip_y1 = target ? target_h : SCREEN_HEIGHT;
+}
+
+/* Does a rectangle touch the clip rect? (lets callers skip hidden work) */
+int vga_clip_visible(int x, int y, int width, int height) {
+    if (target) {
+        x -= target_x;
+        y -= target_y;
+    }
+    return x < clip_x1 && x + width > clip_x0 && y < clip_y1 && y + height > clip_y0;
+}
+
+/* Send drawing to an 8bpp surface (pitch = width) that stands for the
+ * screen rect at x/y, or back to the screen with pixels = 0 */
+void vga_set_target(uint8_t* pixels, int x, int y, int width, int height) {
+    target = pixels;
+    target_x = x;
+    target_y = y;
+    target_w = width;
+    target_h = height;
+    vga_reset_clip();
+}
+
+/* Clear screen */
+void vga_clear(uint8_t color) {
+    vga_fillrect(0, 0, SCREEN_WIDTH, SCREEN_HEIGHT, color);
+}
+
+/* Draw pixel */
+void vga_putpixel(int x, int y, uint8_t color) {
+    if (target) { x -= target_x; y -= target_y; }
+    if (x < clip_x0 || x >= clip_x1 || y < clip_y0 || y >= clip_y1) return;
     
-    outb(VGA_GC_INDEX, GC_GRAPHICS_MODE);
-    outb(VGA_GC_DATA, 0x00);
-    outb(VGA_GC_INDEX, GC_BIT_MASK);
-    outb(VGA_GC_DATA, 0xFF);
+    if (target) {
+        target[y * target_w + x] = color & 0x0F;
+        return;
+    }
+    if (shadow_enabled) {
+        *shadow_at(x, y) = color & 0x0F;
+        add_damage(x, y, 1, 1);
+        return;
+    }
+    int hit = cursor_begin(x, y, 1, 1);
+    drv->fill(x, y, 1, 1, color & 0x0F);
+    cursor_end(hit);
 }
 
 /* Get pixel */
 uint8_t vga_getpixel(int x, int y) {
+    if (target) {
+        x -= target_x;
+        y -= target_y;
+        if (x < 0 || x >= target_w || y < 0 || y >= target_h) return 0;
+        return target[y * target_w + x];
+    }
     if (x < 0 || x >= SCREEN_WIDTH || y < 0 || y >= SCREEN_HEIGHT) return 0;
-    
-    int offset = y * BYTES_PER_LINE + x / 8;
-    uint8_t mask = 0x80 >> (x & 7);
-    uint8_t color = 0;
-    volatile uint8_t byte_val;
-    
-    for (int plane = 0; plane < 4; plane++) {
-        set_read_plane(plane);
-        byte_val = VGA_MEMORY[offset];  /* Read after setting plane */
-        if (byte_val & mask) {
-            color |= (1 << plane);
-        }
+    if (shadow_enabled) return *shadow_at(x, y);
+    if (cursor_drawn && cursor_overlaps(x, y, 1, 1)) {
+        return cursor_under[(y - cursor_y) * sprites[cursor_id].width + (x - cursor_x)];
     }
-    return color;
+    return drv->getpixel(x, y);
 }
 
 /* Horizontal line */
 void vga_hline(int x, int y, int width, uint8_t color) {
-    for (int i = 0; i < width; i++) {
-        vga_putpixel(x + i, y, color);
-    }
+    vga_fillrect(x, y, width, 1, color);
 }
 
 /* Vertical line */
 void vga_vline(int x, int y, int height, uint8_t color) {
-    for (int i = 0; i < height; i++) {
-        vga_putpixel(x, y + i, color);
-    }
+    vga_fillrect(x, y, 1, height, color);
 }
 
 /* Line (Bresenham) */
 void vga_line(int x1, int y1, int x2, int y2, uint8_t color) {
+    /* Axis-aligned lines go through the fill path */
+    if (y1 == y2) {
+        if (x1 > x2) { int t = x1; x1 = x2; x2 = t; }
+        vga_hline(x1, y1, x2 - x1 + 1, color);
+        return;
+    }
+    if (x1 == x2) {
+        if (y1 > y2) { int t = y1; y1 = y2; y2 = t; }
+        vga_vline(x1, y1, y2 - y1 + 1, color);
+        return;
+    }
+    
     int dx = x2 - x1;
     int dy = y2 - y1;
     int sx = (dx > 0) ? 1 : -1;
@@ -321,11 +702,80 @@ void vga_rect(int x, int y, int width, int height, uint8_t color) {
 
 /* Filled rectangle */
 void vga_fillrect(int x, int y, int width, int height, uint8_t color) {
-    for (int j = 0; j < height; j++) {
-        for (int i = 0; i < width; i++) {
-            vga_putpixel(x + i, y + j, color);
-        }
+    if (target) { x -= target_x; y -= target_y; }
+    if (!display_clip_rect(&x, &y, &width, &height)) return;
+    if (target) {
+        chunky_fill(target, target_w, x, y, width, height, color & 0x0F);
+        return;
+    }
+    if (shadow_enabled) {
+        chunky_fill(shadow_fb, SCREEN_WIDTH, x, y, width, height, color & 0x0F);
+        add_damage(x, y, width, height);
+        return;
+    }
+    int hit = cursor_begin(x, y, width, height);
+    drv->fill(x, y, width, height, color & 0x0F);
+    cursor_end(hit);
+}
+
+/* Copy screen region (overlap safe) */
+void vga_copyrect(int sx, int sy, int dx, int dy, int w, int h) {
+    int bw = SCREEN_WIDTH, bh = SCREEN_HEIGHT;
+    if (target) {
+        sx -= target_x; sy -= target_y;
+        dx -= target_x; dy -= target_y;
+        bw = target_w;
+        bh = target_h;
+    }
+    
+    /* Clip the source against the screen, the destination against the clip rect */
+    if (sx < 0) { w += sx; dx -= sx; sx = 0; }
+    if (sy < 0) { h += sy; dy -= sy; sy = 0; }
+    if (dx < clip_x0) { w -= clip_x0 - dx; sx += clip_x0 - dx; dx = clip_x0; }
+    if (dy < clip_y0) { h -= clip_y0 - dy; sy += clip_y0 - dy; dy = clip_y0; }
+    if (sx + w > bw) w = bw - sx;
+    if (dx + w > clip_x1) w = clip_x1 - dx;
+    if (sy + h > bh) h = bh - sy;
+    if (dy + h > clip_y1) h = clip_y1 - dy;
+    if (w <= 0 || h <= 0) return;
+    if (sx == dx && sy == dy) return;
+    
+    if (target) {
+        chunky_copy(target, target_w, sx, sy, dx, dy, w, h);
+        return;
     }
+    if (!shadow_enabled) {
+        int hit = cursor_begin(sx, sy, w, h) | cursor_begin(dx, dy, w, h);
+        drv->copy(sx, sy, dx, dy, w, h);
+        cursor_end(hit);
+        return;
+    }
+    
+    chunky_copy(shadow_fb, SCREEN_WIDTH, sx, sy, dx, dy, w, h);
+    add_damage(dx, dy, w, h);
+}
+
+/* Draw a bitmap - one byte per pixel, VGA_TRANSPARENT pixels are skipped */
+void vga_drawbitmap(int x, int y, int width, int height, const uint8_t* bitmap) {
+    int pitch = width;
+    if (target) { x -= target_x; y -= target_y; }
+    int cx = x, cy = y;
+    if (!display_clip_rect(&cx, &cy, &width, &height)) return;
+    bitmap += (cy - y) * pitch + (cx - x);
+    
+    if (target) {
+        chunky_blit(target, target_w, cx, cy, width, height, bitmap, pitch);
+        return;
+    }
+    if (!shadow_enabled) {
+        int hit = cursor_begin(cx, cy, width, height);
+        drv->blit(cx, cy, width, height, bitmap, pitch);
+        cursor_end(hit);
+        return;
+    }
+    
+    chunky_blit(shadow_fb, SCREEN_WIDTH, cx, cy, width, height, bitmap, pitch);
+    add_damage(cx, cy, width, height);
 }
 
 /* Circle outline */
@@ -346,92 +796,117 @@ void vga_circle(int cx, int cy, int radius, uint8_t color) {
     }
 }
 
-/* Filled circle */
+/* Filled circle - one span per scanline pair */
 void vga_fillcircle(int cx, int cy, int radius, uint8_t color) {
-    for (int y = -radius; y <= radius; y++) {
-        for (int x = -radius; x <= radius; x++) {
-            if (x * x + y * y <= radius * radius) {
-                vga_putpixel(cx + x, cy + y, color);
-            }
-        }
+    int half = radius;
+    for (int y = 0; y <= radius; y++) {
+        while (half * half + y * y > radius * radius) half--;
+        vga_hline(cx - half, cy + y, 2 * half + 1, color);
+        if (y) vga_hline(cx - half, cy - y, 2 * half + 1, color);
+    }
+}
+
+/* Draw a run of n characters on one line in the shadow framebuffer */
+static void text_shadow(int x, int y, const char* str, int n, uint8_t fg, uint8_t bg) {
+    int cx = x, cy = y, cw = n * 8, ch = 8;
+    if (!display_clip_rect(&cx, &cy, &cw, &ch)) return;
+    chunky_text(shadow_fb, SCREEN_WIDTH, x, y, str, n, fg, bg);
+    add_damage(cx, cy, cw, ch);
+}
+
+static void text_run(int x, int y, const char* str, int n, uint8_t fg, uint8_t bg) {
+    if (n <= 0) return;
+    if (target) {
+        chunky_text(target, target_w, x - target_x, y - target_y, str, n, fg, bg);
+    } else if (shadow_enabled) {
+        text_shadow(x, y, str, n, fg, bg);
+    } else {
+        int hit = cursor_begin(x, y, n * 8, 8);
+        drv->glyphs(x, y, str, n, fg, bg);
+        cursor_end(hit);
     }
 }
 
 /* Draw character */
 void vga_putchar(int x, int y, char c, uint8_t fg, uint8_t bg) {
-    unsigned char uc = (unsigned char)c;
-    if (uc > 127) uc = '?';
-    const uint8_t* glyph = font8x8[uc];
-    for (int row = 0; row < 8; row++) {
-        for (int col = 0; col < 8; col++) {
-            uint8_t pixel = (glyph[row] >> (7 - col)) & 1;
-            vga_putpixel(x + col, y + row, pixel ? fg : bg);
-        }
-    }
+    text_run(x, y, &c, 1, fg, bg);
 }
 
-/* Draw string */
+/* Draw string - each line is drawn as one run */
 void vga_putstring(int x, int y, const char* str, uint8_t fg, uint8_t bg) {
-    int startx = x;
     while (*str) {
-        if (*str == '\n') { x = startx; y += 8; }
-        else { vga_putchar(x, y, *str, fg, bg); x += 8; }
-        str++;
+        int n = 0;
+        while (str[n] && str[n] != '\n') n++;
+        text_run(x, y, str, n, fg, bg);
+        str += n;
+        if (*str == '\n') { y += 8; str++; }
     }
 }
 
+/* ===== Frame control ===== */
+
 /* Wait for vsync */
 void vga_vsync(void) {
-    while (inb(VGA_INSTAT_READ) & 0x08);
-    while (!(inb(VGA_INSTAT_READ) & 0x08));
+    drv->vsync();
 }
 
-/* Swap buffer */
+/* Swap buffer - flip to a freshly presented page, or flush shadow
+ * damage during vertical retrace */
 void vga_swap(void) {
-    vga_vsync();
+    if (!shadow_enabled) {
+        drv->vsync();
+        return;
+    }
+    if (drv->flip) {
+        if (num_damage == 0 && num_prev_damage == 0 && !back_stale) return;
+        shadow_flip();
+        return;
+    }
+    if (num_damage == 0) return;
+    drv->vsync();
+    shadow_flush();
 }
 
-/* Current VGA mode (0=640x480, 1=320x200) */
-static int current_vga_mode = 0;
-
-/* Set VGA mode */
-void vga_set_mode(int mode) {
-    if (mode == current_vga_mode) return;
-    
-    current_vga_mode = mode;
+/* Enable or disable the shadow framebuffer */
+void vga_set_shadow(int enable) {
+    if (enable == shadow_enabled) return;
     
-    if (mode == 1) {
-        /* Switch to 320x200 16-color mode (Mode 13h) */
-        /* Call BIOS INT 10h, AH=0, AL=0x13 */
-        uint16_t bios_ax = 0x0013;
-        asm volatile (
-            "int $0x10"
-            : "+a" (bios_ax)
-        );
-    } else if (mode == 2) {
-        /* Switch to 720p mode (1280x720) using VESA */
-        /* VESA mode 0x118 (1280x720x16) */
-        uint16_t bios_ax = 0x4F02;
-        uint16_t bios_bx = 0x0118;  /* VESA mode 118h */
-        asm volatile (
-            "int $0x10"
-            : "+a" (bios_ax), "+b" (bios_bx)
-        );
+    if (enable) {
+        if (SCREEN_WIDTH * SCREEN_HEIGHT > SHADOW_MAX_PIXELS) return;
+        /* Start from what is on screen now, without the cursor */
+        cursor_remove();
+        drv->readback(shadow_fb, SCREEN_WIDTH);
+        num_damage = 0;
+        back_stale = 1;
+        shadow_enabled = 1;
+        if (cursor_id >= 0) {
+            add_damage(cursor_x, cursor_y, sprites[cursor_id].width, sprites[cursor_id].height);
+        }
     } else {
-        /* Switch back to 640x480 16-color mode (Mode 12h) */
-        /* Call BIOS INT 10h, AH=0, AL=0x12 */
-        uint16_t bios_ax = 0x0012;
-        asm volatile (
-            "int $0x10"
-            : "+a" (bios_ax)
-        );
+        if (cursor_id >= 0) {
+            add_damage(cursor_x, cursor_y, sprites[cursor_id].width, sprites[cursor_id].height);
+        }
+        if (drv->flip) {
+            /* Leave the final frame on the page that direct drawing uses */
+            shadow_flip();
+        } else {
+            shadow_flush();
+        }
+        shadow_enabled = 0;
+        /* The flush drew the cursor; the shadow has what is under it */
+        if (cursor_id >= 0) {
+            display_sprite_t* spr = &sprites[cursor_id];
+            for (int j = 0; j < spr->height; j++) {
+                for (int i = 0; i < spr->width; i++) {
+                    cursor_under[j * spr->width + i] = *shadow_at(cursor_x + i, cursor_y + j);
+                }
+            }
+            cursor_drawn = 1;
+        }
     }
-    
-    /* Reinitialize VGA memory pointer */
-    vga_init();
 }
 
-/* Get current VGA mode */
-int vga_get_mode(void) {
-    return current_vga_mode;
+/* Check if the shadow framebuffer is in use */
+int vga_shadow_enabled(void) {
+    return shadow_enabled;
 }
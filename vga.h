@@ -1,6 +1,6 @@
 /*
- * vga.h - VGA Graphics Driver for GegOS
- * 640x480, 16 colors (Mode 12h)
+ * vga.h - Graphics API for GegOS
+ * 16 colors on Mode 12h, Mode 13h or a 32bpp linear framebuffer
  */
 
 #ifndef VGA_H
@@ -8,9 +8,16 @@
 
 #include <stdint.h>
 
-/* Screen dimensions - Mode 12h */
-#define SCREEN_WIDTH  640
-#define SCREEN_HEIGHT 480
+/* Screen dimensions - set by the active display mode */
+extern int screen_width;
+extern int screen_height;
+#define SCREEN_WIDTH  screen_width
+#define SCREEN_HEIGHT screen_height
+
+/* Modes for vga_set_mode */
+#define VGA_MODE_640x480  0   /* BGA page flipped, else Mode 12h planar */
+#define VGA_MODE_320x200  1   /* Mode 13h, chunky */
+#define VGA_MODE_HIGHRES  2   /* BGA 1024x768, else the bootloader framebuffer */
 
 /* VGA Color Palette (standard 256-color palette) */
 #define COLOR_BLACK       0
@@ -30,7 +37,10 @@
 #define COLOR_YELLOW      14
 #define COLOR_WHITE       15
 
-/* Initialize VGA Mode 13h (320x200, 256 colors) */
+/* Hand over the bootloader's 32bpp framebuffer (call before vga_init), 0 if unusable */
+int vga_set_framebuffer(uint64_t addr, uint32_t pitch, uint32_t width, uint32_t height, uint8_t bpp);
+
+/* Initialize graphics (bootloader framebuffer if given, else Mode 12h) */
 void vga_init(void);
 
 /* Clear screen with a color */
@@ -69,22 +79,57 @@ void vga_putchar(int x, int y, char c, uint8_t fg, uint8_t bg);
 /* Draw a string at position */
 void vga_putstring(int x, int y, const char* str, uint8_t fg, uint8_t bg);
 
-/* Draw a bitmap */
+/* Bitmap pixel value that is not drawn */
+#define VGA_TRANSPARENT   0xFF
+
+/* Draw a bitmap (one byte per pixel, VGA_TRANSPARENT pixels skipped) */
 void vga_drawbitmap(int x, int y, int width, int height, const uint8_t* bitmap);
 
-/* Copy screen region (for mouse cursor) */
+/* Register a sprite (pixels: one byte per pixel, must stay valid), returns ID */
+int vga_sprite_create(int width, int height, const uint8_t* pixels);
+
+/* Draw a sprite (latch blit from off-screen VRAM when byte aligned) */
+void vga_sprite_draw(int id, int x, int y);
+
+/* Cursor overlay - kept over the scene with a save-under, never drawn into it */
+void vga_cursor_set(int sprite_id);   /* sprite up to 16x16, -1 hides */
+void vga_cursor_move(int x, int y);
+
+/* Clip rectangle - all drawing is restricted to it */
+void vga_set_clip(int x, int y, int width, int height);
+void vga_reset_clip(void);
+int vga_clip_visible(int x, int y, int width, int height);
+
+/* Render into an 8bpp surface standing for a screen rect (0 = the screen) */
+void vga_set_target(uint8_t* pixels, int x, int y, int width, int height);
+
+/* Copy screen region (overlap safe, latch copy when byte aligned) */
 void vga_copyrect(int sx, int sy, int dx, int dy, int w, int h);
 
-/* Swap double buffer (if using) */
+/* Swap double buffer (flushes shadow framebuffer damage at vsync) */
 void vga_swap(void);
 
+/* Enable/disable the system-RAM shadow framebuffer (draw to RAM, flush on swap) */
+void vga_set_shadow(int enable);
+
+/* Check if the shadow framebuffer is in use */
+int vga_shadow_enabled(void);
+
 /* Wait for vertical retrace (smooth animation) */
 void vga_vsync(void);
 
-/* Set VGA mode (0=640x480, 1=320x200) */
+/* Set mode (VGA_MODE_*), keeps the current one if unavailable */
 void vga_set_mode(int mode);
 
 /* Get current VGA mode */
 int vga_get_mode(void);
 
+/* Check if vga_init has brought up a display */
+int vga_started(void);
+
+/* Memory type (PAGE_CACHE_*) for the linear framebuffer, write-combining
+ * by default (needs PAT); lasts across mode switches. Returns 0 if the
+ * current mode has none (Mode 12h is always uncached for its latch reads). */
+int vga_set_framebuffer_cache(int type);
+
 #endif /* VGA_H */
@@ -0,0 +1,395 @@
+/*
+ * vga_lfb.c - Linear framebuffer display drivers for GegOS
+ * 32bpp framebuffer from the bootloader (multiboot_driver) and the
+ * Bochs/QEMU graphics adapter at 8 or 32bpp with page flipping
+ * (bga_driver, bga640_driver), sharing the same pixel code
+ */
+
+#include "vga.h"
+#include "display.h"
+#include "font.h"
+#include "io.h"
+
+/* SSE2 vectors: four pixels per store (the _u type allows unaligned access) */
+typedef uint32_t v4u32 __attribute__((vector_size(16)));
+typedef uint32_t v4u32_u __attribute__((vector_size(16), aligned(4)));
+typedef uint8_t v16u8_u __attribute__((vector_size(16), aligned(1)));
+
+#define PAL(c) display_palette[(c) & 0x0F]
+
+/* Framebuffer of the active driver. Drawing goes to the visible page,
+ * present() to the hidden one (the same page when not flipping). */
+static uint8_t* fb_front = 0;
+static uint8_t* fb_back = 0;
+static int fb_pitch = 0;        /* in bytes */
+
+static inline uint32_t* pixel_at(int x, int y) {
+    return (uint32_t*)(fb_front + (long)y * fb_pitch) + x;
+}
+
+static inline uint32_t* back_row(int y) {
+    return (uint32_t*)(fb_back + (long)y * fb_pitch);
+}
+
+/* ===== Row primitives ===== */
+
+/* Fill n pixels - aligned 16-byte stores for the bulk of the row */
+static void fill_row(uint32_t* p, int n, uint32_t c) {
+    while (n > 0 && ((uintptr_t)p & 15)) { *p++ = c; n--; }
+    v4u32 v = { c, c, c, c };
+    while (n >= 4) {
+        *(v4u32*)p = v;
+        p += 4;
+        n -= 4;
+    }
+    while (n-- > 0) *p++ = c;
+}
+
+/* Copy n pixels (overlap safe) */
+static void copy_row(uint32_t* dst, const uint32_t* src, int n) {
+    if (dst > src && dst < src + n) {
+        while (n >= 4) {
+            n -= 4;
+            *(v4u32_u*)(dst + n) = *(const v4u32_u*)(src + n);
+        }
+        while (n-- > 0) dst[n] = src[n];
+        return;
+    }
+    int i = 0;
+    for (; i + 4 <= n; i += 4) {
+        *(v4u32_u*)(dst + i) = *(const v4u32_u*)(src + i);
+    }
+    for (; i < n; i++) dst[i] = src[i];
+}
+
+/* Map an RGB value back to its palette index */
+static uint8_t palette_index(uint32_t rgb) {
+    rgb &= 0xFFFFFF;
+    for (int i = 0; i < 16; i++) {
+        if (display_palette[i] == rgb) return (uint8_t)i;
+    }
+    return 0;
+}
+
+/* ===== 32bpp driver operations ===== */
+
+static void lfb_fill(int x, int y, int w, int h, uint8_t color) {
+    uint32_t c = PAL(color);
+    uint32_t* row = pixel_at(x, y);
+    for (int j = 0; j < h; j++) {
+        fill_row(row, w, c);
+        row += fb_pitch / 4;
+    }
+}
+
+static uint8_t lfb_getpixel(int x, int y) {
+    return palette_index(*pixel_at(x, y));
+}
+
+static void lfb_blit(int x, int y, int w, int h, const uint8_t* src, int pitch) {
+    for (int j = 0; j < h; j++) {
+        const uint8_t* s = src + j * pitch;
+        uint32_t* dst = pixel_at(x, y + j);
+        for (int i = 0; i < w; i++) {
+            if (s[i] != VGA_TRANSPARENT) dst[i] = PAL(s[i]);
+        }
+    }
+}
+
+static void lfb_copy(int sx, int sy, int dx, int dy, int w, int h) {
+    int step = (dy > sy) ? -1 : 1;
+    int row0 = (dy > sy) ? h - 1 : 0;
+    for (int j = 0, r = row0; j < h; j++, r += step) {
+        copy_row(pixel_at(dx, dy + r), pixel_at(sx, sy + r), w);
+    }
+}
+
+static void lfb_glyphs(int x, int y, const char* str, int n, uint8_t fg, uint8_t bg) {
+    int cx = x, cy = y, cw = n * 8, ch = 8;
+    if (!display_clip_rect(&cx, &cy, &cw, &ch)) return;
+    
+    uint32_t colors[2] = { PAL(bg), PAL(fg) };
+    for (int j = cy; j < cy + ch; j++) {
+        uint32_t* dst = pixel_at(0, j);
+        for (int px = cx; px < cx + cw; px++) {
+            int col = px - x;
+            unsigned char c = (unsigned char)str[col >> 3];
+            uint8_t g = font8x8[c > 127 ? '?' : c][j - y];
+            dst[px] = colors[(g >> (7 - (col & 7))) & 1];
+        }
+    }
+}
+
+/* Expand shadow rows to 32bpp, four pixels per store */
+static void lfb_present(const uint8_t* src, int pitch, int x0, int y0, int x1, int y1) {
+    for (int y = y0; y < y1; y++) {
+        const uint8_t* s = src + y * pitch;
+        uint32_t* d = back_row(y);
+        int x = x0;
+        for (; x + 4 <= x1; x += 4) {
+            v4u32 v = { PAL(s[x]), PAL(s[x + 1]), PAL(s[x + 2]), PAL(s[x + 3]) };
+            *(v4u32_u*)(d + x) = v;
+        }
+        for (; x < x1; x++) d[x] = PAL(s[x]);
+    }
+}
+
+static void lfb_readback(uint8_t* dst, int pitch) {
+    for (int y = 0; y < SCREEN_HEIGHT; y++) {
+        const uint32_t* s = pixel_at(0, y);
+        for (int x = 0; x < SCREEN_WIDTH; x++) {
+            dst[y * pitch + x] = palette_index(s[x]);
+        }
+    }
+}
+
+/* ===== 8bpp driver operations (pixel = palette index) ===== */
+
+static void lfb8_fill(int x, int y, int w, int h, uint8_t color) {
+    chunky_fill(fb_front, fb_pitch, x, y, w, h, color);
+}
+
+static uint8_t lfb8_getpixel(int x, int y) {
+    return fb_front[(long)y * fb_pitch + x];
+}
+
+static void lfb8_blit(int x, int y, int w, int h, const uint8_t* src, int pitch) {
+    chunky_blit(fb_front, fb_pitch, x, y, w, h, src, pitch);
+}
+
+static void lfb8_copy(int sx, int sy, int dx, int dy, int w, int h) {
+    chunky_copy(fb_front, fb_pitch, sx, sy, dx, dy, w, h);
+}
+
+static void lfb8_glyphs(int x, int y, const char* str, int n, uint8_t fg, uint8_t bg) {
+    chunky_text(fb_front, fb_pitch, x, y, str, n, fg, bg);
+}
+
+/* Same layout as the shadow framebuffer - plain row copies */
+static void lfb8_present(const uint8_t* src, int pitch, int x0, int y0, int x1, int y1) {
+    for (int y = y0; y < y1; y++) {
+        const uint8_t* s = src + y * pitch + x0;
+        uint8_t* d = fb_back + (long)y * fb_pitch + x0;
+        int n = x1 - x0, i = 0;
+        for (; i + 16 <= n; i += 16) {
+            *(v16u8_u*)(d + i) = *(const v16u8_u*)(s + i);
+        }
+        for (; i < n; i++) d[i] = s[i];
+    }
+}
+
+static void lfb8_readback(uint8_t* dst, int pitch) {
+    for (int y = 0; y < SCREEN_HEIGHT; y++) {
+        const uint8_t* s = fb_front + (long)y * fb_pitch;
+        for (int x = 0; x < SCREEN_WIDTH; x++) {
+            dst[y * pitch + x] = s[x] & 0x0F;
+        }
+    }
+}
+
+/* ===== Bochs/QEMU graphics adapter (DISPI interface) ===== */
+
+#define BGA_INDEX_PORT  0x01CE
+#define BGA_DATA_PORT   0x01CF
+
+#define BGA_REG_ID      0
+#define BGA_REG_XRES    1
+#define BGA_REG_YRES    2
+#define BGA_REG_BPP     3
+#define BGA_REG_ENABLE  4
+#define BGA_REG_VIRT_W  6
+#define BGA_REG_VIRT_H  7
+#define BGA_REG_Y_OFF   9
+
+#define BGA_ID_MIN      0xB0C0
+#define BGA_ID_MAX      0xB0C5
+
+#define BGA_ENABLED     0x01
+#define BGA_LFB_ENABLED 0x40
+
+/* Modes - high resolution keeps 32bpp like the bootloader framebuffer,
+ * 640x480 uses 8bpp so present() is a straight copy of the shadow */
+#define BGA_WIDTH       1024
+#define BGA_HEIGHT      768
+#define BGA640_WIDTH    640
+#define BGA640_HEIGHT   480
+
+/* Where QEMU puts BAR0 when PCI lookup fails */
+#define BGA_DEFAULT_LFB 0xE0000000
+
+static void bga_write(uint16_t index, uint16_t value) {
+    outw(BGA_INDEX_PORT, index);
+    outw(BGA_DATA_PORT, value);
+}
+
+static uint16_t bga_read(uint16_t index) {
+    outw(BGA_INDEX_PORT, index);
+    return inw(BGA_DATA_PORT);
+}
+
+static int bga_present(void) {
+    uint16_t id = bga_read(BGA_REG_ID);
+    return id >= BGA_ID_MIN && id <= BGA_ID_MAX;
+}
+
+/* Program a DISPI mode with the linear framebuffer enabled */
+static void bga_set(int width, int height, int bpp, int virt_height) {
+    bga_write(BGA_REG_ENABLE, 0);
+    bga_write(BGA_REG_XRES, (uint16_t)width);
+    bga_write(BGA_REG_YRES, (uint16_t)height);
+    bga_write(BGA_REG_BPP, (uint16_t)bpp);
+    bga_write(BGA_REG_ENABLE, BGA_ENABLED | BGA_LFB_ENABLED);
+    bga_write(BGA_REG_VIRT_W, (uint16_t)width);
+    bga_write(BGA_REG_VIRT_H, (uint16_t)virt_height);
+    bga_write(BGA_REG_Y_OFF, 0);
+}
+
+/* Find the framebuffer: BAR0 of the 1234:1111 display device on PCI bus 0 */
+static uint32_t bga_find_lfb(void) {
+    for (uint32_t dev = 0; dev < 32; dev++) {
+        uint32_t addr = 0x80000000 | (dev << 11);
+        outl(0xCF8, addr);
+        if (inl(0xCFC) != 0x11111234) continue;
+        outl(0xCF8, addr | 0x10);
+        uint32_t bar = inl(0xCFC) & ~0xFu;
+        if (bar) return bar;
+    }
+    return BGA_DEFAULT_LFB;
+}
+
+/* Page flipping state: page 0 at scanline 0, page 1 right below it */
+static uint8_t* bga_base = 0;
+static int bga_height = 0;
+static int bga_page = 0;        /* page on screen */
+
+/* Set a mode with two pages of virtual height when VRAM allows it */
+static int bga_start(int width, int height, int bpp) {
+    if (!bga_present()) return 0;
+    bga_set(width, height, bpp, height * 2);
+    if (bpp == 8) display_load_dac();
+    
+    bga_base = (uint8_t*)(uintptr_t)bga_find_lfb();
+    bga_height = height;
+    bga_page = 0;
+    fb_pitch = width * bpp / 8;
+    display_map_framebuffer((uintptr_t)bga_base, (uint64_t)fb_pitch * height * 2);
+    fb_front = bga_base;
+    /* The adapter clamps the virtual height to its memory */
+    if (bga_read(BGA_REG_VIRT_H) >= height * 2) {
+        fb_back = bga_base + (long)height * fb_pitch;
+    } else {
+        fb_back = fb_front;
+    }
+    return 1;
+}
+
+/* Show the hidden page during vertical retrace */
+static void bga_flip(void) {
+    display_vga_vsync();
+    if (fb_back == fb_front) return;
+    
+    bga_page ^= 1;
+    bga_write(BGA_REG_Y_OFF, (uint16_t)(bga_page * bga_height));
+    uint8_t* t = fb_front;
+    fb_front = fb_back;
+    fb_back = t;
+}
+
+static int bga_init(void) {
+    return bga_start(BGA_WIDTH, BGA_HEIGHT, 32);
+}
+
+static int bga640_init(void) {
+    return bga_start(BGA640_WIDTH, BGA640_HEIGHT, 8);
+}
+
+/* Back to VGA compatible operation */
+static void bga_leave(void) {
+    bga_write(BGA_REG_ENABLE, 0);
+}
+
+display_driver_t bga_driver = {
+    .name = "1024x768",
+    .width = BGA_WIDTH,
+    .height = BGA_HEIGHT,
+    .init = bga_init,
+    .leave = bga_leave,
+    .fill = lfb_fill,
+    .getpixel = lfb_getpixel,
+    .blit = lfb_blit,
+    .copy = lfb_copy,
+    .glyphs = lfb_glyphs,
+    .present = lfb_present,
+    .flip = bga_flip,
+    .readback = lfb_readback,
+    .vsync = display_vga_vsync,
+};
+
+display_driver_t bga640_driver = {
+    .name = "640x480",
+    .width = BGA640_WIDTH,
+    .height = BGA640_HEIGHT,
+    .init = bga640_init,
+    .leave = bga_leave,
+    .fill = lfb8_fill,
+    .getpixel = lfb8_getpixel,
+    .blit = lfb8_blit,
+    .copy = lfb8_copy,
+    .glyphs = lfb8_glyphs,
+    .present = lfb8_present,
+    .flip = bga_flip,
+    .readback = lfb8_readback,
+    .vsync = display_vga_vsync,
+};
+
+/* ===== Bootloader framebuffer ===== */
+
+static uint8_t* mb_fb = 0;
+static int mb_pitch = 0;        /* in bytes */
+static int mb_on_bga = 0;       /* mode was set through BGA, can be restored */
+static int mb_lost = 0;         /* left for a VGA mode that cannot be undone */
+
+/* Describe the bootloader framebuffer, returns 0 if it is unusable */
+int multiboot_fb_setup(uint64_t addr, uint32_t pitch, uint32_t width, uint32_t height, uint8_t bpp) {
+    if (!addr || addr > 0xFFFFFFFFull || bpp != 32 || !width || !height) return 0;
+    mb_fb = (uint8_t*)(uintptr_t)addr;
+    mb_pitch = (int)pitch;
+    multiboot_driver.width = (int)width;
+    multiboot_driver.height = (int)height;
+    return 1;
+}
+
+static int multiboot_init(void) {
+    if (!mb_fb || mb_lost) return 0;
+    if (mb_on_bga) {
+        bga_set(multiboot_driver.width, multiboot_driver.height, 32, multiboot_driver.height);
+    }
+    fb_front = fb_back = mb_fb;
+    fb_pitch = mb_pitch;
+    display_map_framebuffer((uintptr_t)mb_fb, (uint64_t)mb_pitch * multiboot_driver.height);
+    return 1;
+}
+
+/* Leaving for a VGA mode: only a BGA-backed framebuffer can come back */
+static void multiboot_leave(void) {
+    if (bga_present()) {
+        mb_on_bga = 1;
+        bga_leave();
+    } else {
+        mb_lost = 1;
+    }
+}
+
+display_driver_t multiboot_driver = {
+    .name = "boot framebuffer",
+    .init = multiboot_init,
+    .leave = multiboot_leave,
+    .fill = lfb_fill,
+    .getpixel = lfb_getpixel,
+    .blit = lfb_blit,
+    .copy = lfb_copy,
+    .glyphs = lfb_glyphs,
+    .present = lfb_present,
+    .readback = lfb_readback,
+    .vsync = display_vga_vsync,
+};
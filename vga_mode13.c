@@ -0,0 +1,103 @@
+/*
+ * vga_mode13.c - Mode 13h display driver for GegOS
+ * 320x200, one byte per pixel at 0xA0000 (only colours 0-15 are used)
+ */
+
+#include "vga.h"
+#include "display.h"
+
+/* Linear framebuffer of Mode 13h */
+#define MODE13_MEMORY ((uint8_t*)0xA0000)
+
+/* Mode 13h geometry */
+#define MODE13_WIDTH   320
+#define MODE13_HEIGHT  200
+
+/* Mode 13h register values (320x200, chain-4) */
+static const uint8_t mode13h_misc = 0x63;
+
+static const uint8_t mode13h_seq[] = {
+    0x03, 0x01, 0x0F, 0x00, 0x0E
+};
+
+static const uint8_t mode13h_crtc[] = {
+    0x5F, 0x4F, 0x50, 0x82, 0x54, 0x80, 0xBF, 0x1F,
+    0x00, 0x41, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0x9C, 0x0E, 0x8F, 0x28, 0x40, 0x96, 0xB9, 0xA3,
+    0xFF
+};
+
+static const uint8_t mode13h_gc[] = {
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x40, 0x05, 0x0F,
+    0xFF
+};
+
+static const uint8_t mode13h_ac[] = {
+    0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
+    0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F,
+    0x41, 0x00, 0x0F, 0x00, 0x00
+};
+
+static int mode13_init(void) {
+    display_program_vga(mode13h_misc, mode13h_seq, mode13h_crtc, mode13h_gc, mode13h_ac);
+    display_load_dac();
+    
+    /* Plain memory in this mode, so stores may be combined */
+    display_map_framebuffer((uintptr_t)MODE13_MEMORY, MODE13_WIDTH * MODE13_HEIGHT);
+    return 1;
+}
+
+/* Video memory has the same layout as the shadow framebuffer, so all
+ * drawing is the shared chunky code pointed at 0xA0000 */
+static void mode13_fill(int x, int y, int w, int h, uint8_t color) {
+    chunky_fill(MODE13_MEMORY, MODE13_WIDTH, x, y, w, h, color);
+}
+
+static uint8_t mode13_getpixel(int x, int y) {
+    return MODE13_MEMORY[y * MODE13_WIDTH + x];
+}
+
+static void mode13_blit(int x, int y, int w, int h, const uint8_t* src, int pitch) {
+    chunky_blit(MODE13_MEMORY, MODE13_WIDTH, x, y, w, h, src, pitch);
+}
+
+static void mode13_copy(int sx, int sy, int dx, int dy, int w, int h) {
+    chunky_copy(MODE13_MEMORY, MODE13_WIDTH, sx, sy, dx, dy, w, h);
+}
+
+static void mode13_glyphs(int x, int y, const char* str, int n, uint8_t fg, uint8_t bg) {
+    chunky_text(MODE13_MEMORY, MODE13_WIDTH, x, y, str, n, fg, bg);
+}
+
+static void mode13_present(const uint8_t* src, int pitch, int x0, int y0, int x1, int y1) {
+    for (int y = y0; y < y1; y++) {
+        const uint8_t* s = src + y * pitch;
+        uint8_t* d = MODE13_MEMORY + y * MODE13_WIDTH;
+        for (int x = x0; x < x1; x++) {
+            d[x] = s[x];
+        }
+    }
+}
+
+static void mode13_readback(uint8_t* dst, int pitch) {
+    for (int y = 0; y < MODE13_HEIGHT; y++) {
+        for (int x = 0; x < MODE13_WIDTH; x++) {
+            dst[y * pitch + x] = MODE13_MEMORY[y * MODE13_WIDTH + x] & 0x0F;
+        }
+    }
+}
+
+display_driver_t mode13_driver = {
+    .name = "320x200",
+    .width = MODE13_WIDTH,
+    .height = MODE13_HEIGHT,
+    .init = mode13_init,
+    .fill = mode13_fill,
+    .getpixel = mode13_getpixel,
+    .blit = mode13_blit,
+    .copy = mode13_copy,
+    .glyphs = mode13_glyphs,
+    .present = mode13_present,
+    .readback = mode13_readback,
+    .vsync = display_vga_vsync,
+};
@@ -0,0 +1,589 @@
+/*
+ * vga_planar.c - Mode 12h display driver for GegOS
+ * 640x480, 16 colors, planar
+ */
+
+#include "vga.h"
+#include "display.h"
+#include "font.h"
+#include "io.h"
+#include "paging.h"
+
+/* VGA framebuffer address (volatile: latch reads must not be elided) */
+static volatile uint8_t* const VGA_MEMORY = (volatile uint8_t*)0xA0000;
+
+/* Graphics controller registers */
+#define GC_SET_RESET        0x00
+#define GC_ENABLE_SET_RESET 0x01
+#define GC_DATA_ROTATE      0x03
+#define GC_GRAPHICS_MODE    0x05
+#define GC_BIT_MASK         0x08
+#define GC_READ_MAP_SELECT  0x04
+
+/* Sequencer registers */
+#define SEQ_MAP_MASK        0x02
+
+/* Mode 12h register values (640x480, 16 color) */
+static const uint8_t mode12h_misc = 0xE3;
+
+static const uint8_t mode12h_seq[] = {
+    0x03, 0x01, 0x0F, 0x00, 0x06
+};
+
+static const uint8_t mode12h_crtc[] = {
+    0x5F, 0x4F, 0x50, 0x82, 0x54, 0x80, 0x0B, 0x3E,
+    0x00, 0x40, 0x00, 0x00, 0x00, 0x00, 0x00, 0x00,
+    0xEA, 0x0C, 0xDF, 0x28, 0x00, 0xE7, 0x04, 0xE3,
+    0xFF
+};
+
+static const uint8_t mode12h_gc[] = {
+    0x00, 0x00, 0x00, 0x00, 0x00, 0x00, 0x05, 0x0F,
+    0xFF
+};
+
+/* Palette maps straight to DAC 0-15 (loaded by display_load_dac) */
+static const uint8_t mode12h_ac[] = {
+    0x00, 0x01, 0x02, 0x03, 0x04, 0x05, 0x06, 0x07,
+    0x08, 0x09, 0x0A, 0x0B, 0x0C, 0x0D, 0x0E, 0x0F,
+    0x01, 0x00, 0x0F, 0x00, 0x00
+};
+
+/* Mode 12h geometry */
+#define PLANAR_WIDTH   640
+#define PLANAR_HEIGHT  480
+
+/* Bytes per line in planar mode */
+#define BYTES_PER_LINE 80
+
+/*
+ * Register shadow - every GC/sequencer write goes through these helpers,
+ * so consecutive primitives that share state (same colour, same bit mask)
+ * cost no port I/O beyond the first. Index and data go out as a single
+ * outw. planar_init() loads the shadow from the mode table it programs,
+ * so it stays right across mode switches.
+ */
+static uint16_t gc_shadow[9];
+static uint16_t map_mask_shadow;
+
+static inline void gc_write(uint8_t index, uint8_t value) {
+    if (gc_shadow[index] == value) return;
+    gc_shadow[index] = value;
+    outw(VGA_GC_INDEX, (uint16_t)((value << 8) | index));
+}
+
+static inline void set_map_mask(uint8_t mask) {
+    if (map_mask_shadow == mask) return;
+    map_mask_shadow = mask;
+    outw(VGA_SEQ_INDEX, (uint16_t)((mask << 8) | SEQ_MAP_MASK));
+}
+
+/* Set read plane */
+static void set_read_plane(uint8_t plane) {
+    gc_write(GC_READ_MAP_SELECT, plane);
+}
+
+/* Set bit mask (which pixels of a byte a write touches) */
+static inline void set_bit_mask(uint8_t mask) {
+    gc_write(GC_BIT_MASK, mask);
+}
+
+/* Solid colour state: write mode 0 with set/reset driving all four planes,
+ * so the CPU data byte is ignored and only the bit mask matters */
+static inline void set_solid_color(uint8_t color) {
+    gc_write(GC_GRAPHICS_MODE, 0x00);
+    gc_write(GC_DATA_ROTATE, 0x00);
+    gc_write(GC_ENABLE_SET_RESET, 0x0F);
+    gc_write(GC_SET_RESET, color & 0x0F);
+    set_map_mask(0x0F);
+}
+
+/* Single-plane state for masked paths: plane is read back through the
+ * read map, merged in software and written with only that plane enabled */
+static void select_plane(int plane) {
+    gc_write(GC_GRAPHICS_MODE, 0x00);
+    gc_write(GC_DATA_ROTATE, 0x00);
+    gc_write(GC_ENABLE_SET_RESET, 0x00);
+    set_bit_mask(0xFF);
+    set_read_plane(plane);
+    set_map_mask(1 << plane);
+}
+
+/* Write plane bits under a pixel mask (plane selected by select_plane) */
+static inline void plane_merge(volatile uint8_t* p, uint8_t bits, uint8_t mask) {
+    if (mask != 0xFF) bits = (uint8_t)((*p & ~mask) | (bits & mask));
+    *p = bits;
+}
+
+/* Partial byte column: the latch read keeps the pixels outside the mask */
+static void fill_column(volatile uint8_t* p, int h, uint8_t mask) {
+    set_bit_mask(mask);
+    for (int j = 0; j < h; j++) {
+        (void)*p;
+        *p = 0xFF;
+        p += BYTES_PER_LINE;
+    }
+}
+
+/*
+ * Span fill engine. Colour state must already be set. The rectangle is
+ * filled in column bands - left edge byte, solid middle, right edge byte -
+ * so the bit mask is programmed at most three times per rectangle
+ * regardless of its height. Middle bytes need no latch read.
+ */
+static void fill_spans(int x, int y, int w, int h) {
+    volatile uint8_t* row = VGA_MEMORY + y * BYTES_PER_LINE;
+    int first = x >> 3;
+    int last = (x + w - 1) >> 3;
+    uint8_t lmask = 0xFF >> (x & 7);
+    uint8_t rmask = (uint8_t)(0xFF << (7 - ((x + w - 1) & 7)));
+    
+    if (first == last) {
+        fill_column(row + first, h, lmask & rmask);
+        return;
+    }
+    if (lmask != 0xFF) fill_column(row + first++, h, lmask);
+    if (rmask != 0xFF) fill_column(row + last--, h, rmask);
+    if (first > last) return;
+    
+    set_bit_mask(0xFF);
+    int count = last - first + 1;
+    for (int j = 0; j < h; j++) {
+        volatile uint8_t* p = row + first;
+        for (int i = 0; i < count; i++) {
+            p[i] = 0xFF;
+        }
+        row += BYTES_PER_LINE;
+    }
+}
+
+/* ============================================================================
+ * OFF-SCREEN CACHE - Mode 12h only uses the first 38400 bytes of each
+ * 64 KiB plane. The tail holds pre-rendered glyphs and sprites, which are
+ * blitted on screen with latch copies (one read/write pair per byte column
+ * covers all four planes).
+ * ============================================================================ */
+
+#define VRAM_OFFSCREEN_START (BYTES_PER_LINE * PLANAR_HEIGHT)
+#define VRAM_PLANE_SIZE      0x10000
+
+/* Glyph sets: all 128 glyphs pre-rendered for one fg/bg pair, 8 bytes each */
+#define GLYPH_SET_BYTES      (128 * 8)
+#define MAX_GLYPH_SETS       16
+#define GLYPH_POOL_START     (VRAM_PLANE_SIZE - MAX_GLYPH_SETS * GLYPH_SET_BYTES)
+
+typedef struct {
+    uint8_t fg, bg;
+    int valid;
+    uint32_t last_used;
+} glyph_set_t;
+
+static glyph_set_t glyph_sets[MAX_GLYPH_SETS];
+static uint32_t glyph_clock = 0;
+static int vram_next = VRAM_OFFSCREEN_START;
+
+/* Forget everything cached off-screen (VRAM contents are gone; the
+ * front end drops sprite cache handles on every mode set) */
+static void offscreen_reset(void) {
+    for (int i = 0; i < MAX_GLYPH_SETS; i++) {
+        glyph_sets[i].valid = 0;
+    }
+    vram_next = VRAM_OFFSCREEN_START;
+}
+
+/* Allocate off-screen bytes (per plane), returns offset or 0 if full */
+static int vram_alloc(int bytes) {
+    if (vram_next + bytes > GLYPH_POOL_START) return 0;
+    int offset = vram_next;
+    vram_next += bytes;
+    return offset;
+}
+
+/* Latch blit of an off-screen block (pitch = width_bytes) to the screen */
+static void blit_offscreen(int offset, int x, int y, int width_bytes, int h) {
+    volatile uint8_t* src = VGA_MEMORY + offset;
+    volatile uint8_t* dst = VGA_MEMORY + y * BYTES_PER_LINE + (x >> 3);
+    
+    gc_write(GC_GRAPHICS_MODE, 0x01);
+    set_map_mask(0x0F);
+    for (int j = 0; j < h; j++) {
+        for (int i = 0; i < width_bytes; i++) {
+            dst[i] = src[i];
+        }
+        src += width_bytes;
+        dst += BYTES_PER_LINE;
+    }
+}
+
+/* Find the glyph set for a colour pair, rendering it (LRU slot) if needed */
+static int glyph_set_for(uint8_t fg, uint8_t bg) {
+    int victim = 0;
+    glyph_clock++;
+    
+    for (int i = 0; i < MAX_GLYPH_SETS; i++) {
+        glyph_set_t* gs = &glyph_sets[i];
+        if (gs->valid && gs->fg == fg && gs->bg == bg) {
+            gs->last_used = glyph_clock;
+            return i;
+        }
+        if (!gs->valid) {
+            victim = i;
+        } else if (glyph_sets[victim].valid && gs->last_used < glyph_sets[victim].last_used) {
+            victim = i;
+        }
+    }
+    
+    /* Render the set one plane at a time */
+    volatile uint8_t* dst = VGA_MEMORY + GLYPH_POOL_START + victim * GLYPH_SET_BYTES;
+    for (int plane = 0; plane < 4; plane++) {
+        uint8_t fg_bits = (fg & (1 << plane)) ? 0xFF : 0x00;
+        uint8_t bg_bits = (bg & (1 << plane)) ? 0xFF : 0x00;
+        select_plane(plane);
+        for (int i = 0; i < GLYPH_SET_BYTES; i++) {
+            uint8_t g = font8x8[i >> 3][i & 7];
+            dst[i] = (uint8_t)((g & fg_bits) | (~g & bg_bits));
+        }
+    }
+    
+    glyph_sets[victim].fg = fg;
+    glyph_sets[victim].bg = bg;
+    glyph_sets[victim].valid = 1;
+    glyph_sets[victim].last_used = glyph_clock;
+    return victim;
+}
+
+/* Cached glyph blit - byte-aligned x, fully on-screen, planar mode only */
+static void blit_glyph(int x, int y, unsigned char c, uint8_t fg, uint8_t bg) {
+    int set = glyph_set_for(fg & 0x0F, bg & 0x0F);
+    blit_offscreen(GLYPH_POOL_START + set * GLYPH_SET_BYTES + c * 8, x, y, 1, 8);
+}
+
+/* Copy a sprite's pixels into off-screen VRAM */
+static int sprite_upload(display_sprite_t* spr) {
+    int width_bytes = spr->width >> 3;
+    int offset = vram_alloc(width_bytes * spr->height);
+    if (!offset) return 0;
+    
+    for (int plane = 0; plane < 4; plane++) {
+        volatile uint8_t* dst = VGA_MEMORY + offset;
+        const uint8_t* src = spr->pixels;
+        select_plane(plane);
+        for (int i = 0; i < width_bytes * spr->height; i++) {
+            uint8_t bits = 0;
+            for (int b = 0; b < 8; b++) {
+                bits = (uint8_t)((bits << 1) | ((*src++ >> plane) & 1));
+            }
+            dst[i] = bits;
+        }
+    }
+    spr->cache = offset;
+    return 1;
+}
+
+/* Sprite op - latch blit from off-screen VRAM when opaque, whole bytes,
+ * byte aligned and fully on screen */
+static int planar_sprite(display_sprite_t* spr, int x, int y) {
+    if (!spr->opaque || (spr->width & 7) || (x & 7)) return 0;
+    if (x < 0 || y < 0 || x + spr->width > PLANAR_WIDTH || y + spr->height > PLANAR_HEIGHT) return 0;
+    if (!spr->cache && !sprite_upload(spr)) return 0;
+    blit_offscreen(spr->cache, x, y, spr->width >> 3, spr->height);
+    return 1;
+}
+
+/* ===== Driver operations ===== */
+
+/* Initialize VGA Mode 12h (640x480, 16 colors) */
+static int planar_init(void) {
+    display_program_vga(mode12h_misc, mode12h_seq, mode12h_crtc, mode12h_gc, mode12h_ac);
+    display_load_dac();
+    
+    /* Reads load the latches, so they must not be speculative (Mode 13h
+     * may have left the window write-combining) */
+    paging_set_cache((uintptr_t)VGA_MEMORY, VRAM_PLANE_SIZE, PAGE_CACHE_UNCACHED);
+    
+    /* Registers now hold the mode table values */
+    for (int i = 0; i < 9; i++) {
+        gc_shadow[i] = mode12h_gc[i];
+    }
+    map_mask_shadow = mode12h_seq[SEQ_MAP_MASK];
+    
+    /* Off-screen contents do not survive a mode set */
+    offscreen_reset();
+    return 1;
+}
+
+/* Solid fill through the span engine */
+static void planar_fill(int x, int y, int w, int h, uint8_t color) {
+    set_solid_color(color);
+    fill_spans(x, y, w, h);
+}
+
+/* Get pixel */
+static uint8_t planar_getpixel(int x, int y) {
+    int offset = y * BYTES_PER_LINE + x / 8;
+    uint8_t mask = 0x80 >> (x & 7);
+    uint8_t color = 0;
+    
+    for (int plane = 0; plane < 4; plane++) {
+        set_read_plane(plane);
+        if (VGA_MEMORY[offset] & mask) {
+            color |= (1 << plane);
+        }
+    }
+    return color;
+}
+
+/* Left/right edge masks of a pixel span */
+static inline uint8_t left_mask(int x) {
+    return 0xFF >> (x & 7);
+}
+
+static inline uint8_t right_mask(int x_last) {
+    return (uint8_t)(0xFF << (7 - (x_last & 7)));
+}
+
+/*
+ * Masked copy - any alignment. Works plane by plane: each source row is
+ * read into a buffer first (so overlapping rows are safe), shifted to the
+ * destination alignment and merged at the edges in software.
+ */
+static void copy_planes(int sx, int sy, int dx, int dy, int w, int h) {
+    uint8_t buf[BYTES_PER_LINE + 3];
+    int sfirst = sx >> 3;
+    int scount = ((sx + w - 1) >> 3) - sfirst + 1;
+    int dfirst = dx >> 3;
+    int dlast = (dx + w - 1) >> 3;
+    uint8_t lmask = left_mask(dx);
+    uint8_t rmask = right_mask(dx + w - 1);
+    int bit_off = 8 + (sx & 7) - (dx & 7);  /* +8 for the pad byte */
+    int step = (dy > sy) ? -1 : 1;
+    int row0 = (dy > sy) ? h - 1 : 0;
+    
+    for (int plane = 0; plane < 4; plane++) {
+        select_plane(plane);
+        for (int j = 0, r = row0; j < h; j++, r += step) {
+            volatile uint8_t* src = VGA_MEMORY + (sy + r) * BYTES_PER_LINE + sfirst;
+            volatile uint8_t* dst = VGA_MEMORY + (dy + r) * BYTES_PER_LINE;
+    
+            buf[0] = 0;
+            for (int i = 0; i < scount; i++) buf[i + 1] = src[i];
+            buf[scount + 1] = 0;
+            buf[scount + 2] = 0;
+    
+            for (int b = dfirst, off = bit_off; b <= dlast; b++, off += 8) {
+                int k = off >> 3;
+                int shift = off & 7;
+                uint8_t bits = (uint8_t)((buf[k] << shift) | (buf[k + 1] >> (8 - shift)));
+                uint8_t mask = 0xFF;
+                if (b == dfirst) mask &= lmask;
+                if (b == dlast) mask &= rmask;
+                plane_merge(dst + b, bits, mask);
+            }
+        }
+    }
+}
+
+/*
+ * Latch copy - whole bytes, same bit alignment. Write mode 1 stores the
+ * latches loaded by the source read, so all four planes move with one
+ * read/write pair per byte. Write mode is left at 1; every other writer
+ * sets the mode it needs.
+ */
+static void copy_latched(int sbyte, int sy, int dbyte, int dy, int count, int h) {
+    int step = (dy > sy) ? -1 : 1;
+    int row0 = (dy > sy) ? h - 1 : 0;
+    int backwards = dbyte > sbyte;
+    
+    gc_write(GC_GRAPHICS_MODE, 0x01);
+    set_map_mask(0x0F);
+    
+    for (int j = 0, r = row0; j < h; j++, r += step) {
+        volatile uint8_t* src = VGA_MEMORY + (sy + r) * BYTES_PER_LINE + sbyte;
+        volatile uint8_t* dst = VGA_MEMORY + (dy + r) * BYTES_PER_LINE + dbyte;
+        if (backwards) {
+            for (int i = count - 1; i >= 0; i--) dst[i] = src[i];
+        } else {
+            for (int i = 0; i < count; i++) dst[i] = src[i];
+        }
+    }
+}
+
+/* Copy screen region (overlap safe) */
+static void planar_copy(int sx, int sy, int dx, int dy, int w, int h) {
+    if ((sx & 7) != (dx & 7)) {
+        copy_planes(sx, sy, dx, dy, w, h);
+        return;
+    }
+    
+    /* Same alignment: latch-copy the whole bytes, masked copy the edges.
+     * Parts run in the copy direction so none overwrites another's source. */
+    int lead = (8 - (dx & 7)) & 7;          /* pixels before first whole byte */
+    if (lead > w) lead = w;
+    int tail = (dx + w) & 7;                /* pixels after last whole byte */
+    if (lead + tail > w) tail = 0;
+    int mid = (w - lead - tail) >> 3;       /* whole bytes */
+    
+    if (dx > sx) {
+        if (tail) copy_planes(sx + w - tail, sy, dx + w - tail, dy, tail, h);
+        if (mid) copy_latched((sx + lead) >> 3, sy, (dx + lead) >> 3, dy, mid, h);
+        if (lead) copy_planes(sx, sy, dx, dy, lead, h);
+    } else {
+        if (lead) copy_planes(sx, sy, dx, dy, lead, h);
+        if (mid) copy_latched((sx + lead) >> 3, sy, (dx + lead) >> 3, dy, mid, h);
+        if (tail) copy_planes(sx + w - tail, sy, dx + w - tail, dy, tail, h);
+    }
+}
+
+/* Bitmap - build each plane byte and its opaque mask, then merge */
+static void planar_blit(int cx, int cy, int width, int height, const uint8_t* bitmap, int pitch) {
+    int first = cx >> 3;
+    int last = (cx + width - 1) >> 3;
+    for (int plane = 0; plane < 4; plane++) {
+        select_plane(plane);
+        for (int j = 0; j < height; j++) {
+            const uint8_t* src = bitmap + j * pitch - (cx & 7);
+            volatile uint8_t* dst = VGA_MEMORY + (cy + j) * BYTES_PER_LINE;
+            for (int b = first; b <= last; b++, src += 8) {
+                uint8_t bits = 0, mask = 0;
+                for (int i = 0; i < 8; i++) {
+                    int px = (b << 3) + i;
+                    if (px < cx || px >= cx + width) continue;
+                    uint8_t c = src[i];
+                    if (c == VGA_TRANSPARENT) continue;
+                    mask |= 0x80 >> i;
+                    if (c & (1 << plane)) bits |= 0x80 >> i;
+                }
+                if (mask) plane_merge(dst + b, bits, mask);
+            }
+        }
+    }
+}
+
+/* ============================================================================
+ * TEXT - glyph rows are written as whole bytes. The background of a run is
+ * one span fill; the foreground uses write mode 3, where the CPU byte (the
+ * glyph row, pre-shifted for unaligned x) is ANDed with the bit mask and
+ * set/reset supplies the colour. A whole run needs one register setup.
+ * ============================================================================ */
+
+static inline unsigned char glyph_index(char c) {
+    unsigned char uc = (unsigned char)c;
+    return uc > 127 ? '?' : uc;
+}
+
+/* Write one glyph row byte in write mode 3 (latch read keeps the rest) */
+static inline void text_byte(volatile uint8_t* row, int col, uint8_t bits) {
+    if (!bits || col < 0 || col >= BYTES_PER_LINE) return;
+    (void)row[col];
+    row[col] = bits;
+}
+
+/* The bits of glyph byte column col inside the clip columns [x0, x1] */
+static inline uint8_t clip_bits(uint8_t bits, int col, int x0, int x1) {
+    if (col < (x0 >> 3) || col > (x1 >> 3)) return 0;
+    if (col == (x0 >> 3)) bits &= 0xFF >> (x0 & 7);
+    if (col == (x1 >> 3)) bits &= (uint8_t)(0xFF << (7 - (x1 & 7)));
+    return bits;
+}
+
+/* Draw a run of n characters on one line in planar VRAM */
+static void planar_glyphs(int x, int y, const char* str, int n, uint8_t fg, uint8_t bg) {
+    int cx = x, cy = y, cw = n * 8, ch = 8;
+    if (!display_clip_rect(&cx, &cy, &cw, &ch)) return;
+    
+    /* Fast path: byte aligned and fully visible - cached glyph blits */
+    if (cw == n * 8 && ch == 8 && !(x & 7)) {
+        for (int i = 0; i < n; i++) {
+            blit_glyph(x + i * 8, y, glyph_index(str[i]), fg, bg);
+        }
+        return;
+    }
+    
+    set_solid_color(bg);
+    fill_spans(cx, cy, cw, ch);
+    
+    gc_write(GC_GRAPHICS_MODE, 0x03);
+    gc_write(GC_SET_RESET, fg & 0x0F);
+    set_bit_mask(0xFF);
+    
+    /* Only the characters the clip overlaps, masked at its edges */
+    int x1 = cx + cw - 1;
+    int shift = x & 7;
+    for (int i = (cx - x) >> 3; i <= (x1 - x) >> 3; i++) {
+        const uint8_t* glyph = font8x8[glyph_index(str[i])];
+        int col = (x >> 3) + i;
+        for (int r = cy - y; r < cy - y + ch; r++) {
+            volatile uint8_t* row = VGA_MEMORY + (y + r) * BYTES_PER_LINE;
+            uint8_t g = glyph[r];
+            if (!shift) {
+                text_byte(row, col, clip_bits(g, col, cx, x1));
+            } else {
+                text_byte(row, col, clip_bits((uint8_t)(g >> shift), col, cx, x1));
+                text_byte(row, col + 1, clip_bits((uint8_t)(g << (8 - shift)), col + 1, cx, x1));
+            }
+        }
+    }
+}
+
+/* Convert a shadow rect to planar form - whole bytes, so no latch reads */
+static void planar_present(const uint8_t* shadow, int pitch, int x0, int y0, int x1, int y1) {
+    int bytes = (x1 - x0) >> 3;
+    
+    gc_write(GC_GRAPHICS_MODE, 0x00);
+    gc_write(GC_DATA_ROTATE, 0x00);
+    gc_write(GC_ENABLE_SET_RESET, 0x00);
+    set_bit_mask(0xFF);
+    
+    for (int plane = 0; plane < 4; plane++) {
+        set_map_mask(1 << plane);
+        for (int y = y0; y < y1; y++) {
+            const uint8_t* src = shadow + y * pitch + x0;
+            volatile uint8_t* dst = VGA_MEMORY + y * BYTES_PER_LINE + (x0 >> 3);
+            for (int b = 0; b < bytes; b++) {
+                uint8_t bits = 0;
+                for (int i = 0; i < 8; i++) {
+                    bits = (uint8_t)((bits << 1) | ((src[i] >> plane) & 1));
+                }
+                dst[b] = bits;
+                src += 8;
+            }
+        }
+    }
+}
+
+/* Read the screen back one plane at a time */
+static void planar_readback(uint8_t* dst, int pitch) {
+    for (int y = 0; y < PLANAR_HEIGHT; y++) {
+        for (int x = 0; x < PLANAR_WIDTH; x++) {
+            dst[y * pitch + x] = 0;
+        }
+    }
+    for (int plane = 0; plane < 4; plane++) {
+        set_read_plane(plane);
+        for (int y = 0; y < PLANAR_HEIGHT; y++) {
+            uint8_t* row = dst + y * pitch;
+            for (int i = 0; i < BYTES_PER_LINE; i++) {
+                uint8_t bits = VGA_MEMORY[y * BYTES_PER_LINE + i];
+                for (int b = 7; b >= 0; b--) {
+                    *row++ |= ((bits >> b) & 1) << plane;
+                }
+            }
+        }
+    }
+}
+
+display_driver_t planar_driver = {
+    .name = "640x480",
+    .width = PLANAR_WIDTH,
+    .height = PLANAR_HEIGHT,
+    .init = planar_init,
+    .fill = planar_fill,
+    .getpixel = planar_getpixel,
+    .blit = planar_blit,
+    .copy = planar_copy,
+    .glyphs = planar_glyphs,
+    .sprite = planar_sprite,
+    .present = planar_present,
+    .readback = planar_readback,
+    .vsync = display_vga_vsync,
+};
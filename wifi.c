@@ -6,6 +6,8 @@
 #include "network.h"
 #include "vga.h"
 #include "keyboard.h"
+#include "apps.h"
+#include "timer.h"
 
 /* Simple string copy */
 static void strcpy_safe(char* dst, const char* src, int max) {
@@ -19,6 +21,10 @@ static void strcpy_safe(char* dst, const char* src, int max) {
 
 static int wifi_win = -1;
 
+/* How long "Scanning..." stays up before the list shows */
+#define SCAN_MS 1500
+static timer_entry_t scan_timer;
+
 typedef enum {
     WIFI_STATE_MENU,
     WIFI_STATE_SCANNING,
@@ -32,19 +38,18 @@ static char password_input[32] = "";
 static int password_cursor = 0;
 static char selected_ssid[32] = "";
 
-void app_wifi(void) {
-    wifi_win = gui_create_window(400, 80, 350, 280, "WiFi Manager");
-    gui_set_active_window(wifi_win);
-    wifi_state = WIFI_STATE_MENU;
-    selected_network = 0;
-    password_input[0] = 0;
-    password_cursor = 0;
-}
-
 int get_wifi_win(void) {
     return wifi_win;
 }
 
+/* Scan timer fired - show what was found */
+static void scan_done(void* data) {
+    (void)data;
+    if (wifi_state != WIFI_STATE_SCANNING) return;
+    wifi_state = WIFI_STATE_LIST;
+    gui_invalidate_window(wifi_win);
+}
+
 void wifi_draw_content(gui_window_t* win) {
     if (!win || !win->visible) return;
     
@@ -79,8 +84,6 @@ void wifi_draw_content(gui_window_t* win) {
     } else if (wifi_state == WIFI_STATE_SCANNING) {
         vga_putstring(x + 50, y + 100, "Scanning for", COLOR_BLACK, COLOR_WHITE);
         vga_putstring(x + 50, y + 120, "WiFi networks...", COLOR_BLACK, COLOR_WHITE);
-        network_scan_wifi();
-        wifi_state = WIFI_STATE_LIST;
         
     } else if (wifi_state == WIFI_STATE_LIST) {
         vga_putstring(x + 10, y + 10, "Available Networks:", COLOR_BLACK, COLOR_WHITE);
@@ -142,7 +145,7 @@ void wifi_draw_content(gui_window_t* win) {
     }
 }
 
-void wifi_handle_key(char key) {
+void wifi_handle_key(gui_window_t* win, char key) {
     if (wifi_state == WIFI_STATE_LIST) {
         int net_count = 0;
         network_get_networks(&net_count);
@@ -192,17 +195,48 @@ void wifi_handle_key(char key) {
             password_cursor++;
         }
     }
+    gui_invalidate_window(win->id);
 }
 
-void wifi_handle_click(int x, int y) {
+void wifi_handle_click(gui_window_t* win, int mx, int my) {
+    /* Relative to the content area, as drawn */
+    int x = mx - (win->x + 3);
+    int y = my - (win->y + 17);
+    
     if (wifi_state == WIFI_STATE_MENU) {
         /* Check "Scan Networks" button */
         if (x >= 20 && x <= 140 && y >= 100 && y <= 120) {
             wifi_state = WIFI_STATE_SCANNING;
+            network_scan_wifi();
+            timer_start(&scan_timer, SCAN_MS, 0, scan_done, 0);
         }
         /* Check "Disconnect" button */
         if (x >= 20 && x <= 140 && y >= 130 && y <= 150) {
             network_disconnect();
         }
     }
+    gui_invalidate_window(win->id);
+}
+
+static void wifi_closed(gui_window_t* win) {
+    timer_stop(&scan_timer);
+    app_window_closed(win);
+}
+
+static const gui_window_ops_t wifi_ops = {
+    .draw = wifi_draw_content,
+    .key = wifi_handle_key,
+    .click = wifi_handle_click,
+    .close = wifi_closed,
+};
+
+void app_wifi(void) {
+    if (gui_focus_window(wifi_win)) return;  /* already open */
+    wifi_win = gui_create_window(400, 80, 350, 280, "WiFi Manager");
+    gui_set_window_ops(wifi_win, &wifi_ops, &wifi_win);
+    gui_set_active_window(wifi_win);
+    wifi_state = WIFI_STATE_MENU;
+    selected_network = 0;
+    password_input[0] = 0;
+    password_cursor = 0;
 }
@@ -9,8 +9,8 @@
 
 void app_wifi(void);
 void wifi_draw_content(gui_window_t* win);
-void wifi_handle_key(char key);
-void wifi_handle_click(int x, int y);
+void wifi_handle_key(gui_window_t* win, char key);
+void wifi_handle_click(gui_window_t* win, int mx, int my);
 
 int get_wifi_win(void);
 